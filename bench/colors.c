@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Datastore.h"
+#include "Room.h"
+#include "Node.h"
+#include "Sensor.h"
+#include "ColorBatch.h"
+#include "Clock.h"
+
+// Time to map sensor values to pixel colors, ColorBatch against calling updateSensorPixel on every sensor.
+// Every node has a sensor of each type, with a random range so some values fall outside of it, and
+// every other sensor has a gradient of its own. Values stay the same between passes.
+
+#define SENSOR_TYPES    5
+#define MATRIX_COLUMNS  256 // Pixels are spread over rows of this width, each one at a position of its own
+
+void printUsage (const char* name) {
+    fprintf(stderr, "Usage: %s [-n sensors] [-p passes]\n", name);
+}
+
+Datastore* createSite (uint32_t nSensors) {
+    Datastore* datastore = createDatastore();
+    if (!datastore) {
+        return NULL;
+    }
+    datastore->bulkLoad = true;
+
+    Room* room = createRoom(datastore, 1);
+    if (!room) {
+        deleteDatastore(datastore);
+        return NULL;
+    }
+
+    Color stops[] = {{0, 0, 0}, {255, 0, 0}, {255, 255, 0}, {255, 255, 255}};
+    Node* node = NULL;
+    for (uint32_t s = 0; s < nSensors; s++) {
+        if (s % SENSOR_TYPES == 0) {
+            node = createNode(room, s / SENSOR_TYPES + 1);
+            if (!node) {
+                deleteDatastore(datastore);
+                return NULL;
+            }
+        }
+
+        Position pos = {s % MATRIX_COLUMNS, s / MATRIX_COLUMNS};
+        uint16_t rangeMin = rand() % 100;
+        Sensor* sensor = createSensor(node, s + 1, s % SENSOR_TYPES, &pos, rangeMin, rangeMin + 1 + rand() % 1000);
+        if (!sensor || (s % 2 && setSensorGradient(sensor, stops, sizeof(stops)/sizeof(stops[0])))) {
+            deleteDatastore(datastore);
+            return NULL;
+        }
+        setSensorValue(sensor, rand() & UINT16_MAX);
+    }
+
+    datastore->bulkLoad = false;
+
+    return datastore;
+}
+
+// Same work as the rules thread did before ColorBatch
+bool updateEverySensorPixel (Datastore* datastore) {
+    LL_iterator(datastore->rooms, room_elem) {
+        LL_iterator(((Room*)room_elem->ptr)->nodes, node_elem) {
+            LL_iterator(((Node*)node_elem->ptr)->sensors, sensor_elem) {
+                if (updateSensorPixel(sensor_elem->ptr)) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+// Hash of the colors of all pixels
+uint64_t hashPixels (Datastore* datastore) {
+    uint64_t hash = 14695981039346656037ULL;
+    LL_iterator(datastore->pixels, pixel_elem) {
+        Color* color = getPixelColor(pixel_elem->ptr);
+        hash = (hash ^ ((color->r << 16) | (color->g << 8) | color->b)) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Paints every pixel with a color no gradient gives, so the next pass has to write them all
+void clearPixels (Datastore* datastore) {
+    Color color = {1, 2, 3};
+    LL_iterator(datastore->pixels, pixel_elem) {
+        setPixelColor(pixel_elem->ptr, &color);
+    }
+}
+
+void printRate (const char* name, uint32_t nSensors, uint32_t nPasses, uint64_t time) {
+    printf("%-20s %8.1f ns/sensor\n", name, (double)time / nPasses / nSensors);
+}
+
+int main (int argc, char* argv[]) {
+    uint32_t nSensors = 15000;
+    uint32_t nPasses = 200;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:p:")) != -1) {
+        switch (option) {
+            case 'n':
+                nSensors = strtol(optarg, NULL, 10);
+                break;
+
+            case 'p':
+                nPasses = strtol(optarg, NULL, 10);
+                break;
+
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    // Sensor IDs are 16 bit
+    if (!nSensors || nSensors > UINT16_MAX || !nPasses) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    Datastore* datastore = createSite(nSensors);
+    if (!datastore) {
+        fprintf(stderr, "Error creating the site\n");
+        return 1;
+    }
+    printf("%u sensors, %u passes\n", nSensors, nPasses);
+
+    // Both must give every pixel the same color
+    clearPixels(datastore);
+    bool error = updateEverySensorPixel(datastore);
+    uint64_t perSensor = hashPixels(datastore);
+    clearPixels(datastore);
+    error = error || updateSensorPixels(datastore);
+    if (error || hashPixels(datastore) != perSensor) {
+        fprintf(stderr, "%s\n", error ? "Error updating the pixels" : "Pixel colors differ between ColorBatch and updateSensorPixel");
+        deleteDatastore(datastore);
+        return 1;
+    }
+
+    uint64_t start = getMonotonicTimeNs();
+    for (uint32_t i = 0; i < nPasses; i++) {
+        updateEverySensorPixel(datastore);
+    }
+    printRate("updateSensorPixel", nSensors, nPasses, getMonotonicTimeNs() - start);
+
+    start = getMonotonicTimeNs();
+    for (uint32_t i = 0; i < nPasses; i++) {
+        updateSensorPixels(datastore);
+    }
+    printRate("ColorBatch", nSensors, nPasses, getMonotonicTimeNs() - start);
+
+    deleteDatastore(datastore);
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ImportConfiguration.h"
+#include "Clock.h"
+
+// Load time of a generated site. Every device is a node with a sensor, an actuator and a rule
+// driving the actuator from the sensor, NODES_PER_ROOM nodes to a room. The file is left in place.
+
+#define NODES_PER_ROOM  100
+
+void printUsage (const char* name) {
+    fprintf(stderr, "Usage: %s [-n devices] [file]\n", name);
+}
+
+bool writeSite (const char* filename, uint32_t nDevices) {
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        return true;
+    }
+
+    // Square matrix with a pixel for every sensor and actuator
+    uint32_t side = (uint32_t)ceil(sqrt(2.0 * nDevices));
+    fprintf(file, "{\"matrix\": {\"width\": %u, \"height\": %u},\n\"rooms\": [", side, side);
+    for (uint32_t n = 1; n <= nDevices; n++) {
+        uint32_t pixel = 2*(n-1);
+        if (n % NODES_PER_ROOM == 1) {
+            fprintf(file, "%s\n{\"id\": %u, \"name\": \"Room %u\", \"nodes\": [", n > 1 ? "]}," : "",
+                n / NODES_PER_ROOM + 1, n / NODES_PER_ROOM + 1);
+        }
+        fprintf(file, "%s\n  {\"id\": %u, \"period\": 60000,"
+            " \"sensors\": [{\"id\": %u, \"type\": %u, \"posX\": %u, \"posY\": %u, \"rangeMin\": 0, \"rangeMax\": 1000}],"
+            " \"actuators\": [{\"id\": %u, \"type\": 0, \"posX\": %u, \"posY\": %u}]}",
+            n % NODES_PER_ROOM == 1 ? "" : ",", n, n, n % 5, pixel % side, pixel / side, n, (pixel+1) % side, (pixel+1) / side);
+    }
+    fprintf(file, "]}\n],\n\"rules\": [");
+    for (uint32_t n = 1; n <= nDevices; n++) {
+        fprintf(file, "%s\n  {\"id\": %u, \"type\": %u, \"value\": %u, \"sensors\": [%u], \"actuators\": [%u], \"profiles\": [%s], \"childs\": []}",
+            n > 1 ? "," : "", n, n % 2, 10 + n % 90, n, n, n % 3 ? "" : "1");
+    }
+    fprintf(file, "\n],\n\"pixels\": [],\n\"profiles\": [{\"id\": 1, \"name\": \"Working hours\", \"start\": \"08:00\", \"end\": \"20:00\"}]}\n");
+
+    return fclose(file) != 0;
+}
+
+void printTime (const char* name, uint64_t start) {
+    printf("%-8s %8.1f ms\n", name, (getMonotonicTimeNs() - start) / 1e6);
+}
+
+int main (int argc, char* argv[]) {
+    uint32_t nDevices = 50000;
+    const char* filename = "/tmp/GASbench.json";
+
+    int option;
+    while ((option = getopt(argc, argv, "n:")) != -1) {
+        switch (option) {
+            case 'n':
+                nDevices = strtol(optarg, NULL, 10);
+                break;
+
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc) {
+        filename = argv[optind];
+    }
+
+    // IDs are 16 bit
+    if (!nDevices || nDevices > UINT16_MAX) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (writeSite(filename, nDevices)) {
+        fprintf(stderr, "Error writing %s\n", filename);
+        return 1;
+    }
+
+    struct stat info;
+    stat(filename, &info);
+    printf("%u devices, %s, %.1f MB\n", nDevices, filename, info.st_size / 1e6);
+
+    uint64_t start = getMonotonicTimeNs();
+    char* json = getJSONStringFromFile(filename);
+    printTime("read", start);
+
+    start = getMonotonicTimeNs();
+    cJSON* root = json ? cJSON_Parse(json) : NULL;
+    printTime("parse", start);
+    cJSON_Delete(root);
+    free(json);
+    if (!root) {
+        fprintf(stderr, "Error parsing %s\n", filename);
+        return 1;
+    }
+
+    // Read, parse and build the datastore, as on startup
+    start = getMonotonicTimeNs();
+    Datastore* datastore = importConfiguration(filename);
+    printTime("import", start);
+    if (!datastore) {
+        fprintf(stderr, "Error importing %s\n", filename);
+        return 1;
+    }
+
+    start = getMonotonicTimeNs();
+    deleteDatastore(datastore);
+    printTime("delete", start);
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "FrameWriter.h"
+#include "Clock.h"
+
+// Text frames per second written to /dev/null, FrameWriter against the fprintf loop it replaced.
+// Both are first run over the same changing frames into temporary files, which must be identical.
+
+#define CHECK_FRAMES    2000
+
+void printUsage (const char* name) {
+    fprintf(stderr, "Usage: %s [-w width] [-h height] [-f frames]\n", name);
+}
+
+// Text output as it was written before FrameWriter kept the frame formatted
+void writeTextLoop (FILE* stream, const uint8_t* frame, uint16_t width, uint16_t height) {
+    fprintf(stream, "[");
+    for (uint16_t x = 0; x < width; x++) {
+        for (uint16_t y = 0; y < height; y++) {
+            const uint8_t* rgb = frame + ((uint32_t)y*width + x)*3;
+            fprintf(stream, "[%d,%d,%d]", rgb[0], rgb[1], rgb[2]);
+            if (y < height-1) {
+                fprintf(stream, ",");
+            }
+        }
+        if (x < width-1) {
+            fprintf(stream, ",");
+        }
+    }
+    fprintf(stream, "]\n");
+}
+
+// Changes a few channels, some of them by one so the length of their text changes now and then
+void changeFrame (uint8_t* frame, size_t size, uint32_t n) {
+    for (uint32_t k = 0; k < n % 7; k++) {
+        frame[rand() % size] = (n % 3) ? rand() : frame[rand() % size] + 1;
+    }
+}
+
+bool sameContents (FILE* a, FILE* b) {
+    rewind(a);
+    rewind(b);
+
+    int c;
+    while ((c = fgetc(a)) == fgetc(b)) {
+        if (c == EOF) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool checkOutput (uint8_t* frame, size_t size, uint16_t width, uint16_t height) {
+    FILE* loop = tmpfile();
+    FILE* written = tmpfile();
+    FrameWriter* writer = written ? createFrameWriter(written, FRAME_FORMAT_TEXT, width, height) : NULL;
+    bool error = !loop || !writer;
+
+    for (uint32_t n = 1; n <= CHECK_FRAMES && !error; n++) {
+        changeFrame(frame, size, n);
+        writeTextLoop(loop, frame, width, height);
+        error = writeFrame(writer, frame, n, NULL);
+    }
+    error = error || fflush(loop) || fflush(written) || !sameContents(loop, written);
+
+    if (writer) {
+        deleteFrameWriter(writer);
+    }
+    if (loop) {
+        fclose(loop);
+    }
+    if (written) {
+        fclose(written);
+    }
+
+    return error;
+}
+
+// mode 0: fprintf loop, 1: FrameWriter with the same frame, 2: FrameWriter with one channel changed per frame
+bool runMode (uint8_t mode, uint8_t* frame, size_t size, uint16_t width, uint16_t height, uint32_t nFrames) {
+    static const char* names[] = {"fprintf loop", "writer, same frame", "writer, 1 change"};
+
+    FILE* stream = fopen("/dev/null", "w");
+    FrameWriter* writer = stream ? createFrameWriter(stream, FRAME_FORMAT_TEXT, width, height) : NULL;
+    if (!writer) {
+        if (stream) {
+            fclose(stream);
+        }
+        return true;
+    }
+
+    bool error = false;
+    uint64_t start = getMonotonicTimeNs();
+    for (uint32_t n = 1; n <= nFrames && !error; n++) {
+        if (mode == 0) {
+            writeTextLoop(stream, frame, width, height);
+            continue;
+        }
+        if (mode == 2) {
+            frame[(n*37) % size] ^= 1;
+        }
+        error = writeFrame(writer, frame, n, NULL);
+    }
+    error = fflush(stream) || error;
+    double seconds = (getMonotonicTimeNs() - start) / 1e9;
+
+    printf("%-20s %10.0f frames/s\n", names[mode], nFrames / seconds);
+
+    deleteFrameWriter(writer);
+    fclose(stream);
+
+    return error;
+}
+
+int main (int argc, char* argv[]) {
+    uint16_t width = 30;
+    uint16_t height = 30;
+    uint32_t nFrames = 20000;
+
+    int option;
+    while ((option = getopt(argc, argv, "w:h:f:")) != -1) {
+        switch (option) {
+            case 'w':
+                width = strtol(optarg, NULL, 10);
+                break;
+
+            case 'h':
+                height = strtol(optarg, NULL, 10);
+                break;
+
+            case 'f':
+                nFrames = strtol(optarg, NULL, 10);
+                break;
+
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (!width || !height || !nFrames) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    size_t size = (size_t)width*height*3;
+    uint8_t* frame = (uint8_t*)malloc(size);
+    if (!frame) {
+        fprintf(stderr, "Error allocating the frame\n");
+        return 1;
+    }
+
+    srand(1);
+    for (size_t i = 0; i < size; i++) {
+        frame[i] = rand();
+    }
+
+    if (checkOutput(frame, size, width, height)) {
+        fprintf(stderr, "FrameWriter output differs from the fprintf loop\n");
+        free(frame);
+        return 1;
+    }
+    printf("%ux%u pixels, %u frames\n", width, height, nFrames);
+
+    for (uint8_t mode = 0; mode < 3; mode++) {
+        if (runMode(mode, frame, size, width, height, nFrames)) {
+            fprintf(stderr, "Error writing frames\n");
+            free(frame);
+            return 1;
+        }
+    }
+
+    free(frame);
+
+    return 0;
+}
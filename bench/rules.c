@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Datastore.h"
+#include "Room.h"
+#include "Node.h"
+#include "Sensor.h"
+#include "Actuator.h"
+#include "Rule.h"
+#include "RuleWorkers.h"
+#include "Clock.h"
+
+// Rule evaluations per second on a generated site, compiled program against walking the rule trees.
+// Every node has a sensor of each type and RULES_PER_NODE actuators, each driven by a rule of its own.
+// With -j, the program is also run on worker pools of 2, 4, ... threads, up to the given count.
+
+#define SENSOR_TYPES    5
+#define RULES_PER_NODE  4
+#define MATRIX_COLUMNS  256 // Pixels are spread over rows of this width, each one at a position of its own
+
+void printUsage (const char* name) {
+    fprintf(stderr, "Usage: %s [-n rules] [-p passes] [-j threads]\n", name);
+}
+
+// Next free pixel position
+Position* nextPosition (Position* pos) {
+    pos->x++;
+    if (pos->x == MATRIX_COLUMNS) {
+        pos->x = 0;
+        pos->y++;
+    }
+
+    return pos;
+}
+
+Datastore* createSite (uint32_t nRules) {
+    Datastore* datastore = createDatastore();
+    if (!datastore) {
+        return NULL;
+    }
+    datastore->bulkLoad = true;
+
+    Room* room = createRoom(datastore, 1);
+    if (!room) {
+        deleteDatastore(datastore);
+        return NULL;
+    }
+
+    Position pos = {0, 0};
+    uint32_t nNodes = (nRules + RULES_PER_NODE - 1) / RULES_PER_NODE;
+    uint16_t operations[] = {TYPE_RULE_LESS_THEN, TYPE_RULE_GREATER_THEN, TYPE_RULE_WITHIN_MARGIN};
+    uint32_t rule = 0;
+    for (uint32_t n = 0; n < nNodes; n++) {
+        Node* node = createNode(room, n + 1);
+        if (!node) {
+            deleteDatastore(datastore);
+            return NULL;
+        }
+
+        Sensor* sensors[SENSOR_TYPES];
+        for (uint8_t type = 0; type < SENSOR_TYPES; type++) {
+            sensors[type] = createSensor(node, n*SENSOR_TYPES + type + 1, type, nextPosition(&pos), 0, UINT16_MAX);
+            if (!sensors[type]) {
+                deleteDatastore(datastore);
+                return NULL;
+            }
+            setSensorValue(sensors[type], rand() & UINT16_MAX);
+        }
+
+        for (uint32_t a = 0; a < RULES_PER_NODE && rule < nRules; a++, rule++) {
+            Actuator* actuator = createActuator(node, rule + 1, 0, nextPosition(&pos));
+            Sensor* sensor = sensors[rule % SENSOR_TYPES];
+            Rule* newRule = createRule(datastore, NULL, rule + 1, operations[rule % 3], rand() % 100);
+            if (!actuator || !newRule || addSensorToRule(newRule, sensor) || addActuatorToRule(newRule, actuator)) {
+                deleteDatastore(datastore);
+                return NULL;
+            }
+        }
+    }
+
+    datastore->bulkLoad = false;
+
+    return datastore;
+}
+
+// Same work as executeRules does when the rules can not be compiled
+bool walkRules (Datastore* datastore) {
+    Color colorActive = {RULE_ACTIVE_RED, RULE_ACTIVE_GREEN, RULE_ACTIVE_BLUE},
+        colorInactive = {RULE_INACTIVE_RED, RULE_INACTIVE_GREEN, RULE_INACTIVE_BLUE};
+
+    LL_iterator(datastore->rules, rule_elem) {
+        Rule* rule = rule_elem->ptr;
+        bool active = evaluateRule(rule, false, NULL);
+        LL_iterator(rule->actuators, actuator_elem) {
+            if (setPixelColor(getActuatorPixel(actuator_elem->ptr), active ? &colorActive : &colorInactive)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void printRate (const char* name, uint32_t nRules, uint32_t nPasses, uint64_t time) {
+    double seconds = time / 1e9;
+    printf("%-20s %10.0f passes/s %12.0f rule evaluations/s\n", name, nPasses / seconds, (double)nRules * nPasses / seconds);
+}
+
+// Hash of the colors of all pixels, which show the state of the actuators
+uint64_t hashPixels (Datastore* datastore) {
+    uint64_t hash = 14695981039346656037ULL;
+    LL_iterator(datastore->pixels, pixel_elem) {
+        Color* color = getPixelColor(pixel_elem->ptr);
+        hash = (hash ^ ((color->r << 16) | (color->g << 8) | color->b)) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Runs the program on a pool of nThreads, 1 being the sequential path, and hashes the outcome
+bool runOnWorkers (Datastore* datastore, uint32_t nRules, uint32_t nPasses, uint32_t nThreads, uint64_t* outcome) {
+    RuleWorkers* workers = createRuleWorkers(nThreads);
+    if (!workers) {
+        return true;
+    }
+
+    // The first pass partitions the program for the pool
+    bool error = executeRulesOnWorkers(workers, datastore, false, NULL);
+
+    uint64_t start = getMonotonicTimeNs();
+    for (uint32_t i = 0; i < nPasses && !error; i++) {
+        error = executeRulesOnWorkers(workers, datastore, false, NULL);
+    }
+    uint64_t time = getMonotonicTimeNs() - start;
+    *outcome = hashPixels(datastore);
+
+    char name[32];
+    snprintf(name, sizeof(name), "program, %u thread%s", nThreads, nThreads > 1 ? "s" : "");
+    printRate(name, nRules, nPasses, time);
+
+    deleteRuleWorkers(workers);
+
+    return error;
+}
+
+int main (int argc, char* argv[]) {
+    uint32_t nRules = 10000;
+    uint32_t nPasses = 1000;
+    uint32_t nThreads = 1;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:p:j:")) != -1) {
+        switch (option) {
+            case 'n':
+                nRules = strtol(optarg, NULL, 10);
+                break;
+
+            case 'p':
+                nPasses = strtol(optarg, NULL, 10);
+                break;
+
+            case 'j':
+                nThreads = strtol(optarg, NULL, 10);
+                break;
+
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    // Sensor IDs are 16 bit
+    if (!nRules || nRules > UINT16_MAX / SENSOR_TYPES * RULES_PER_NODE || !nPasses ||
+        !nThreads || nThreads > RULE_WORKERS_MAX_THREADS) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    Datastore* datastore = createSite(nRules);
+    if (!datastore) {
+        fprintf(stderr, "Error creating the site\n");
+        return 1;
+    }
+    printf("%u rules, %u passes\n", nRules, nPasses);
+
+    // The first pass compiles the program
+    if (executeRules(datastore, false, NULL)) {
+        fprintf(stderr, "Error executing the rules\n");
+        deleteDatastore(datastore);
+        return 1;
+    }
+
+    // 1, 2, 4, ... threads, ending with the count asked for. Actuators must end up the same on all of them.
+    uint32_t threads = 1;
+    uint64_t sequential = 0;
+    while (true) {
+        uint64_t outcome;
+        if (runOnWorkers(datastore, nRules, nPasses, threads, &outcome)) {
+            fprintf(stderr, "Error executing the rules on %u threads\n", threads);
+            deleteDatastore(datastore);
+            return 1;
+        }
+
+        if (threads == 1) {
+            sequential = outcome;
+        }
+        else if (outcome != sequential) {
+            fprintf(stderr, "Actuators differ between 1 and %u threads\n", threads);
+            deleteDatastore(datastore);
+            return 1;
+        }
+
+        if (threads == nThreads) {
+            break;
+        }
+        threads = (threads*2 < nThreads) ? threads*2 : nThreads;
+    }
+
+    uint64_t start = getMonotonicTimeNs();
+    for (uint32_t i = 0; i < nPasses; i++) {
+        walkRules(datastore);
+    }
+    printRate("tree walk", nRules, nPasses, getMonotonicTimeNs() - start);
+
+    deleteDatastore(datastore);
+
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "Actuator.h"
+#include "RuleProgram.h"
 
 Actuator* createActuator (Node* node, uint16_t id, uint8_t type, Position* pos) {
     if (!node) {
@@ -13,7 +14,7 @@ Actuator* createActuator (Node* node, uint16_t id, uint8_t type, Position* pos)
     Room* room = (Room*)node->parentRoom;
     Datastore* datastore = (Datastore*)room->parentDatastore;
     
-    if (findActuatorByID(datastore, id)) {
+    if (!datastore->bulkLoad && findActuatorByID(datastore, id)) {
         // There is already a Actuator with this ID
         deletePixel(pixel);
         return NULL;
@@ -39,6 +40,7 @@ Actuator* createActuator (Node* node, uint16_t id, uint8_t type, Position* pos)
     actuator->parentNode = node;
     actuator->listPtr = elem;
     actuator->pixel = pixel;
+    actuator->slot = 0;
 
     return actuator;
 }
@@ -50,6 +52,7 @@ bool deleteActuator (Actuator* actuator) {
 
     // Remove Actuator from existing rules
     Datastore* datastore = actuator->parentNode->parentRoom->parentDatastore;
+    invalidateRuleProgram(datastore);
     LL_iterator(datastore->rules, rule_elem) {
         Rule* rule = rule_elem->ptr;
         LL_iterator(rule->actuators, ruleActuator_elem) {
@@ -14,6 +14,10 @@ typedef struct _actuator Actuator;
 #include "Node.h"
 #include "Position.h"
 
+// How the outputs of several rules driving the same actuator are combined
+#define ACTUATOR_POLICY_LAST_WRITER 0   // Last rule in rule order wins
+#define ACTUATOR_POLICY_ANY_TRUE    1   // Active if any rule is active
+#define ACTUATOR_POLICY_PRIORITY    2   // Highest priority rule wins, ties go to the last one
 
 /**
  * @brief Structure to hold all data concerning an actuator.
@@ -25,6 +29,7 @@ struct _actuator {
     uint16_t id;
     uint8_t type;
     Pixel* pixel;
+    uint32_t slot;  // Command slot in the compiled rule program, only valid if the program maps it back to this actuator
 };
 
 /**
@@ -0,0 +1,15 @@
+#include "Clock.h"
+
+uint64_t getMonotonicTime () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec*1000 + now.tv_nsec/1000000;
+}
+
+uint64_t getMonotonicTimeNs () {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec*1000000000 + now.tv_nsec;
+}
@@ -0,0 +1,23 @@
+#ifndef __CLOCK__
+#define __CLOCK__
+
+#include <stdint.h>
+#include <time.h>
+
+
+/**
+ * @brief Current time of the monotonic clock. Unaffected by changes of the wall clock,
+ * only meaningful when compared with other readings of this clock.
+ * 
+ * @return uint64_t Milliseconds since an arbitrary point in the past
+ */
+uint64_t getMonotonicTime ();
+
+/**
+ * @brief Current time of the monotonic clock, with the resolution needed to time short operations
+ * 
+ * @return uint64_t Nanoseconds since an arbitrary point in the past
+ */
+uint64_t getMonotonicTimeNs ();
+
+#endif
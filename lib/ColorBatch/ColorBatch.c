@@ -0,0 +1,250 @@
+#include "ColorBatch.h"
+#include "Metrics.h"
+#include "Clock.h"
+#include <string.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define COLOR_KERNEL_X86
+#endif
+
+ColorBatch* compileColorBatch (Datastore* datastore) {
+    if (!datastore) {
+        return NULL;
+    }
+
+    ColorBatch* batch = (ColorBatch*)malloc(sizeof(ColorBatch));
+    if (!batch) {
+        return NULL;
+    }
+
+    uint32_t size = 0;
+    LL_iterator(datastore->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+            size += listSize(node->sensors);
+        }
+    }
+
+    // One more slot, so an empty batch still gets valid arrays
+    batch->size = 0;
+    batch->sensors = (Sensor**)malloc((size + 1)*sizeof(Sensor*));
+    batch->pixels = (Pixel**)malloc((size + 1)*sizeof(Pixel*));
+    batch->colors = (Color**)malloc((size + 1)*sizeof(Color*));
+    batch->luts = (const Color**)malloc((size + 1)*sizeof(Color*));
+    batch->scale = (float*)malloc((size + 1)*sizeof(float));
+    batch->offset = (float*)malloc((size + 1)*sizeof(float));
+    batch->values = (float*)malloc((size + 1)*sizeof(float));
+    batch->steps = (uint8_t*)malloc((size + 1)*sizeof(uint8_t));
+    batch->seen = (uint64_t*)calloc(size + 1, sizeof(uint64_t));
+    batch->fresh = (uint64_t*)malloc((size + 1)*sizeof(uint64_t));
+    batch->nFresh = 0;
+    if (!batch->sensors || !batch->pixels || !batch->colors || !batch->luts || !batch->scale ||
+        !batch->offset || !batch->values || !batch->steps || !batch->seen || !batch->fresh) {
+
+        deleteColorBatch(batch);
+        return NULL;
+    }
+
+    LL_iterator(datastore->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+            LL_iterator(node->sensors, sensor_elem) {
+                Sensor* sensor = (Sensor*)sensor_elem->ptr;
+                if (!sensor->pixel || !sensor->gradient || batch->size == size) {
+                    continue;
+                }
+
+                uint32_t i = batch->size++;
+                batch->sensors[i] = sensor;
+                batch->pixels[i] = sensor->pixel;
+                batch->colors[i] = sensor->pixel->color;
+                batch->luts[i] = sensor->gradient->lut;
+                getSensorColorScale(sensor, &batch->scale[i], &batch->offset[i]);
+            }
+        }
+    }
+
+    return batch;
+}
+
+bool deleteColorBatch (ColorBatch* batch) {
+    if (!batch) {
+        return true;
+    }
+
+    free(batch->sensors);
+    free(batch->pixels);
+    free(batch->colors);
+    free(batch->luts);
+    free(batch->scale);
+    free(batch->offset);
+    free(batch->values);
+    free(batch->steps);
+    free(batch->seen);
+    free(batch->fresh);
+    free(batch);
+
+    return false;
+}
+
+void colorKernelScalar (const float* values, const float* scale, const float* offset, uint32_t start, uint32_t n, uint8_t* steps) {
+    for (uint32_t i = start; i < n; i++) {
+        steps[i] = getGradientStep(values[i], scale[i], offset[i]);
+    }
+}
+
+#ifdef COLOR_KERNEL_X86
+
+// max(x, 0) gives 0 for NaN, like the scalar code, as long as x is the first operand
+
+__attribute__((target("avx2")))
+void colorKernelAVX2 (const float* values, const float* scale, const float* offset, uint32_t n, uint8_t* steps) {
+    const __m256 low = _mm256_setzero_ps(),
+        high = _mm256_set1_ps(GRADIENT_STEPS - 1);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    uint32_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i step[4];
+        for (uint8_t j = 0; j < 4; j++) {
+            __m256 x = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(values+i+8*j), _mm256_loadu_ps(scale+i+8*j)),
+                _mm256_loadu_ps(offset+i+8*j));
+            step[j] = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(x, low), high));
+        }
+
+        // Packing works within 128 bit lanes, the permute puts the 32 bit groups back in order
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(step[0], step[1]), _mm256_packs_epi32(step[2], step[3]));
+        _mm256_storeu_si256((__m256i*)(steps+i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+
+    colorKernelScalar(values, scale, offset, i, n, steps);
+}
+
+void colorKernelSSE2 (const float* values, const float* scale, const float* offset, uint32_t n, uint8_t* steps) {
+    const __m128 low = _mm_setzero_ps(),
+        high = _mm_set1_ps(GRADIENT_STEPS - 1);
+
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i step[4];
+        for (uint8_t j = 0; j < 4; j++) {
+            __m128 x = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values+i+4*j), _mm_loadu_ps(scale+i+4*j)),
+                _mm_loadu_ps(offset+i+4*j));
+            step[j] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(x, low), high));
+        }
+
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(step[0], step[1]), _mm_packs_epi32(step[2], step[3]));
+        _mm_storeu_si128((__m128i*)(steps+i), packed);
+    }
+
+    colorKernelScalar(values, scale, offset, i, n, steps);
+}
+
+#endif
+
+void colorKernel (const float* values, const float* scale, const float* offset, uint32_t n, uint8_t* steps) {
+#ifdef COLOR_KERNEL_X86
+    if (__builtin_cpu_supports("avx2")) {
+        colorKernelAVX2(values, scale, offset, n, steps);
+    }
+    else {
+        colorKernelSSE2(values, scale, offset, n, steps);
+    }
+#else
+    colorKernelScalar(values, scale, offset, 0, n, steps);
+#endif
+}
+
+bool updateColorBatch (ColorBatch* batch) {
+    if (!batch) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < batch->size; i++) {
+        batch->values[i] = getSensorValue(batch->sensors[i]);
+    }
+
+    colorKernel(batch->values, batch->scale, batch->offset, batch->size, batch->steps);
+
+    const Color colorStale = {NODE_STALE_RED, NODE_STALE_GREEN, NODE_STALE_BLUE};
+    uint32_t nStale = 0;
+    for (uint32_t i = 0; i < batch->size; i++) {
+        bool stale = isSensorStale(batch->sensors[i]);
+        nStale += stale;
+        const Color* color = stale ? &colorStale : &batch->luts[i][batch->steps[i]];
+
+        // Only this thread writes the pixel: reading it back needs no lock
+        Color* current = batch->colors[i];
+        if (current->r == color->r && current->g == color->g && current->b == color->b) {
+            continue;
+        }
+
+        pthread_mutex_lock(&batch->pixels[i]->mutex);
+        *current = *color;
+        pthread_mutex_unlock(&batch->pixels[i]->mutex);
+    }
+    setMetricGauge(METRIC_STALE_SENSORS, nStale);
+
+    return false;
+}
+
+// ColorBatch of the datastore, compiled on first use
+ColorBatch* getColorBatch (Datastore* datastore) {
+    if (!datastore->colors) {
+        datastore->colors = compileColorBatch(datastore);
+    }
+
+    return datastore->colors;
+}
+
+bool updateSensorPixels (Datastore* datastore) {
+    if (!datastore || !getColorBatch(datastore)) {
+        return true;
+    }
+
+    return updateColorBatch(datastore->colors);
+}
+
+bool claimSensorSamples (Datastore* datastore) {
+    if (!datastore || !getColorBatch(datastore)) {
+        return true;
+    }
+
+    ColorBatch* batch = datastore->colors;
+    batch->nFresh = 0;
+    for (uint32_t i = 0; i < batch->size; i++) {
+        uint64_t received = __atomic_load_n(&batch->sensors[i]->received, __ATOMIC_ACQUIRE);
+        if (received && received != batch->seen[i]) {
+            batch->seen[i] = received;
+            batch->fresh[batch->nFresh++] = received;
+        }
+    }
+
+    return false;
+}
+
+bool recordSampleLatency (Datastore* datastore, uint8_t histogram) {
+    if (!datastore || !datastore->colors) {
+        return true;
+    }
+
+    ColorBatch* batch = datastore->colors;
+    uint64_t now = getMonotonicTimeNs();
+    for (uint32_t i = 0; i < batch->nFresh; i++) {
+        recordMetricTime(histogram, now - batch->fresh[i]);
+    }
+
+    return false;
+}
+
+void invalidateColorBatch (Datastore* datastore) {
+    if (!datastore || !datastore->colors) {
+        return;
+    }
+
+    deleteColorBatch(datastore->colors);
+    datastore->colors = NULL;
+}
@@ -0,0 +1,120 @@
+#ifndef __COLOR_BATCH__
+#define __COLOR_BATCH__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct _color_batch ColorBatch;
+
+#include "Datastore.h"
+#include "Sensor.h"
+#include "Pixel.h"
+#include "Gradient.h"
+
+
+/**
+ * @brief Sensors of a Datastore and the pixels showing them, stored as structure of
+ * arrays so their colors can be computed many at a time.
+ *
+ * The range of each sensor is turned once into a scale and offset giving the step of
+ * its gradient lookup table, so mapping a value to a color is a multiply-add, a
+ * saturating conversion and a table load.
+ *
+ * Pixels of sensors are only written by the thread updating the batch, which keeps
+ * them unlocked for reading and only takes the pixel lock when the color changes.
+ *
+ * seen holds the receive time of the last sample of each sensor claimed for latency
+ * tracing, fresh the receive times of the samples claimed by the current pass.
+ *
+ */
+struct _color_batch {
+    uint32_t size;
+    Sensor** sensors;
+    Pixel** pixels;
+    Color** colors;
+    const Color** luts;
+    float* scale;
+    float* offset;
+    float* values;
+    uint8_t* steps;
+    uint64_t* seen;
+    uint64_t* fresh;
+    uint32_t nFresh;
+};
+
+/**
+ * @brief Gathers every sensor of the datastore with its pixel and gradient
+ *
+ * @param datastore Pointer to the Datastore object
+ * @return ColorBatch* Pointer to the new ColorBatch object. NULL if error.
+ */
+ColorBatch* compileColorBatch (Datastore* datastore);
+
+/**
+ * @brief Delete a ColorBatch object
+ *
+ * @param batch Pointer to the ColorBatch object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteColorBatch (ColorBatch* batch);
+
+/**
+ * @brief Maps the current value of every sensor of the batch to a color and writes it
+ * to its pixel. Sensors that stopped reporting are drawn gray.
+ *
+ * @param batch Pointer to the ColorBatch object
+ * @return true Error
+ * @return false All good
+ */
+bool updateColorBatch (ColorBatch* batch);
+
+/**
+ * @brief Updates the pixels of all sensors of a datastore, compiling its ColorBatch if needed.
+ * Only ever called from the thread rendering the frames.
+ *
+ * @param datastore Pointer to the Datastore object
+ * @return true Error
+ * @return false All good
+ */
+bool updateSensorPixels (Datastore* datastore);
+
+/**
+ * @brief Claims the samples received since the previous call, for the pass about to
+ * start to trace them. Only the latest sample of each sensor is seen: samples replaced
+ * before a pass reads them never reach a pixel and are not traced.
+ * Only ever called from the thread rendering the frames, compiling the ColorBatch if needed.
+ *
+ * @param datastore Pointer to the Datastore object
+ * @return true Error
+ * @return false All good
+ */
+bool claimSensorSamples (Datastore* datastore);
+
+/**
+ * @brief Records, for every sample claimed by claimSensorSamples, the time since it was received
+ *
+ * @param datastore Pointer to the Datastore object
+ * @param histogram One of the histogram METRIC_*
+ * @return true Error
+ * @return false All good
+ */
+bool recordSampleLatency (Datastore* datastore, uint8_t histogram);
+
+/**
+ * @brief Computes the gradient step of n values, value*scale + offset truncated and
+ * saturated to [0, GRADIENT_STEPS-1], the same as getGradientStep.
+ * Uses AVX2 or SSE2 when available, falling back to scalar code.
+ *
+ */
+void colorKernel (const float* values, const float* scale, const float* offset, uint32_t n, uint8_t* steps);
+
+/**
+ * @brief Drops the ColorBatch of the datastore so it gets rebuilt on the next update
+ *
+ * @param datastore Pointer to the Datastore object
+ */
+void invalidateColorBatch (Datastore* datastore);
+
+#endif
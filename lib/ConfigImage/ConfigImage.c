@@ -0,0 +1,568 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ConfigImage.h"
+
+#define ALIGN8(size) ((((uint64_t)(size)) + 7) & ~(uint64_t)7)
+
+// Pointer to index map, kept sorted by pointer so it can be searched while writing
+typedef struct {
+    const void* ptr;
+    uint32_t index;
+} ImageIndex;
+
+int compareImageIndex (const void* a, const void* b) {
+    const void* pa = ((const ImageIndex*)a)->ptr;
+    const void* pb = ((const ImageIndex*)b)->ptr;
+
+    return (pa > pb) - (pa < pb);
+}
+
+uint32_t findImageIndex (ImageIndex* indexes, uint32_t n, const void* ptr) {
+    ImageIndex key = {ptr, 0};
+    ImageIndex* found = bsearch(&key, indexes, n, sizeof(ImageIndex), &compareImageIndex);
+
+    return found ? found->index : CONFIG_IMAGE_NONE;
+}
+
+// FNV-1a
+uint64_t getImageChecksum (const uint8_t* data, uint64_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint64_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+// Appends a string to the string area of the image, returning its offset
+uint32_t addImageString (uint8_t* strings, uint64_t* size, const char* str) {
+    if (!str) {
+        return CONFIG_IMAGE_NONE;
+    }
+
+    uint32_t offset = (uint32_t)*size;
+    size_t length = strlen(str) + 1;
+    if (strings) {
+        memcpy(strings + offset, str, length);
+    }
+    *size += length;
+
+    return offset;
+}
+
+bool writeConfigImage (Datastore* datastore, const char* filename, const char* sourceFilename) {
+    if (!datastore || !filename || !sourceFilename) {
+        return true;
+    }
+
+    struct stat source;
+    if (stat(sourceFilename, &source)) {
+        return true;
+    }
+
+    // Count every element and the space taken by the strings
+    ConfigImageHeader header;
+    memset(&header, 0, sizeof(ConfigImageHeader));
+    header.magic = CONFIG_IMAGE_MAGIC;
+    header.version = CONFIG_IMAGE_VERSION;
+    header.sourceSize = (uint64_t)source.st_size;
+    header.sourceTime = (int64_t)source.st_mtim.tv_sec;
+    header.sourceTimeNsec = (int64_t)source.st_mtim.tv_nsec;
+    header.actuatorPolicy = datastore->actuatorPolicy;
+
+    uint64_t stringsSize = 0;
+    LL_iterator(datastore->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        header.nRooms++;
+        addImageString(NULL, &stringsSize, room->name);
+
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+            header.nNodes++;
+            header.nSensors += listSize(node->sensors);
+            header.nActuators += listSize(node->actuators);
+
+            LL_iterator(node->sensors, sensor_elem) {
+                Sensor* sensor = (Sensor*)sensor_elem->ptr;
+                if (sensor->history && !header.historySize) {
+                    header.historySize = sensor->history->capacity;
+                    header.historyWindow = sensor->history->window;
+                    header.historyAlpha = sensor->history->alpha;
+                }
+            }
+        }
+    }
+    LL_iterator(datastore->profiles, profile_elem) {
+        Profile* profile = (Profile*)profile_elem->ptr;
+        header.nProfiles++;
+        addImageString(NULL, &stringsSize, profile->name);
+    }
+    LL_iterator(datastore->rules, rule_elem) {
+        Rule* rule = (Rule*)rule_elem->ptr;
+        header.nRules++;
+        header.nRefs += listSize(rule->sensors) + listSize(rule->actuators) + listSize(rule->profiles);
+    }
+    header.nPixels = listSize(datastore->pixels) - header.nSensors - header.nActuators;
+    header.matrixWidth = datastore->matrixWidth;
+    header.matrixHeight = datastore->matrixHeight;
+    LL_iterator(datastore->panels, panel_elem) {
+        Panel* panel = (Panel*)panel_elem->ptr;
+        header.nPanels++;
+        addImageString(NULL, &stringsSize, panel->output);
+    }
+
+    // Lay the arrays out after the header
+    uint64_t offset = ALIGN8(sizeof(ConfigImageHeader));
+    header.roomsOffset = offset;
+    offset = ALIGN8(offset + header.nRooms*sizeof(ConfigImageRoom));
+    header.nodesOffset = offset;
+    offset = ALIGN8(offset + header.nNodes*sizeof(ConfigImageNode));
+    header.sensorsOffset = offset;
+    offset = ALIGN8(offset + header.nSensors*sizeof(ConfigImageSensor));
+    header.actuatorsOffset = offset;
+    offset = ALIGN8(offset + header.nActuators*sizeof(ConfigImageActuator));
+    header.profilesOffset = offset;
+    offset = ALIGN8(offset + header.nProfiles*sizeof(ConfigImageProfile));
+    header.rulesOffset = offset;
+    offset = ALIGN8(offset + header.nRules*sizeof(ConfigImageRule));
+    header.refsOffset = offset;
+    offset = ALIGN8(offset + header.nRefs*sizeof(uint32_t));
+    header.pixelsOffset = offset;
+    offset = ALIGN8(offset + header.nPixels*sizeof(ConfigImagePixel));
+    header.panelsOffset = offset;
+    offset = ALIGN8(offset + header.nPanels*sizeof(ConfigImagePanel));
+    header.stringsOffset = offset;
+    header.stringsSize = stringsSize;
+    header.size = ALIGN8(offset + stringsSize);
+
+    uint8_t* image = calloc(1, header.size);
+    uint32_t nIndexes = header.nSensors + header.nActuators + header.nProfiles + header.nRules;
+    ImageIndex* indexes = malloc((nIndexes + 1)*sizeof(ImageIndex));
+    ImageIndex* pixelOwners = malloc((header.nSensors + header.nActuators + 1)*sizeof(ImageIndex));
+    if (!image || !indexes || !pixelOwners) {
+        free(image);
+        free(indexes);
+        free(pixelOwners);
+        return true;
+    }
+
+    ConfigImageRoom* rooms = (ConfigImageRoom*)(image + header.roomsOffset);
+    ConfigImageNode* nodes = (ConfigImageNode*)(image + header.nodesOffset);
+    ConfigImageSensor* sensors = (ConfigImageSensor*)(image + header.sensorsOffset);
+    ConfigImageActuator* actuators = (ConfigImageActuator*)(image + header.actuatorsOffset);
+    ConfigImageProfile* profiles = (ConfigImageProfile*)(image + header.profilesOffset);
+    ConfigImageRule* rules = (ConfigImageRule*)(image + header.rulesOffset);
+    uint32_t* refs = (uint32_t*)(image + header.refsOffset);
+    ConfigImagePixel* pixels = (ConfigImagePixel*)(image + header.pixelsOffset);
+    ConfigImagePanel* panels = (ConfigImagePanel*)(image + header.panelsOffset);
+    uint8_t* strings = image + header.stringsOffset;
+
+    // Topology, remembering the index of every element rules can reference
+    uint32_t nRooms = 0, nNodes = 0, nSensors = 0, nActuators = 0, nProfiles = 0, nRules = 0, nRefs = 0, nPixels = 0;
+    uint32_t nOwners = 0;
+    ImageIndex* sensorIndexes = indexes;
+    ImageIndex* actuatorIndexes = sensorIndexes + header.nSensors;
+    ImageIndex* profileIndexes = actuatorIndexes + header.nActuators;
+    ImageIndex* ruleIndexes = profileIndexes + header.nProfiles;
+    stringsSize = 0;
+
+    LL_iterator(datastore->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        rooms[nRooms].id = room->id;
+        rooms[nRooms].name = addImageString(strings, &stringsSize, room->name);
+
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+            nodes[nNodes].id = node->id;
+            nodes[nNodes].room = nRooms;
+            nodes[nNodes].period = node->period;
+
+            LL_iterator(node->sensors, sensor_elem) {
+                Sensor* sensor = (Sensor*)sensor_elem->ptr;
+                ConfigImageSensor* imageSensor = &sensors[nSensors];
+                imageSensor->id = sensor->id;
+                imageSensor->node = nNodes;
+                imageSensor->period = sensor->period;
+                imageSensor->type = sensor->type;
+                imageSensor->posX = sensor->pixel->pos->x;
+                imageSensor->posY = sensor->pixel->pos->y;
+                imageSensor->rangeMin = sensor->rangeMin;
+                imageSensor->rangeMax = sensor->rangeMax;
+                imageSensor->conversion = sensor->table ? SENSOR_CONVERSION_TABLE : SENSOR_CONVERSION_FORMULA;
+                imageSensor->nStops = sensor->gradient->nStops;
+                memcpy(imageSensor->stops, sensor->gradient->stops, sensor->gradient->nStops*sizeof(Color));
+
+                sensorIndexes[nSensors] = (ImageIndex){sensor, nSensors};
+                pixelOwners[nOwners++] = (ImageIndex){sensor->pixel, 0};
+                nSensors++;
+            }
+
+            LL_iterator(node->actuators, actuator_elem) {
+                Actuator* actuator = (Actuator*)actuator_elem->ptr;
+                ConfigImageActuator* imageActuator = &actuators[nActuators];
+                imageActuator->id = actuator->id;
+                imageActuator->node = nNodes;
+                imageActuator->type = actuator->type;
+                imageActuator->posX = actuator->pixel->pos->x;
+                imageActuator->posY = actuator->pixel->pos->y;
+
+                actuatorIndexes[nActuators] = (ImageIndex){actuator, nActuators};
+                pixelOwners[nOwners++] = (ImageIndex){actuator->pixel, 0};
+                nActuators++;
+            }
+
+            nNodes++;
+        }
+
+        nRooms++;
+    }
+
+    LL_iterator(datastore->profiles, profile_elem) {
+        Profile* profile = (Profile*)profile_elem->ptr;
+        profiles[nProfiles].id = profile->id;
+        profiles[nProfiles].name = addImageString(strings, &stringsSize, profile->name);
+        profiles[nProfiles].start = profile->start.tm_hour*60 + profile->start.tm_min;
+        profiles[nProfiles].end = profile->end.tm_hour*60 + profile->end.tm_min;
+
+        profileIndexes[nProfiles] = (ImageIndex){profile, nProfiles};
+        nProfiles++;
+    }
+
+    // Rules are created parents first, so the datastore list already has the order the image needs
+    LL_iterator(datastore->rules, rule_elem) {
+        ruleIndexes[nRules] = (ImageIndex){rule_elem->ptr, nRules};
+        nRules++;
+    }
+
+    qsort(sensorIndexes, nSensors, sizeof(ImageIndex), &compareImageIndex);
+    qsort(actuatorIndexes, nActuators, sizeof(ImageIndex), &compareImageIndex);
+    qsort(profileIndexes, nProfiles, sizeof(ImageIndex), &compareImageIndex);
+    qsort(ruleIndexes, nRules, sizeof(ImageIndex), &compareImageIndex);
+    qsort(pixelOwners, nOwners, sizeof(ImageIndex), &compareImageIndex);
+
+    bool error = false;
+    nRules = 0;
+    LL_iterator(datastore->rules, rule_elem) {
+        Rule* rule = (Rule*)rule_elem->ptr;
+        ConfigImageRule* imageRule = &rules[nRules++];
+        imageRule->id = rule->id;
+        imageRule->parent = rule->parentRule ? findImageIndex(ruleIndexes, header.nRules, rule->parentRule) : CONFIG_IMAGE_NONE;
+        imageRule->operation = rule->operation;
+        imageRule->value = rule->value;
+        imageRule->priority = rule->priority;
+        imageRule->hysteresis = rule->hysteresis;
+        imageRule->minOnTime = rule->minOnTime;
+        imageRule->minOffTime = rule->minOffTime;
+        imageRule->window = rule->window;
+        imageRule->count = rule->count;
+        imageRule->operand = rule->operand;
+        imageRule->refs = nRefs;
+        imageRule->nSensors = listSize(rule->sensors);
+        imageRule->nActuators = listSize(rule->actuators);
+        imageRule->nProfiles = listSize(rule->profiles);
+
+        // A parent listed after its child cannot be loaded back
+        error |= imageRule->parent != CONFIG_IMAGE_NONE && imageRule->parent >= nRules-1;
+
+        LL_iterator(rule->sensors, sensor_elem) {
+            refs[nRefs] = findImageIndex(sensorIndexes, header.nSensors, sensor_elem->ptr);
+            error |= refs[nRefs++] == CONFIG_IMAGE_NONE;
+        }
+        LL_iterator(rule->actuators, actuator_elem) {
+            refs[nRefs] = findImageIndex(actuatorIndexes, header.nActuators, actuator_elem->ptr);
+            error |= refs[nRefs++] == CONFIG_IMAGE_NONE;
+        }
+        LL_iterator(rule->profiles, profile_elem) {
+            refs[nRefs] = findImageIndex(profileIndexes, header.nProfiles, profile_elem->ptr);
+            error |= refs[nRefs++] == CONFIG_IMAGE_NONE;
+        }
+    }
+
+    LL_iterator(datastore->pixels, pixel_elem) {
+        Pixel* pixel = (Pixel*)pixel_elem->ptr;
+        ImageIndex key = {pixel, 0};
+        if (bsearch(&key, pixelOwners, nOwners, sizeof(ImageIndex), &compareImageIndex) || nPixels == header.nPixels) {
+            continue;
+        }
+
+        pixels[nPixels].posX = pixel->pos->x;
+        pixels[nPixels].posY = pixel->pos->y;
+        pixels[nPixels].r = pixel->color->r;
+        pixels[nPixels].g = pixel->color->g;
+        pixels[nPixels].b = pixel->color->b;
+        nPixels++;
+    }
+    error |= nPixels != header.nPixels;
+
+    uint32_t nPanels = 0;
+    LL_iterator(datastore->panels, panel_elem) {
+        Panel* panel = (Panel*)panel_elem->ptr;
+        panels[nPanels].x = panel->x;
+        panels[nPanels].y = panel->y;
+        panels[nPanels].width = panel->width;
+        panels[nPanels].height = panel->height;
+        panels[nPanels].output = addImageString(strings, &stringsSize, panel->output);
+        panels[nPanels].maxFps = panel->maxFps;
+        panels[nPanels].keyframePeriod = panel->keyframePeriod;
+        panels[nPanels].format = panel->format;
+        panels[nPanels].delta = panel->delta;
+        nPanels++;
+    }
+
+    free(indexes);
+    free(pixelOwners);
+
+    header.checksum = getImageChecksum(image + sizeof(ConfigImageHeader), header.size - sizeof(ConfigImageHeader));
+    memcpy(image, &header, sizeof(ConfigImageHeader));
+
+    // Write next to the final file and rename, so a reader never sees half an image
+    char* tmpFilename = malloc(strlen(filename) + 5);
+    if (error || !tmpFilename) {
+        free(tmpFilename);
+        free(image);
+        return true;
+    }
+    sprintf(tmpFilename, "%s.tmp", filename);
+
+    FILE* file = fopen(tmpFilename, "wb");
+    if (!file) {
+        free(tmpFilename);
+        free(image);
+        return true;
+    }
+
+    error = fwrite(image, 1, header.size, file) != header.size;
+    error |= fclose(file) != 0;
+    error = error || rename(tmpFilename, filename);
+    if (error) {
+        unlink(tmpFilename);
+    }
+
+    free(tmpFilename);
+    free(image);
+
+    return error;
+}
+
+// Tells if count records of size bytes at offset fit in the image
+bool isImageArrayValid (const ConfigImageHeader* header, uint64_t offset, uint64_t count, uint64_t size) {
+    return offset % 8 == 0 &&
+        offset >= sizeof(ConfigImageHeader) &&
+        offset <= header->size &&
+        count <= (header->size - offset) / (size ? size : 1);
+}
+
+const char* getImageString (const ConfigImageHeader* header, const uint8_t* image, uint32_t offset) {
+    if (offset == CONFIG_IMAGE_NONE || offset >= header->stringsSize) {
+        return NULL;
+    }
+
+    return (const char*)(image + header->stringsOffset + offset);
+}
+
+// Creates the elements of the image in a new datastore, in the same order importConfiguration does
+Datastore* buildDatastoreFromImage (const ConfigImageHeader* header, const uint8_t* image) {
+    const ConfigImageRoom* rooms = (const ConfigImageRoom*)(image + header->roomsOffset);
+    const ConfigImageNode* nodes = (const ConfigImageNode*)(image + header->nodesOffset);
+    const ConfigImageSensor* sensors = (const ConfigImageSensor*)(image + header->sensorsOffset);
+    const ConfigImageActuator* actuators = (const ConfigImageActuator*)(image + header->actuatorsOffset);
+    const ConfigImageProfile* profiles = (const ConfigImageProfile*)(image + header->profilesOffset);
+    const ConfigImageRule* rules = (const ConfigImageRule*)(image + header->rulesOffset);
+    const uint32_t* refs = (const uint32_t*)(image + header->refsOffset);
+    const ConfigImagePixel* pixels = (const ConfigImagePixel*)(image + header->pixelsOffset);
+    const ConfigImagePanel* panels = (const ConfigImagePanel*)(image + header->panelsOffset);
+
+    Datastore* datastore = createDatastore();
+    void** objects = malloc(((uint64_t)header->nRooms + header->nNodes + header->nSensors +
+        header->nActuators + header->nProfiles + header->nRules + 1)*sizeof(void*));
+    if (!datastore || !objects) {
+        deleteDatastore(datastore);
+        free(objects);
+        return NULL;
+    }
+
+    Room** roomObjects = (Room**)objects;
+    Node** nodeObjects = (Node**)(roomObjects + header->nRooms);
+    Sensor** sensorObjects = (Sensor**)(nodeObjects + header->nNodes);
+    Actuator** actuatorObjects = (Actuator**)(sensorObjects + header->nSensors);
+    Profile** profileObjects = (Profile**)(actuatorObjects + header->nActuators);
+    Rule** ruleObjects = (Rule**)(profileObjects + header->nProfiles);
+
+    // Uniqueness is checked once everything is in, like when importing the source file
+    datastore->bulkLoad = true;
+
+    // The panels must fit in the matrix
+    bool error = setMatrixSize(datastore, header->matrixWidth, header->matrixHeight);
+    for (uint32_t i = 0; i < header->nPanels && !error; i++) {
+        Panel* panel = createPanel(datastore, panels[i].x, panels[i].y, panels[i].width, panels[i].height,
+            getImageString(header, image, panels[i].output));
+        error = !panel || setPanelEncoding(panel, panels[i].format, panels[i].maxFps, panels[i].delta, panels[i].keyframePeriod);
+    }
+
+    for (uint32_t i = 0; i < header->nRooms && !error; i++) {
+        roomObjects[i] = createRoom(datastore, rooms[i].id);
+        error = !roomObjects[i] || setRoomName(roomObjects[i], getImageString(header, image, rooms[i].name));
+    }
+
+    // Sensors and actuators are stored node after node
+    uint32_t sensor = 0, actuator = 0;
+    for (uint32_t i = 0; i < header->nNodes && !error; i++) {
+        Node* node = NULL;
+        if (nodes[i].room < header->nRooms) {
+            node = createNode(roomObjects[nodes[i].room], nodes[i].id);
+        }
+        nodeObjects[i] = node;
+        error = !node;
+
+        for (; sensor < header->nSensors && sensors[sensor].node == i && !error; sensor++) {
+            const ConfigImageSensor* imageSensor = &sensors[sensor];
+            Position position = {imageSensor->posX, imageSensor->posY};
+            sensorObjects[sensor] = createSensor(node, imageSensor->id, imageSensor->type, &position, imageSensor->rangeMin, imageSensor->rangeMax);
+            error = !sensorObjects[sensor] ||
+                setSensorConversion(sensorObjects[sensor], imageSensor->conversion) ||
+                setSensorGradient(sensorObjects[sensor], imageSensor->stops, imageSensor->nStops) ||
+                (imageSensor->period && setSensorPeriod(sensorObjects[sensor], imageSensor->period));
+        }
+
+        for (; actuator < header->nActuators && actuators[actuator].node == i && !error; actuator++) {
+            const ConfigImageActuator* imageActuator = &actuators[actuator];
+            Position position = {imageActuator->posX, imageActuator->posY};
+            actuatorObjects[actuator] = createActuator(node, imageActuator->id, imageActuator->type, &position);
+            error = !actuatorObjects[actuator];
+        }
+
+        error = error || (nodes[i].period && setNodePeriod(node, nodes[i].period));
+    }
+    error = error || sensor != header->nSensors || actuator != header->nActuators;
+
+    if (!error && header->historySize) {
+        error = createSensorHistories(datastore, header->historySize, header->historyWindow, header->historyAlpha);
+    }
+
+    for (uint32_t i = 0; i < header->nProfiles && !error; i++) {
+        char start[8], end[8];
+        snprintf(start, sizeof(start), "%02u:%02u", (profiles[i].start / 60) % 100, profiles[i].start % 60);
+        snprintf(end, sizeof(end), "%02u:%02u", (profiles[i].end / 60) % 100, profiles[i].end % 60);
+        profileObjects[i] = createProfile(datastore, profiles[i].id, getImageString(header, image, profiles[i].name), start, end);
+        error = !profileObjects[i];
+    }
+
+    for (uint32_t i = 0; i < header->nRules && !error; i++) {
+        const ConfigImageRule* imageRule = &rules[i];
+        if ((imageRule->parent != CONFIG_IMAGE_NONE && imageRule->parent >= i) ||
+            (uint64_t)imageRule->refs + imageRule->nSensors + imageRule->nActuators + imageRule->nProfiles > header->nRefs) {
+
+            error = true;
+            break;
+        }
+
+        Rule* parent = imageRule->parent == CONFIG_IMAGE_NONE ? NULL : ruleObjects[imageRule->parent];
+        Rule* rule = createRule(datastore, parent, imageRule->id, imageRule->operation, imageRule->value);
+        ruleObjects[i] = rule;
+        error = !rule ||
+            setRulePriority(rule, imageRule->priority) ||
+            setRuleOperand(rule, imageRule->operand) ||
+            setRuleWindow(rule, imageRule->window, imageRule->count) ||
+            setRuleHysteresis(rule, imageRule->hysteresis) ||
+            setRuleDwellTimes(rule, imageRule->minOnTime, imageRule->minOffTime);
+
+        const uint32_t* ref = refs + imageRule->refs;
+        for (uint32_t j = 0; j < imageRule->nSensors && !error; j++, ref++) {
+            error = *ref >= header->nSensors || addSensorToRule(rule, sensorObjects[*ref]);
+        }
+        for (uint32_t j = 0; j < imageRule->nActuators && !error; j++, ref++) {
+            error = *ref >= header->nActuators || addActuatorToRule(rule, actuatorObjects[*ref]);
+        }
+        for (uint32_t j = 0; j < imageRule->nProfiles && !error; j++, ref++) {
+            error = *ref >= header->nProfiles || addProfileToRule(rule, profileObjects[*ref]);
+        }
+    }
+
+    if (!error) {
+        datastore->actuatorPolicy = header->actuatorPolicy;
+        invalidateRuleProgram(datastore);
+    }
+
+    for (uint32_t i = 0; i < header->nPixels && !error; i++) {
+        Position position = {pixels[i].posX, pixels[i].posY};
+        Color color = {(uint8_t)pixels[i].r, (uint8_t)pixels[i].g, (uint8_t)pixels[i].b};
+        error = !createPixel(datastore, &color, &position);
+    }
+
+    free(objects);
+
+    if (!error) {
+        uint32_t nErrors = 0;
+        DatastoreIndex* index = indexDatastore(datastore, &nErrors);
+        error = !index || nErrors;
+        deleteDatastoreIndex(index);
+        datastore->bulkLoad = false;
+    }
+
+    if (error) {
+        deleteDatastore(datastore);
+        return NULL;
+    }
+
+    return datastore;
+}
+
+Datastore* loadConfigImage (const char* filename, const char* sourceFilename) {
+    if (!filename || !sourceFilename) {
+        return NULL;
+    }
+
+    struct stat source, info;
+    if (stat(sourceFilename, &source)) {
+        return NULL;
+    }
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &info) || (uint64_t)info.st_size < sizeof(ConfigImageHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t* image = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        return NULL;
+    }
+
+    // Reject images of other versions, damaged ones, and any image older than its source
+    const ConfigImageHeader* header = (const ConfigImageHeader*)image;
+    bool valid = header->magic == CONFIG_IMAGE_MAGIC &&
+        header->version == CONFIG_IMAGE_VERSION &&
+        header->size == (uint64_t)info.st_size &&
+        header->sourceSize == (uint64_t)source.st_size &&
+        header->sourceTime == (int64_t)source.st_mtim.tv_sec &&
+        header->sourceTimeNsec == (int64_t)source.st_mtim.tv_nsec &&
+        isImageArrayValid(header, header->roomsOffset, header->nRooms, sizeof(ConfigImageRoom)) &&
+        isImageArrayValid(header, header->nodesOffset, header->nNodes, sizeof(ConfigImageNode)) &&
+        isImageArrayValid(header, header->sensorsOffset, header->nSensors, sizeof(ConfigImageSensor)) &&
+        isImageArrayValid(header, header->actuatorsOffset, header->nActuators, sizeof(ConfigImageActuator)) &&
+        isImageArrayValid(header, header->profilesOffset, header->nProfiles, sizeof(ConfigImageProfile)) &&
+        isImageArrayValid(header, header->rulesOffset, header->nRules, sizeof(ConfigImageRule)) &&
+        isImageArrayValid(header, header->refsOffset, header->nRefs, sizeof(uint32_t)) &&
+        isImageArrayValid(header, header->pixelsOffset, header->nPixels, sizeof(ConfigImagePixel)) &&
+        isImageArrayValid(header, header->panelsOffset, header->nPanels, sizeof(ConfigImagePanel)) &&
+        isImageArrayValid(header, header->stringsOffset, header->stringsSize, 1) &&
+        (!header->stringsSize || image[header->stringsOffset + header->stringsSize - 1] == '\0') &&
+        header->checksum == getImageChecksum(image + sizeof(ConfigImageHeader), header->size - sizeof(ConfigImageHeader));
+
+    Datastore* datastore = valid ? buildDatastoreFromImage(header, image) : NULL;
+
+    munmap(image, info.st_size);
+
+    return datastore;
+}
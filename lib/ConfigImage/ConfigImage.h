@@ -0,0 +1,181 @@
+#ifndef __CONFIG_IMAGE__
+#define __CONFIG_IMAGE__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct _config_image_header ConfigImageHeader;
+typedef struct _config_image_room ConfigImageRoom;
+typedef struct _config_image_node ConfigImageNode;
+typedef struct _config_image_sensor ConfigImageSensor;
+typedef struct _config_image_actuator ConfigImageActuator;
+typedef struct _config_image_profile ConfigImageProfile;
+typedef struct _config_image_rule ConfigImageRule;
+typedef struct _config_image_pixel ConfigImagePixel;
+typedef struct _config_image_panel ConfigImagePanel;
+
+#include "Datastore.h"
+
+#define CONFIG_IMAGE_MAGIC      0x49534147  // "GASI" read as a little endian word
+#define CONFIG_IMAGE_VERSION    3
+#define CONFIG_IMAGE_NONE       UINT32_MAX  // Missing index or string
+
+
+/**
+ * @brief Start of a configuration image. Every array of the image is referenced by its
+ * offset from the start of the file and its number of records, and starts 8 byte aligned.
+ * The checksum covers everything after the header.
+ * The size and modification time of the source file tell when the image is stale.
+ *
+ */
+struct _config_image_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t checksum;
+    uint64_t size;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    int64_t sourceTimeNsec;
+    uint32_t actuatorPolicy;
+    uint32_t historySize;
+    uint32_t historyWindow;
+    float historyAlpha;
+    uint64_t roomsOffset;
+    uint32_t nRooms;
+    uint32_t nNodes;
+    uint64_t nodesOffset;
+    uint64_t sensorsOffset;
+    uint32_t nSensors;
+    uint32_t nActuators;
+    uint64_t actuatorsOffset;
+    uint64_t profilesOffset;
+    uint32_t nProfiles;
+    uint32_t nRules;
+    uint64_t rulesOffset;
+    uint64_t refsOffset;
+    uint32_t nRefs;
+    uint32_t nPixels;
+    uint64_t pixelsOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint16_t matrixWidth;
+    uint16_t matrixHeight;
+    uint32_t nPanels;
+    uint64_t panelsOffset;
+};
+
+struct _config_image_room {
+    uint32_t id;
+    uint32_t name;
+};
+
+// room is an index in the rooms array
+struct _config_image_node {
+    uint32_t id;
+    uint32_t room;
+    uint32_t period;
+};
+
+// node is an index in the nodes array. The gradient keeps its stops only, the lookup table is rebuilt.
+struct _config_image_sensor {
+    uint32_t id;
+    uint32_t node;
+    uint32_t period;
+    uint16_t type;
+    uint16_t posX;
+    uint16_t posY;
+    uint16_t rangeMin;
+    uint16_t rangeMax;
+    uint16_t conversion;
+    uint8_t nStops;
+    uint8_t padding[3];
+    Color stops[GRADIENT_MAX_STOPS];
+};
+
+struct _config_image_actuator {
+    uint32_t id;
+    uint32_t node;
+    uint16_t type;
+    uint16_t posX;
+    uint16_t posY;
+    uint16_t padding;
+};
+
+struct _config_image_profile {
+    uint32_t id;
+    uint32_t name;
+    uint16_t start;
+    uint16_t end;
+};
+
+/**
+ * @brief Rule of the image. Rules are stored parents first, parent being an index in the rules array.
+ * The sensors, actuators and profiles of the rule are indexes into their arrays, stored in the
+ * refs array starting at refs.
+ *
+ */
+struct _config_image_rule {
+    uint32_t id;
+    uint32_t parent;
+    uint16_t operation;
+    uint16_t value;
+    uint16_t priority;
+    uint16_t hysteresis;
+    uint32_t minOnTime;
+    uint32_t minOffTime;
+    uint32_t window;
+    uint16_t count;
+    uint16_t operand;
+    uint32_t refs;
+    uint32_t nSensors;
+    uint32_t nActuators;
+    uint32_t nProfiles;
+};
+
+// Pixels not drawn by a sensor or actuator
+struct _config_image_pixel {
+    uint16_t posX;
+    uint16_t posY;
+    uint16_t r;
+    uint16_t g;
+    uint16_t b;
+    uint16_t padding;
+};
+
+// output is an offset in the strings
+struct _config_image_panel {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint32_t output;
+    uint32_t maxFps;
+    uint32_t keyframePeriod;
+    uint8_t format;
+    uint8_t delta;
+    uint16_t padding;
+};
+
+/**
+ * @brief Writes a binary image of the configuration held by a datastore
+ *
+ * @param datastore Pointer to the Datastore object, as built from the source file
+ * @param filename Filename of the image to write. Replaced atomically.
+ * @param sourceFilename Configuration file the datastore was parsed from
+ * @return true Error
+ * @return false All good
+ */
+bool writeConfigImage (Datastore* datastore, const char* filename, const char* sourceFilename);
+
+/**
+ * @brief Builds a datastore from a configuration image
+ *
+ * @param filename Filename of the image
+ * @param sourceFilename Configuration file the image was compiled from
+ * @return Datastore* Pointer to the new Datastore object. NULL if the image is missing, corrupt,
+ * from another version or older than the source file.
+ */
+Datastore* loadConfigImage (const char* filename, const char* sourceFilename);
+
+#endif
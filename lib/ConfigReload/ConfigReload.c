@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "ConfigReload.h"
+#include "Clock.h"
+#include "Metrics.h"
+
+void* thread_configReload (void* arg) {
+    ConfigReload* reload = arg;
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+
+    while (true) {
+        int received;
+        if (sigwait(&signals, &received)) {
+            break;
+        }
+
+        // deleteConfigReload wakes the thread up with a SIGHUP too
+        if (!__atomic_load_n(&reload->active, __ATOMIC_SEQ_CST)) {
+            break;
+        }
+
+        reloadConfiguration(reload);
+    }
+
+    return NULL;
+}
+
+ConfigReload* createConfigReload (const char* filename, ConfigLoader* load, Datastore* datastore) {
+    if (!filename || !load || !datastore) {
+        return NULL;
+    }
+
+    ConfigReload* reload = (ConfigReload*)malloc(sizeof(ConfigReload));
+    if (!reload) {
+        return NULL;
+    }
+
+    reload->filename = (char*)malloc(strlen(filename)+1);
+    if (!reload->filename) {
+        free(reload);
+        return NULL;
+    }
+    strcpy(reload->filename, filename);
+
+    reload->load = load;
+    reload->datastore = datastore;
+    reload->epoch = 1;
+    for (uint8_t i = 0; i < CONFIG_RELOAD_MAX_READERS; i++) {
+        reload->readers[i] = CONFIG_RELOAD_IDLE;
+    }
+    pthread_mutex_init(&reload->mutex, NULL);
+    reload->active = true;
+    reload->nReloads = 0;
+
+    // Threads created from now on inherit the mask: only the reload thread gets SIGHUP
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    if (pthread_sigmask(SIG_BLOCK, &signals, NULL) ||
+        pthread_create(&reload->thread, NULL, &thread_configReload, reload)) {
+
+        pthread_mutex_destroy(&reload->mutex);
+        free(reload->filename);
+        free(reload);
+        return NULL;
+    }
+
+    return reload;
+}
+
+bool deleteConfigReload (ConfigReload* reload, Datastore** datastore) {
+    if (!reload) {
+        return true;
+    }
+
+    __atomic_store_n(&reload->active, false, __ATOMIC_SEQ_CST);
+    pthread_kill(reload->thread, SIGHUP);
+    pthread_join(reload->thread, NULL);
+
+    if (datastore) {
+        *datastore = reload->datastore;
+    }
+
+    pthread_mutex_destroy(&reload->mutex);
+    free(reload->filename);
+    free(reload);
+
+    return false;
+}
+
+Datastore* acquireDatastore (ConfigReload* reload, uint8_t reader) {
+    if (!reload || reader >= CONFIG_RELOAD_MAX_READERS) {
+        return NULL;
+    }
+
+    // Announce the epoch before loading the pointer: a reload that misses the
+    // announcement published its datastore before bumping the epoch we saw
+    __atomic_store_n(&reload->readers[reader], __atomic_load_n(&reload->epoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+
+    return __atomic_load_n(&reload->datastore, __ATOMIC_SEQ_CST);
+}
+
+void releaseDatastore (ConfigReload* reload, uint8_t reader) {
+    if (!reload || reader >= CONFIG_RELOAD_MAX_READERS) {
+        return;
+    }
+
+    __atomic_store_n(&reload->readers[reader], CONFIG_RELOAD_IDLE, __ATOMIC_SEQ_CST);
+}
+
+// Elements of the old datastore are kept or removed, the ones only in the new one are added
+void countDiff (ConfigDiffCount* count, bool isFrom, bool found) {
+    if (isFrom) {
+        if (found) {
+            count->kept++;
+        }
+        else {
+            count->removed++;
+        }
+    }
+    else if (!found) {
+        count->added++;
+    }
+}
+
+// Counts the elements of one datastore, looking each one up in the index of the other
+void diffTopology (Datastore* datastore, DatastoreIndex* other, ConfigDiff* diff, bool isFrom) {
+    LL_iterator(datastore->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        countDiff(&diff->rooms, isFrom, findInHashTable(other->rooms, room->id) != NULL);
+
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+            countDiff(&diff->nodes, isFrom, findInHashTable(other->nodes, node->id) != NULL);
+
+            LL_iterator(node->sensors, sensor_elem) {
+                Sensor* sensor = (Sensor*)sensor_elem->ptr;
+                countDiff(&diff->sensors, isFrom, findInHashTable(other->sensors, sensor->id) != NULL);
+            }
+
+            LL_iterator(node->actuators, actuator_elem) {
+                Actuator* actuator = (Actuator*)actuator_elem->ptr;
+                countDiff(&diff->actuators, isFrom, findInHashTable(other->actuators, actuator->id) != NULL);
+            }
+        }
+    }
+
+    LL_iterator(datastore->profiles, profile_elem) {
+        Profile* profile = (Profile*)profile_elem->ptr;
+        countDiff(&diff->profiles, isFrom, findInHashTable(other->profiles, profile->id) != NULL);
+    }
+
+    LL_iterator(datastore->rules, rule_elem) {
+        Rule* rule = (Rule*)rule_elem->ptr;
+        countDiff(&diff->rules, isFrom, findInHashTable(other->rules, rule->id) != NULL);
+    }
+}
+
+void diffDatastores (Datastore* from, DatastoreIndex* fromIndex, Datastore* to, DatastoreIndex* toIndex, ConfigDiff* diff) {
+    if (!diff) {
+        return;
+    }
+
+    memset(diff, 0, sizeof(ConfigDiff));
+    if (!from || !fromIndex || !to || !toIndex) {
+        return;
+    }
+
+    diffTopology(from, toIndex, diff, true);
+    diffTopology(to, fromIndex, diff, false);
+}
+
+// Copies the readings of the sensors with the same ID and type. Unless forced,
+// only the ones newer than what the new datastore got on its own.
+void carrySensorReadings (DatastoreIndex* from, Datastore* to, bool force) {
+    LL_iterator(to->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+
+            Node* oldNode = (Node*)findInHashTable(from->nodes, node->id);
+            if (oldNode) {
+                uint64_t lastSeen = __atomic_load_n(&oldNode->lastSeen, __ATOMIC_RELAXED);
+                if (force || lastSeen > __atomic_load_n(&node->lastSeen, __ATOMIC_RELAXED)) {
+                    __atomic_store_n(&node->lastSeen, lastSeen, __ATOMIC_RELAXED);
+                }
+            }
+
+            LL_iterator(node->sensors, sensor_elem) {
+                Sensor* sensor = (Sensor*)sensor_elem->ptr;
+                Sensor* oldSensor = (Sensor*)findInHashTable(from->sensors, sensor->id);
+                if (!oldSensor || oldSensor->type != sensor->type) {
+                    continue;
+                }
+
+                pthread_mutex_lock(&oldSensor->mutex);
+                pthread_mutex_lock(&sensor->mutex);
+                uint64_t lastSeen = __atomic_load_n(&oldSensor->lastSeen, __ATOMIC_RELAXED);
+                if (force || lastSeen > __atomic_load_n(&sensor->lastSeen, __ATOMIC_RELAXED)) {
+                    __atomic_store_n(&sensor->value, __atomic_load_n(&oldSensor->value, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+                    __atomic_store_n(&sensor->lastSeen, lastSeen, __ATOMIC_RELAXED);
+                    copySensorHistory(oldSensor->history, sensor->history);
+                }
+                pthread_mutex_unlock(&sensor->mutex);
+                pthread_mutex_unlock(&oldSensor->mutex);
+            }
+        }
+    }
+}
+
+// Copies the colors being shown and the DB ids of the pixels in the same position
+void carryPixels (DatastoreIndex* from, Datastore* to) {
+    LL_iterator(to->pixels, pixel_elem) {
+        Pixel* pixel = (Pixel*)pixel_elem->ptr;
+        Pixel* oldPixel = (Pixel*)findInHashTable(from->pixels, HASH_POSITION_KEY(pixel->pos->x, pixel->pos->y));
+        if (!oldPixel) {
+            continue;
+        }
+
+        pthread_mutex_lock(&oldPixel->mutex);
+        Color color = *oldPixel->color;
+        pixel->remote_id = oldPixel->remote_id;
+        pthread_mutex_unlock(&oldPixel->mutex);
+
+        setPixelColor(pixel, &color);
+    }
+}
+
+// Tells whether both datastores describe the same matrix, driven by the same panels
+bool isSameGeometry (Datastore* from, Datastore* to) {
+    if (from->matrixWidth != to->matrixWidth || from->matrixHeight != to->matrixHeight ||
+        listSize(from->panels) != listSize(to->panels)) {
+        return false;
+    }
+
+    list_element* other = listStart(to->panels);
+    LL_iterator(from->panels, panel_elem) {
+        Panel* panel = (Panel*)panel_elem->ptr;
+        Panel* otherPanel = (Panel*)other->ptr;
+        if (panel->x != otherPanel->x || panel->y != otherPanel->y ||
+            panel->width != otherPanel->width || panel->height != otherPanel->height ||
+            panel->format != otherPanel->format || panel->maxFps != otherPanel->maxFps ||
+            panel->delta != otherPanel->delta || panel->keyframePeriod != otherPanel->keyframePeriod ||
+            strcmp(panel->output, otherPanel->output)) {
+            return false;
+        }
+        other = other->next;
+    }
+
+    return true;
+}
+
+// Waits until no reader can still hold a datastore published before the given epoch
+void waitForReaders (ConfigReload* reload, uint64_t epoch) {
+    struct timespec pause = {0, 1000000};
+
+    for (uint8_t i = 0; i < CONFIG_RELOAD_MAX_READERS; i++) {
+        while (true) {
+            uint64_t seen = __atomic_load_n(&reload->readers[i], __ATOMIC_SEQ_CST);
+            if (seen == CONFIG_RELOAD_IDLE || seen >= epoch) {
+                break;
+            }
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+bool reloadConfiguration (ConfigReload* reload) {
+    if (!reload) {
+        return true;
+    }
+
+    // A single reload at a time
+    pthread_mutex_lock(&reload->mutex);
+
+    uint64_t start = getMonotonicTime();
+
+    Datastore* datastore = reload->load(reload->filename);
+    if (!datastore) {
+        addMetricCount(METRIC_CONFIG_RELOAD_ERRORS, 1);
+        pthread_mutex_unlock(&reload->mutex);
+        fprintf(stderr, "Error reloading %s, keeping the running configuration.\n", reload->filename);
+        return true;
+    }
+    uint64_t parsed = getMonotonicTime();
+
+    // Elements are matched by ID, and pixels by position, through an index of each datastore.
+    // Both were checked for duplicates when loaded, so none are reported here.
+    Datastore* old = reload->datastore;
+    uint32_t nDuplicates = 0;
+    DatastoreIndex* oldIndex = indexDatastore(old, &nDuplicates);
+    DatastoreIndex* newIndex = indexDatastore(datastore, &nDuplicates);
+    if (!oldIndex || !newIndex) {
+        deleteDatastoreIndex(oldIndex);
+        deleteDatastoreIndex(newIndex);
+        deleteDatastore(datastore);
+        addMetricCount(METRIC_CONFIG_RELOAD_ERRORS, 1);
+        pthread_mutex_unlock(&reload->mutex);
+        fprintf(stderr, "Error indexing %s, keeping the running configuration.\n", reload->filename);
+        return true;
+    }
+
+    ConfigDiff diff;
+    diffDatastores(old, oldIndex, datastore, newIndex, &diff);
+
+    // The framebuffer and the outputs are sized once, at startup
+    if (!isSameGeometry(old, datastore)) {
+        fprintf(stderr, "Matrix size or panels changed in %s, they will take effect on restart.\n", reload->filename);
+    }
+
+    // Carry the state over before publishing, so the new datastore starts where the old one was
+    carrySensorReadings(oldIndex, datastore, true);
+    carryPixels(oldIndex, datastore);
+
+    __atomic_store_n(&reload->datastore, datastore, __ATOMIC_SEQ_CST);
+    uint64_t epoch = __atomic_add_fetch(&reload->epoch, 1, __ATOMIC_SEQ_CST);
+    uint64_t swapped = getMonotonicTime();
+
+    waitForReaders(reload, epoch);
+
+    // Readings that reached the old datastore since the first copy
+    carrySensorReadings(oldIndex, datastore, false);
+    deleteDatastoreIndex(oldIndex);
+    deleteDatastoreIndex(newIndex);
+    deleteDatastore(old);
+    reload->nReloads++;
+
+    pthread_mutex_unlock(&reload->mutex);
+
+    uint64_t end = getMonotonicTime();
+    addMetricCount(METRIC_CONFIG_RELOADS, 1);
+    recordMetricTime(METRIC_CONFIG_RELOAD_TIME, (end - start) * 1000000);
+    fprintf(stderr,
+        "Configuration reloaded in %llu ms (parse %llu ms, swap %llu ms, drain %llu ms). "
+        "Rooms +%u -%u, nodes +%u -%u, sensors +%u -%u, actuators +%u -%u, profiles +%u -%u, rules +%u -%u.\n",
+        (unsigned long long)(end - start), (unsigned long long)(parsed - start),
+        (unsigned long long)(swapped - parsed), (unsigned long long)(end - swapped),
+        diff.rooms.added, diff.rooms.removed, diff.nodes.added, diff.nodes.removed,
+        diff.sensors.added, diff.sensors.removed, diff.actuators.added, diff.actuators.removed,
+        diff.profiles.added, diff.profiles.removed, diff.rules.added, diff.rules.removed);
+
+    return false;
+}
@@ -0,0 +1,131 @@
+#ifndef __CONFIG_RELOAD__
+#define __CONFIG_RELOAD__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct _config_reload ConfigReload;
+typedef struct _config_diff ConfigDiff;
+typedef struct _config_diff_count ConfigDiffCount;
+
+#include "Datastore.h"
+
+#define CONFIG_RELOAD_MAX_READERS   8
+#define CONFIG_RELOAD_IDLE          0   // Epoch of a reader that holds no datastore
+
+typedef Datastore* ConfigLoader (const char* filename);
+
+
+/**
+ * @brief Elements of one kind added, removed and kept by a reload, matched by ID
+ *
+ */
+struct _config_diff_count {
+    uint32_t added;
+    uint32_t removed;
+    uint32_t kept;
+};
+
+/**
+ * @brief Differences between the live datastore and a freshly parsed one
+ *
+ */
+struct _config_diff {
+    ConfigDiffCount rooms;
+    ConfigDiffCount nodes;
+    ConfigDiffCount sensors;
+    ConfigDiffCount actuators;
+    ConfigDiffCount profiles;
+    ConfigDiffCount rules;
+};
+
+/**
+ * @brief Owner of the live Datastore, able to replace it with a new one parsed from the
+ * configuration file while the other threads keep running.
+ *
+ * Threads using the datastore acquire it for a short while (one pass of their loop),
+ * announcing the epoch they saw in their reader slot. A reload parses the file,
+ * carries the sensor readings and pixel colors over, publishes the new datastore and
+ * bumps the epoch. The old datastore is deleted once every reader slot is idle or
+ * has seen the new epoch, so no thread is ever left holding a deleted one.
+ *
+ * Reloads are triggered by SIGHUP, handled by a thread of its own.
+ *
+ */
+struct _config_reload {
+    char* filename;
+    ConfigLoader* load;
+    Datastore* datastore;
+    uint64_t epoch;
+    uint64_t readers[CONFIG_RELOAD_MAX_READERS];
+    pthread_mutex_t mutex;
+    pthread_t thread;
+    bool active;
+    uint32_t nReloads;
+};
+
+/**
+ * @brief Create a ConfigReload object and start the thread waiting for SIGHUP.
+ * Blocks SIGHUP in the calling thread, so it must be created before any other
+ * thread for the signal to reach the reload thread only.
+ *
+ * @param filename Path of the configuration file
+ * @param load Function parsing the configuration file into a new Datastore
+ * @param datastore Live datastore, parsed from the same file
+ * @return ConfigReload* Pointer to the new ConfigReload object. NULL if error.
+ */
+ConfigReload* createConfigReload (const char* filename, ConfigLoader* load, Datastore* datastore);
+
+/**
+ * @brief Stop the reload thread, waiting for a running reload, and delete a ConfigReload object.
+ * The live datastore is not deleted.
+ *
+ * @param reload Pointer to the ConfigReload object
+ * @param datastore Filled with the live datastore once no reload can run. May be NULL.
+ * @return true Error
+ * @return false All good
+ */
+bool deleteConfigReload (ConfigReload* reload, Datastore** datastore);
+
+/**
+ * @brief Get the live datastore. It stays valid until releaseDatastore is called with the same reader.
+ *
+ * @param reload Pointer to the ConfigReload object
+ * @param reader Reader slot of the calling thread, below CONFIG_RELOAD_MAX_READERS
+ * @return Datastore* Pointer to the live Datastore object. NULL if error.
+ */
+Datastore* acquireDatastore (ConfigReload* reload, uint8_t reader);
+
+/**
+ * @brief Tells the datastore got by acquireDatastore is no longer used
+ *
+ * @param reload Pointer to the ConfigReload object
+ * @param reader Reader slot of the calling thread
+ */
+void releaseDatastore (ConfigReload* reload, uint8_t reader);
+
+/**
+ * @brief Parses the configuration file again and swaps the result in for the live datastore,
+ * reporting the differences and how long it took on stderr. The live datastore is kept
+ * if the file has errors.
+ *
+ * @param reload Pointer to the ConfigReload object
+ * @return true Error
+ * @return false All good
+ */
+bool reloadConfiguration (ConfigReload* reload);
+
+/**
+ * @brief Compares two datastores, matching their elements by ID
+ *
+ * @param from Pointer to the old Datastore object
+ * @param fromIndex Index of the old Datastore, as built by indexDatastore
+ * @param to Pointer to the new Datastore object
+ * @param toIndex Index of the new Datastore
+ * @param diff Pointer to the ConfigDiff to fill
+ */
+void diffDatastores (Datastore* from, DatastoreIndex* fromIndex, Datastore* to, DatastoreIndex* toIndex, ConfigDiff* diff);
+
+#endif
@@ -1,4 +1,9 @@
 #include "DBLink.h"
+#include "Metrics.h"
+#include "Clock.h"
+
+// A PGconn must not be used by several threads at once
+pthread_mutex_t DB_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 void addQuerytoList (DBQuery* query, list* queryList) {
     if (!query || !queryList) {
@@ -153,19 +158,30 @@ PGresult* __DB_exec (DBQuery* query, char* paramValues[]) {
         paramFormats[i] = 0;
     }
 
+    addMetricCount(METRIC_DB_QUERIES, 1);
     if (!query->conn) {
+        addMetricCount(METRIC_DB_ERRORS, 1);
         return NULL;
     }
 
+    pthread_mutex_lock(&DB_mutex);
+    uint64_t start = getMonotonicTimeNs();
     PGresult* stmt = PQexecPrepared(
         query->conn,
         query->name,
         query->nParams,
-        paramValues,
+        (const char* const*)paramValues,
         paramLengths,
         paramFormats,
         0
     );
+    recordMetricTime(METRIC_DB_QUERY_TIME, getMonotonicTimeNs() - start);
+    pthread_mutex_unlock(&DB_mutex);
+
+    ExecStatusType status = PQresultStatus(stmt);
+    if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+        addMetricCount(METRIC_DB_ERRORS, 1);
+    }
 
     fprintf(stderr, "%s", PQresultErrorMessage(stmt));
 
@@ -591,11 +607,17 @@ void uploadSensorValue (Sensor* sensor, float val, list* queryList) {
         sprintf(params[0], "%d", sensor->id);
         snprintf(params[1], 12, "%f", val);
 
+        uint64_t received = __atomic_load_n(&sensor->received, __ATOMIC_ACQUIRE);
         __DB_exec(
             query,
             params
         );
 
+        // Rows are inserted on every rule pass, only the first one of each sample counts
+        if (received && __atomic_exchange_n(&sensor->uploaded, received, __ATOMIC_RELAXED) != received) {
+            recordMetricTime(METRIC_SAMPLE_DB_TIME, getMonotonicTimeNs() - received);
+        }
+
         for (int i = 0; i < query->nParams; i++) {
             free(params[i]);
         }
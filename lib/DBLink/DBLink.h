@@ -3,6 +3,7 @@
 
 #include <libpq-fe.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 typedef struct _dbquery DBQuery;
 
@@ -22,6 +23,7 @@ char* getConnectionStringFromFile (const char* filename);
 void DB_prepareSQLQueries (PGconn* conn, list* queryList);
 void DB_preparePriorityQueries (PGconn* conn, list* queryList);
 void DB_prepareRegularQueries (PGconn* conn, list* queryList);
+DBQuery* findQueryByName (list* queryList, char* query_name);
 PGresult* __DB_exec (DBQuery* query, char* paramValues[]);
 PGresult* DB_exec (list* queryList, char* query_name, char* paramValues[]);
 void DB_uploadConfiguration (Datastore* datastore, list* queryList);
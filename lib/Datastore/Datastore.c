@@ -1,4 +1,7 @@
+#include <stdio.h>
+
 #include "Datastore.h"
+#include "Clock.h"
 
 
 Datastore* createDatastore () {
@@ -40,10 +43,62 @@ Datastore* createDatastore () {
         return NULL;
     }
 
+    // Profile transitions happen on minute boundaries: one slot per minute of the day
+    TimerWheel* profileTimers = createTimerWheel(PROFILE_MINUTES_PER_DAY, time(NULL)/60);
+    if (profileTimers == NULL) {
+        deleteList(profiles);
+        deleteList(rules);
+        deleteList(pixels);
+        deleteList(rooms);
+        free(datastore);
+        return NULL;
+    }
+
+    TimerWheel* livenessTimers = createTimerWheel(NODE_LIVENESS_SLOTS, getMonotonicTime()/NODE_LIVENESS_TICK);
+    if (livenessTimers == NULL) {
+        deleteTimerWheel(profileTimers);
+        deleteList(profiles);
+        deleteList(rules);
+        deleteList(pixels);
+        deleteList(rooms);
+        free(datastore);
+        return NULL;
+    }
+
+    list* panels = newList();
+    if (panels == NULL) {
+        deleteTimerWheel(livenessTimers);
+        deleteTimerWheel(profileTimers);
+        deleteList(profiles);
+        deleteList(rules);
+        deleteList(pixels);
+        deleteList(rooms);
+        free(datastore);
+        return NULL;
+    }
+
     datastore->rooms = rooms;
     datastore->pixels = pixels;
     datastore->rules = rules;
     datastore->profiles = profiles;
+    datastore->program = NULL;
+    datastore->colors = NULL;
+    datastore->actuatorPolicy = ACTUATOR_POLICY_LAST_WRITER;
+    datastore->profileTimers = profileTimers;
+    datastore->profileClock = 0;
+    datastore->minuteOfDay = 0;
+    datastore->utcOffset = 0;
+    struct tm currentTime;
+    time_t rawtime = time(NULL);
+    if (localtime_r(&rawtime, &currentTime)) {
+        datastore->utcOffset = currentTime.tm_gmtoff;
+    }
+    datastore->sensorHistories = NULL;
+    datastore->livenessTimers = livenessTimers;
+    datastore->bulkLoad = false;
+    datastore->matrixWidth = DATASTORE_MATRIX_WIDTH;
+    datastore->matrixHeight = DATASTORE_MATRIX_HEIGHT;
+    datastore->panels = panels;
 
     return datastore;
 }
@@ -55,6 +110,21 @@ bool deleteDatastore (Datastore* datastore) {
 
     list_element* aux;
 
+    invalidateRuleProgram(datastore);
+    invalidateColorBatch(datastore);
+    deleteSensorHistories(datastore);
+
+    // Delete all datastore's rules first: sensors, actuators and profiles unlink
+    // themselves from every rule when deleted, which is quadratic with the rules still there
+    aux = listStart(datastore->rules);
+    while (aux != NULL) {
+        if (deleteRule(aux->ptr)) {
+            // Error
+            return 1;
+        }
+        aux = listStart(datastore->rules);
+    }
+
     // Delete all datastore's rooms
     aux = listStart(datastore->rooms);
     while (aux != NULL) {
@@ -87,20 +157,152 @@ bool deleteDatastore (Datastore* datastore) {
         aux = listStart(datastore->profiles);
     }
     deleteList(datastore->profiles);
+    deleteList(datastore->rules);
 
-    // Delete all datastore's rules
-    aux = listStart(datastore->rules);
+    // Delete all datastore's panels
+    aux = listStart(datastore->panels);
     while (aux != NULL) {
-        if (deleteRule(aux->ptr)) {
+        if (deletePanel(aux->ptr)) {
             // Error
             return 1;
         }
-        aux = listStart(datastore->rules);
+        aux = listStart(datastore->panels);
     }
-    deleteList(datastore->rules);
+    deleteList(datastore->panels);
 
+    deleteTimerWheel(datastore->profileTimers);
+    deleteTimerWheel(datastore->livenessTimers);
 
     free(datastore);
 
     return 0;
 }
+
+bool setMatrixSize (Datastore* datastore, uint16_t width, uint16_t height) {
+    if (!datastore || !width || !height || listSize(datastore->panels)) {
+        return true;
+    }
+
+    datastore->matrixWidth = width;
+    datastore->matrixHeight = height;
+
+    return false;
+}
+
+// Adds an element to a table of the index, reporting it if the key was taken
+void indexElement (HashTable* table, uint32_t key, void* element, const char* kind, uint32_t* nErrors, bool* error) {
+    void* existing = NULL;
+    if (insertHashTable(table, key, element, &existing)) {
+        *error = true;
+    }
+    else if (existing) {
+        fprintf(stderr, "Configuration error: %s %u is defined more than once.\n", kind, key);
+        (*nErrors)++;
+    }
+}
+
+void indexPixel (DatastoreIndex* index, Pixel* pixel, uint32_t* nErrors, bool* error) {
+    void* existing = NULL;
+    if (insertHashTable(index->pixels, HASH_POSITION_KEY(pixel->pos->x, pixel->pos->y), pixel, &existing)) {
+        *error = true;
+    }
+    else if (existing) {
+        fprintf(stderr, "Configuration error: pixel (%u, %u) is used more than once.\n", pixel->pos->x, pixel->pos->y);
+        (*nErrors)++;
+    }
+}
+
+DatastoreIndex* indexDatastore (Datastore* datastore, uint32_t* nErrors) {
+    if (!datastore || !nErrors) {
+        return NULL;
+    }
+
+    // Size the tables up front, so they never grow while filled
+    uint32_t nRooms = listSize(datastore->rooms),
+        nNodes = 0,
+        nSensors = 0,
+        nActuators = 0;
+    LL_iterator(datastore->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        nNodes += listSize(room->nodes);
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+            nSensors += listSize(node->sensors);
+            nActuators += listSize(node->actuators);
+        }
+    }
+
+    DatastoreIndex* index = (DatastoreIndex*)malloc(sizeof(DatastoreIndex));
+    if (!index) {
+        return NULL;
+    }
+
+    index->rooms = createHashTable(nRooms);
+    index->nodes = createHashTable(nNodes);
+    index->sensors = createHashTable(nSensors);
+    index->actuators = createHashTable(nActuators);
+    index->pixels = createHashTable(listSize(datastore->pixels));
+    index->profiles = createHashTable(listSize(datastore->profiles));
+    index->rules = createHashTable(listSize(datastore->rules));
+
+    bool error = !index->rooms || !index->nodes || !index->sensors || !index->actuators ||
+        !index->pixels || !index->profiles || !index->rules;
+
+    LL_iterator(datastore->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        indexElement(index->rooms, room->id, room, "room", nErrors, &error);
+
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+            indexElement(index->nodes, node->id, node, "node", nErrors, &error);
+
+            LL_iterator(node->sensors, sensor_elem) {
+                Sensor* sensor = (Sensor*)sensor_elem->ptr;
+                indexElement(index->sensors, sensor->id, sensor, "sensor", nErrors, &error);
+            }
+
+            LL_iterator(node->actuators, actuator_elem) {
+                Actuator* actuator = (Actuator*)actuator_elem->ptr;
+                indexElement(index->actuators, actuator->id, actuator, "actuator", nErrors, &error);
+            }
+        }
+    }
+
+    LL_iterator(datastore->pixels, pixel_elem) {
+        indexPixel(index, (Pixel*)pixel_elem->ptr, nErrors, &error);
+    }
+
+    LL_iterator(datastore->profiles, profile_elem) {
+        Profile* profile = (Profile*)profile_elem->ptr;
+        indexElement(index->profiles, profile->id, profile, "profile", nErrors, &error);
+    }
+
+    LL_iterator(datastore->rules, rule_elem) {
+        Rule* rule = (Rule*)rule_elem->ptr;
+        indexElement(index->rules, rule->id, rule, "rule", nErrors, &error);
+    }
+
+    if (error) {
+        deleteDatastoreIndex(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+bool deleteDatastoreIndex (DatastoreIndex* index) {
+    if (!index) {
+        return true;
+    }
+
+    deleteHashTable(index->rooms);
+    deleteHashTable(index->nodes);
+    deleteHashTable(index->sensors);
+    deleteHashTable(index->actuators);
+    deleteHashTable(index->pixels);
+    deleteHashTable(index->profiles);
+    deleteHashTable(index->rules);
+    free(index);
+
+    return false;
+}
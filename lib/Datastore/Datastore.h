@@ -3,8 +3,11 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 
 typedef struct _datastore Datastore;
+typedef struct _datastore_index DatastoreIndex;
 
 #include "LinkedList.h"
 
@@ -12,6 +15,15 @@ typedef struct _datastore Datastore;
 #include "Rule.h"
 #include "Pixel.h"
 #include "Profile.h"
+#include "RuleProgram.h"
+#include "ColorBatch.h"
+#include "TimerWheel.h"
+#include "SensorHistory.h"
+#include "HashTable.h"
+#include "Panel.h"
+
+#define DATASTORE_MATRIX_WIDTH  30  // Size of the RGB matrix when the configuration does not set it
+#define DATASTORE_MATRIX_HEIGHT 30
 
 
 
@@ -24,6 +36,35 @@ struct _datastore {
     list* pixels;
     list* rules;
     list* profiles;
+    RuleProgram* program;
+    ColorBatch* colors;
+    uint8_t actuatorPolicy;
+    TimerWheel* profileTimers;
+    time_t profileClock;
+    uint16_t minuteOfDay;
+    long utcOffset;
+    void* sensorHistories;
+    TimerWheel* livenessTimers;
+    bool bulkLoad;
+    uint16_t matrixWidth;
+    uint16_t matrixHeight;
+    list* panels;
+};
+
+/**
+ * @brief Elements of a Datastore by ID, and pixels by position, for lookups in constant time
+ * while a whole configuration is loaded.
+ * Not kept up to date: elements created or deleted afterwards are not in it.
+ *
+ */
+struct _datastore_index {
+    HashTable* rooms;
+    HashTable* nodes;
+    HashTable* sensors;
+    HashTable* actuators;
+    HashTable* pixels;
+    HashTable* profiles;
+    HashTable* rules;
 };
 
 /**
@@ -42,4 +83,35 @@ Datastore* createDatastore ();
  */
 bool deleteDatastore (Datastore* datastore);
 
+/**
+ * @brief Set the size of the RGB matrix. Must be set before any panel is created.
+ *
+ * @param datastore Pointer to the Datastore object
+ * @param width Number of columns
+ * @param height Number of rows
+ * @return true Error
+ * @return false All good
+ */
+bool setMatrixSize (Datastore* datastore, uint16_t width, uint16_t height);
+
+/**
+ * @brief Indexes every element of a datastore in a single pass, reporting on stderr all the IDs
+ * and pixel positions used more than once. Meant to be called once a configuration was loaded
+ * with bulkLoad set, as the create functions skip their uniqueness checks then.
+ *
+ * @param datastore Pointer to the Datastore object
+ * @param nErrors Incremented by the number of duplicates found
+ * @return DatastoreIndex* Pointer to the new DatastoreIndex object. NULL if error.
+ */
+DatastoreIndex* indexDatastore (Datastore* datastore, uint32_t* nErrors);
+
+/**
+ * @brief Delete a DatastoreIndex object. The indexed elements are not deleted.
+ *
+ * @param index Pointer to the DatastoreIndex object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteDatastoreIndex (DatastoreIndex* index);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,432 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "FrameWriter.h"
+#include "Clock.h"
+
+// Bytes per pixel of a binary format
+#define FRAME_PIXEL_SIZE(format) ((format) == FRAME_FORMAT_RGB565 ? 2 : FRAMEBUFFER_CHANNELS)
+
+// Longest text of a pixel and its separator: "[255,255,255],"
+#define FRAME_TEXT_PIXEL_MAX    14
+
+// Decimal text of every color component, with its length
+const struct {
+    char digits[3];
+    uint8_t length;
+} frameDecimals[256] = {
+    {"0", 1}, {"1", 1}, {"2", 1}, {"3", 1}, {"4", 1}, {"5", 1}, {"6", 1}, {"7", 1},
+    {"8", 1}, {"9", 1}, {"10", 2}, {"11", 2}, {"12", 2}, {"13", 2}, {"14", 2}, {"15", 2},
+    {"16", 2}, {"17", 2}, {"18", 2}, {"19", 2}, {"20", 2}, {"21", 2}, {"22", 2}, {"23", 2},
+    {"24", 2}, {"25", 2}, {"26", 2}, {"27", 2}, {"28", 2}, {"29", 2}, {"30", 2}, {"31", 2},
+    {"32", 2}, {"33", 2}, {"34", 2}, {"35", 2}, {"36", 2}, {"37", 2}, {"38", 2}, {"39", 2},
+    {"40", 2}, {"41", 2}, {"42", 2}, {"43", 2}, {"44", 2}, {"45", 2}, {"46", 2}, {"47", 2},
+    {"48", 2}, {"49", 2}, {"50", 2}, {"51", 2}, {"52", 2}, {"53", 2}, {"54", 2}, {"55", 2},
+    {"56", 2}, {"57", 2}, {"58", 2}, {"59", 2}, {"60", 2}, {"61", 2}, {"62", 2}, {"63", 2},
+    {"64", 2}, {"65", 2}, {"66", 2}, {"67", 2}, {"68", 2}, {"69", 2}, {"70", 2}, {"71", 2},
+    {"72", 2}, {"73", 2}, {"74", 2}, {"75", 2}, {"76", 2}, {"77", 2}, {"78", 2}, {"79", 2},
+    {"80", 2}, {"81", 2}, {"82", 2}, {"83", 2}, {"84", 2}, {"85", 2}, {"86", 2}, {"87", 2},
+    {"88", 2}, {"89", 2}, {"90", 2}, {"91", 2}, {"92", 2}, {"93", 2}, {"94", 2}, {"95", 2},
+    {"96", 2}, {"97", 2}, {"98", 2}, {"99", 2}, {"100", 3}, {"101", 3}, {"102", 3}, {"103", 3},
+    {"104", 3}, {"105", 3}, {"106", 3}, {"107", 3}, {"108", 3}, {"109", 3}, {"110", 3}, {"111", 3},
+    {"112", 3}, {"113", 3}, {"114", 3}, {"115", 3}, {"116", 3}, {"117", 3}, {"118", 3}, {"119", 3},
+    {"120", 3}, {"121", 3}, {"122", 3}, {"123", 3}, {"124", 3}, {"125", 3}, {"126", 3}, {"127", 3},
+    {"128", 3}, {"129", 3}, {"130", 3}, {"131", 3}, {"132", 3}, {"133", 3}, {"134", 3}, {"135", 3},
+    {"136", 3}, {"137", 3}, {"138", 3}, {"139", 3}, {"140", 3}, {"141", 3}, {"142", 3}, {"143", 3},
+    {"144", 3}, {"145", 3}, {"146", 3}, {"147", 3}, {"148", 3}, {"149", 3}, {"150", 3}, {"151", 3},
+    {"152", 3}, {"153", 3}, {"154", 3}, {"155", 3}, {"156", 3}, {"157", 3}, {"158", 3}, {"159", 3},
+    {"160", 3}, {"161", 3}, {"162", 3}, {"163", 3}, {"164", 3}, {"165", 3}, {"166", 3}, {"167", 3},
+    {"168", 3}, {"169", 3}, {"170", 3}, {"171", 3}, {"172", 3}, {"173", 3}, {"174", 3}, {"175", 3},
+    {"176", 3}, {"177", 3}, {"178", 3}, {"179", 3}, {"180", 3}, {"181", 3}, {"182", 3}, {"183", 3},
+    {"184", 3}, {"185", 3}, {"186", 3}, {"187", 3}, {"188", 3}, {"189", 3}, {"190", 3}, {"191", 3},
+    {"192", 3}, {"193", 3}, {"194", 3}, {"195", 3}, {"196", 3}, {"197", 3}, {"198", 3}, {"199", 3},
+    {"200", 3}, {"201", 3}, {"202", 3}, {"203", 3}, {"204", 3}, {"205", 3}, {"206", 3}, {"207", 3},
+    {"208", 3}, {"209", 3}, {"210", 3}, {"211", 3}, {"212", 3}, {"213", 3}, {"214", 3}, {"215", 3},
+    {"216", 3}, {"217", 3}, {"218", 3}, {"219", 3}, {"220", 3}, {"221", 3}, {"222", 3}, {"223", 3},
+    {"224", 3}, {"225", 3}, {"226", 3}, {"227", 3}, {"228", 3}, {"229", 3}, {"230", 3}, {"231", 3},
+    {"232", 3}, {"233", 3}, {"234", 3}, {"235", 3}, {"236", 3}, {"237", 3}, {"238", 3}, {"239", 3},
+    {"240", 3}, {"241", 3}, {"242", 3}, {"243", 3}, {"244", 3}, {"245", 3}, {"246", 3}, {"247", 3},
+    {"248", 3}, {"249", 3}, {"250", 3}, {"251", 3}, {"252", 3}, {"253", 3}, {"254", 3}, {"255", 3},
+};
+
+FrameWriter* createFrameWriter (FILE* stream, uint8_t format, uint16_t width, uint16_t height) {
+    if (!stream || format > FRAME_FORMAT_RGB565 || !width || !height) {
+        return NULL;
+    }
+
+    FrameWriter* writer = (FrameWriter*)malloc(sizeof(FrameWriter));
+    if (!writer) {
+        return NULL;
+    }
+
+    size_t nPixels = (size_t)width * height;
+
+    // RGB888 is sent straight from the frame, RGB565 needs a buffer to convert into and
+    // text keeps the last frame formatted, with where each pixel landed, to patch it
+    writer->payload = NULL;
+    writer->reference = NULL;
+    writer->textOffsets = NULL;
+    writer->textLengths = NULL;
+    writer->textLength = 0;
+    if (format == FRAME_FORMAT_RGB565) {
+        writer->payload = (uint8_t*)malloc(nPixels * 2);
+        if (!writer->payload) {
+            free(writer);
+            return NULL;
+        }
+    }
+    else if (format == FRAME_FORMAT_TEXT) {
+        writer->payload = (uint8_t*)malloc(nPixels * FRAME_TEXT_PIXEL_MAX + 2);
+        writer->reference = (uint8_t*)malloc(nPixels * FRAMEBUFFER_CHANNELS);
+        writer->textOffsets = (uint32_t*)malloc(nPixels * sizeof(uint32_t));
+        writer->textLengths = (uint8_t*)malloc(nPixels);
+        if (!writer->payload || !writer->reference || !writer->textOffsets || !writer->textLengths) {
+            free(writer->payload);
+            free(writer->reference);
+            free(writer->textOffsets);
+            free(writer->textLengths);
+            free(writer);
+            return NULL;
+        }
+    }
+
+    writer->stream = stream;
+    writer->format = format;
+    writer->width = width;
+    writer->height = height;
+    writer->delta = false;
+    writer->keyframePeriod = 0;
+    writer->lastKeyframe = 0;
+    writer->lastSequence = 0;
+
+    writer->header.magic = FRAME_HEADER_MAGIC;
+    writer->header.version = FRAME_HEADER_VERSION;
+    writer->header.format = format;
+    writer->header.width = width;
+    writer->header.height = height;
+    writer->header.flags = 0;
+    writer->header.sequence = 0;
+    writer->header.length = (uint32_t)(nPixels * FRAME_PIXEL_SIZE(format));
+
+    return writer;
+}
+
+bool deleteFrameWriter (FrameWriter* writer) {
+    if (!writer) {
+        return true;
+    }
+
+    free(writer->payload);
+    free(writer->reference);
+    free(writer->textOffsets);
+    free(writer->textLengths);
+    free(writer);
+
+    return false;
+}
+
+// Writes every byte of the vectors, resuming after short writes and signals
+bool writeAllVectors (int fd, struct iovec* iov, int iovcnt) {
+    while (iovcnt) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return true;
+        }
+
+        while (iovcnt && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt) {
+            iov->iov_base = (uint8_t*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    return false;
+}
+
+bool setFrameWriterDelta (FrameWriter* writer, uint32_t keyframePeriod) {
+    if (!writer || writer->format == FRAME_FORMAT_TEXT || writer->delta) {
+        return true;
+    }
+
+    // Spans never take more than a header per changed pixel
+    size_t nPixels = (size_t)writer->width * writer->height;
+    uint8_t* payload = (uint8_t*)realloc(writer->payload, nPixels * (FRAME_SPAN_HEADER + FRAME_PIXEL_SIZE(writer->format)));
+    if (!payload) {
+        return true;
+    }
+    writer->payload = payload;
+
+    writer->reference = (uint8_t*)malloc(nPixels * FRAMEBUFFER_CHANNELS);
+    if (!writer->reference) {
+        return true;
+    }
+
+    writer->delta = true;
+    writer->keyframePeriod = keyframePeriod;
+
+    return false;
+}
+
+// Little endian stores, independent of the byte order of the host
+uint8_t* putLE16 (uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    return out + 2;
+}
+
+uint8_t* putLE32 (uint8_t* out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+    return out + 4;
+}
+
+// Serializes a header into FRAME_HEADER_SIZE bytes
+void encodeFrameHeader (const FrameHeader* header, uint8_t* out) {
+    out = putLE32(out, header->magic);
+    *out++ = header->version;
+    *out++ = header->format;
+    out = putLE16(out, header->width);
+    out = putLE16(out, header->height);
+    out = putLE16(out, header->flags);
+    out = putLE32(out, header->sequence);
+    putLE32(out, header->length);
+}
+
+// Encodes count pixels of the frame in the format of the writer, returns the bytes written
+size_t encodePixels (uint8_t format, const uint8_t* rgb, size_t count, uint8_t* out) {
+    if (format == FRAME_FORMAT_RGB888) {
+        memcpy(out, rgb, count*FRAMEBUFFER_CHANNELS);
+        return count*FRAMEBUFFER_CHANNELS;
+    }
+
+    for (size_t i = 0; i < count; i++, rgb += FRAMEBUFFER_CHANNELS) {
+        putLE16(out + 2*i, (uint16_t)(((rgb[0] & 0xF8) << 8) | ((rgb[1] & 0xFC) << 3) | (rgb[2] >> 3)));
+    }
+    return count*2;
+}
+
+// Fills the payload with the spans of pixels that differ from the reference, returns its length.
+// Runs of unchanged pixels cheaper to resend than to skip are folded into the spans around them.
+size_t encodeDelta (FrameWriter* writer, const uint8_t* frame) {
+    size_t nPixels = (size_t)writer->width * writer->height;
+    size_t pixelSize = FRAME_PIXEL_SIZE(writer->format);
+    size_t maxGap = FRAME_SPAN_HEADER / pixelSize;
+    const uint8_t* reference = writer->reference;
+    uint8_t* out = writer->payload;
+
+    size_t i = 0;
+    while (i < nPixels) {
+        if (!memcmp(frame + i*FRAMEBUFFER_CHANNELS, reference + i*FRAMEBUFFER_CHANNELS, FRAMEBUFFER_CHANNELS)) {
+            i++;
+            continue;
+        }
+
+        // Extend the span while the next change is close enough
+        size_t start = i, end = i + 1, gap = 0;
+        for (size_t j = end; j < nPixels && j - start < FRAME_SPAN_MAX_PIXELS; j++) {
+            if (memcmp(frame + j*FRAMEBUFFER_CHANNELS, reference + j*FRAMEBUFFER_CHANNELS, FRAMEBUFFER_CHANNELS)) {
+                end = j + 1;
+                gap = 0;
+            }
+            else if (++gap > maxGap) {
+                break;
+            }
+        }
+
+        uint16_t count = (uint16_t)(end - start);
+        out = putLE32(out, (uint32_t)start);
+        out = putLE16(out, count);
+        out += encodePixels(writer->format, frame + start*FRAMEBUFFER_CHANNELS, count, out);
+
+        i = end;
+    }
+
+    return (size_t)(out - writer->payload);
+}
+
+// Formats a pixel as "[r,g,b]", returns its length
+uint8_t formatTextPixel (const uint8_t* rgb, char* out) {
+    uint8_t length = 0;
+    out[length++] = '[';
+    for (uint8_t c = 0; c < FRAMEBUFFER_CHANNELS; c++) {
+        memcpy(out + length, frameDecimals[rgb[c]].digits, 3);
+        length += frameDecimals[rgb[c]].length;
+        out[length++] = c < FRAMEBUFFER_CHANNELS-1 ? ',' : ']';
+    }
+    return length;
+}
+
+// Formats the whole frame, column after column, recording where each pixel lands
+void buildTextFrame (FrameWriter* writer, const uint8_t* frame) {
+    char* out = (char*)writer->payload;
+    size_t length = 0;
+
+    out[length++] = '[';
+    for (uint32_t x = 0; x < writer->width; x++) {
+        for (uint32_t y = 0; y < writer->height; y++) {
+            size_t i = (size_t)y*writer->width + x;
+            writer->textOffsets[i] = (uint32_t)length;
+            writer->textLengths[i] = formatTextPixel(frame + i*FRAMEBUFFER_CHANNELS, out + length);
+            length += writer->textLengths[i];
+            out[length++] = ',';
+        }
+    }
+    out[length-1] = ']';
+    out[length++] = '\n';
+
+    writer->textLength = length;
+}
+
+// Brings the formatted frame up to date, rewriting only the pixels that changed.
+// Falls back to formatting everything when a pixel changes its length.
+void updateTextFrame (FrameWriter* writer, const uint8_t* frame) {
+    if (!writer->textLength) {
+        buildTextFrame(writer, frame);
+        return;
+    }
+
+    size_t nPixels = (size_t)writer->width * writer->height;
+    char* out = (char*)writer->payload;
+    for (size_t i = 0; i < nPixels; i++) {
+        const uint8_t* rgb = frame + i*FRAMEBUFFER_CHANNELS;
+        if (!memcmp(rgb, writer->reference + i*FRAMEBUFFER_CHANNELS, FRAMEBUFFER_CHANNELS)) {
+            continue;
+        }
+
+        char text[FRAME_TEXT_PIXEL_MAX];
+        uint8_t length = formatTextPixel(rgb, text);
+        if (length != writer->textLengths[i]) {
+            buildTextFrame(writer, frame);
+            return;
+        }
+        memcpy(out + writer->textOffsets[i], text, length);
+    }
+}
+
+bool writeTextFrame (FrameWriter* writer, const uint8_t* frame, uint64_t sequence, bool* written) {
+    if (!writer->textLength || sequence != writer->lastSequence) {
+        updateTextFrame(writer, frame);
+        memcpy(writer->reference, frame, (size_t)writer->width * writer->height * FRAMEBUFFER_CHANNELS);
+        writer->lastSequence = sequence;
+    }
+
+    struct iovec iov;
+    iov.iov_base = writer->payload;
+    iov.iov_len = writer->textLength;
+
+    bool error = writeAllVectors(fileno(writer->stream), &iov, 1);
+    if (written) {
+        *written = !error;
+    }
+
+    return error;
+}
+
+bool writeFrame (FrameWriter* writer, const uint8_t* frame, uint64_t sequence, bool* written) {
+    if (written) {
+        *written = false;
+    }
+    if (!writer || !frame) {
+        return true;
+    }
+
+    if (writer->format == FRAME_FORMAT_TEXT) {
+        return writeTextFrame(writer, frame, sequence, written);
+    }
+
+    size_t nPixels = (size_t)writer->width * writer->height;
+    size_t fullLength = nPixels * FRAME_PIXEL_SIZE(writer->format);
+    const uint8_t* payload = frame;
+    size_t length = fullLength;
+    uint16_t flags = 0;
+
+    if (writer->delta) {
+        uint64_t now = getMonotonicTime();
+        bool keyframe = !writer->lastKeyframe || now - writer->lastKeyframe >= writer->keyframePeriod;
+
+        // Nothing new since the last frame sent
+        if (!keyframe && sequence == writer->lastSequence) {
+            return false;
+        }
+
+        if (!keyframe) {
+            length = encodeDelta(writer, frame);
+            if (!length) {
+                writer->lastSequence = sequence;
+                return false;
+            }
+
+            // A full frame is no bigger, and resyncs receivers too
+            keyframe = length >= fullLength;
+        }
+
+        if (keyframe) {
+            length = fullLength;
+            writer->lastKeyframe = now;
+        }
+        else {
+            payload = writer->payload;
+            flags = FRAME_FLAG_DELTA;
+        }
+
+        memcpy(writer->reference, frame, nPixels * FRAMEBUFFER_CHANNELS);
+        writer->lastSequence = sequence;
+    }
+
+    if (!flags && writer->format == FRAME_FORMAT_RGB565) {
+        encodePixels(writer->format, frame, nPixels, writer->payload);
+        payload = writer->payload;
+    }
+
+    writer->header.flags = flags;
+    writer->header.sequence = (uint32_t)sequence;
+    writer->header.length = (uint32_t)length;
+
+    uint8_t header[FRAME_HEADER_SIZE];
+    encodeFrameHeader(&writer->header, header);
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = FRAME_HEADER_SIZE;
+    iov[1].iov_base = (void*)payload;
+    iov[1].iov_len = writer->header.length;
+
+    bool error = writeAllVectors(fileno(writer->stream), iov, 2);
+    if (written) {
+        *written = !error;
+    }
+
+    return error;
+}
+
+bool parseFrameFormat (const char* name, uint8_t* format) {
+    if (!name || !format) {
+        return true;
+    }
+
+    if (!strcmp(name, "text")) {
+        *format = FRAME_FORMAT_TEXT;
+    }
+    else if (!strcmp(name, "rgb888")) {
+        *format = FRAME_FORMAT_RGB888;
+    }
+    else if (!strcmp(name, "rgb565")) {
+        *format = FRAME_FORMAT_RGB565;
+    }
+    else {
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,128 @@
+#ifndef __FRAME_WRITER__
+#define __FRAME_WRITER__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct _frame_writer FrameWriter;
+typedef struct _frame_header FrameHeader;
+
+#include "Framebuffer.h"
+
+#define FRAME_FORMAT_TEXT       0   // One line of "[[r,g,b],...]" per frame, column after column
+#define FRAME_FORMAT_RGB888     1   // Header followed by 3 bytes per pixel, row after row
+#define FRAME_FORMAT_RGB565     2   // Header followed by 2 little endian bytes per pixel, row after row
+
+#define FRAME_HEADER_MAGIC      0x46534147  // "GASF" read as a little endian word
+#define FRAME_HEADER_VERSION    1
+#define FRAME_HEADER_SIZE       20      // Bytes of the header on the wire
+
+#define FRAME_FLAG_DELTA        0x1     // Payload holds the spans changed since the previous frame
+#define FRAME_SPAN_HEADER       6       // Bytes before the pixels of a span: uint32_t index, uint16_t count
+#define FRAME_SPAN_MAX_PIXELS   UINT16_MAX
+
+
+/**
+ * @brief Header sent before every binary frame. Written field by field in little endian,
+ * in this order and with no padding, whatever the byte order of the host.
+ * length is the number of payload bytes following the header.
+ *
+ * Frames without FRAME_FLAG_DELTA hold every pixel. Delta frames hold spans of changed
+ * pixels: the index of the first pixel (y*width + x) and the number of pixels, both little
+ * endian, followed by the pixels in the frame format. Pixels not in any span are unchanged.
+ *
+ */
+struct _frame_header {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t format;
+    uint16_t width;
+    uint16_t height;
+    uint16_t flags;
+    uint32_t sequence;
+    uint32_t length;
+};
+
+/**
+ * @brief Encodes frames of a Framebuffer into an output stream.
+ * Binary frames go out with a single writev on the file descriptor of the stream.
+ *
+ * In delta mode the frame last sent is kept as reference: frames with no change are not
+ * sent at all, and a full keyframe goes out every keyframePeriod ms so receivers can resync.
+ *
+ * Text frames are kept formatted in payload, textLength bytes long, with the offset and
+ * length of every pixel so the next frame only rewrites the pixels that changed.
+ *
+ */
+struct _frame_writer {
+    FILE* stream;
+    uint8_t format;
+    uint16_t width;
+    uint16_t height;
+    FrameHeader header;
+    uint8_t* payload;
+    bool delta;
+    uint32_t keyframePeriod;
+    uint64_t lastKeyframe;
+    uint64_t lastSequence;
+    uint8_t* reference;
+    uint32_t* textOffsets;
+    uint8_t* textLengths;
+    size_t textLength;
+};
+
+/**
+ * @brief Create a FrameWriter object
+ *
+ * @param stream Output stream. Binary formats bypass its buffer.
+ * @param format One of FRAME_FORMAT_*
+ * @param width Number of columns of the frames
+ * @param height Number of rows of the frames
+ * @return FrameWriter* Pointer to the new FrameWriter object. NULL if error.
+ */
+FrameWriter* createFrameWriter (FILE* stream, uint8_t format, uint16_t width, uint16_t height);
+
+/**
+ * @brief Delete a FrameWriter object. The stream is not closed.
+ *
+ * @param writer Pointer to the FrameWriter object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteFrameWriter (FrameWriter* writer);
+
+/**
+ * @brief Switches a binary writer to delta frames
+ *
+ * @param writer Pointer to the FrameWriter object
+ * @param keyframePeriod Time, in ms, between full frames
+ * @return true Error, or the writer uses the text format
+ * @return false All good
+ */
+bool setFrameWriterDelta (FrameWriter* writer, uint32_t keyframePeriod);
+
+/**
+ * @brief Encodes and writes a whole frame. In delta mode only what changed is written, if anything.
+ *
+ * @param writer Pointer to the FrameWriter object
+ * @param frame Packed RGB pixels, as laid out by the Framebuffer
+ * @param sequence Number of the frame
+ * @param written Set when something was written, false for delta frames with no change. May be NULL.
+ * @return true Error
+ * @return false All good
+ */
+bool writeFrame (FrameWriter* writer, const uint8_t* frame, uint64_t sequence, bool* written);
+
+/**
+ * @brief Get the format matching a name
+ *
+ * @param name "text", "rgb888" or "rgb565"
+ * @param format Filled with the matching FRAME_FORMAT_*
+ * @return true Error, unknown name
+ * @return false All good
+ */
+bool parseFrameFormat (const char* name, uint8_t* format);
+
+#endif
@@ -0,0 +1,202 @@
+#include <string.h>
+
+#include "Framebuffer.h"
+
+// Fills a frame with the default pixel color
+void clearFrame (Framebuffer* framebuffer, uint8_t* frame) {
+    for (size_t i = 0; i < framebuffer->frameSize; i += FRAMEBUFFER_CHANNELS) {
+        frame[i] = PIXEL_DEFAULT_RED;
+        frame[i+1] = PIXEL_DEFAULT_GREEN;
+        frame[i+2] = PIXEL_DEFAULT_BLUE;
+    }
+}
+
+Framebuffer* createFramebuffer (uint16_t width, uint16_t height) {
+    if (!width || !height) {
+        return NULL;
+    }
+
+    Framebuffer* framebuffer = (Framebuffer*)malloc(sizeof(Framebuffer));
+    if (!framebuffer) {
+        return NULL;
+    }
+
+    framebuffer->width = width;
+    framebuffer->height = height;
+    framebuffer->frameSize = (size_t)width * height * FRAMEBUFFER_CHANNELS;
+
+    for (uint8_t i = 0; i < FRAMEBUFFER_SLOTS; i++) {
+        framebuffer->frames[i] = (uint8_t*)malloc(framebuffer->frameSize);
+        if (!framebuffer->frames[i]) {
+            while (i--) {
+                free(framebuffer->frames[i]);
+            }
+            free(framebuffer);
+            return NULL;
+        }
+
+        clearFrame(framebuffer, framebuffer->frames[i]);
+        framebuffer->sequences[i] = 0;
+    }
+
+    framebuffer->back = 0;
+    framebuffer->ready = 1;
+    framebuffer->front = 2;
+    framebuffer->published = 0;
+    framebuffer->closed = false;
+    framebuffer->shared = NULL;
+    pthread_mutex_init(&framebuffer->mutex, NULL);
+    pthread_cond_init(&framebuffer->newFrame, NULL);
+
+    return framebuffer;
+}
+
+bool deleteFramebuffer (Framebuffer* framebuffer) {
+    if (!framebuffer) {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < FRAMEBUFFER_SLOTS; i++) {
+        free(framebuffer->frames[i]);
+    }
+    deleteSharedFrame(framebuffer->shared);
+    pthread_mutex_destroy(&framebuffer->mutex);
+    pthread_cond_destroy(&framebuffer->newFrame);
+    free(framebuffer);
+
+    return false;
+}
+
+bool exportFramebuffer (Framebuffer* framebuffer, const char* name) {
+    if (!framebuffer || !name || framebuffer->shared) {
+        return true;
+    }
+
+    framebuffer->shared = createSharedFrame(name, framebuffer->width, framebuffer->height, FRAMEBUFFER_CHANNELS);
+
+    return !framebuffer->shared;
+}
+
+bool renderFrame (Framebuffer* framebuffer, Datastore* datastore) {
+    if (!framebuffer || !datastore) {
+        return true;
+    }
+
+    uint8_t* frame = framebuffer->frames[framebuffer->back];
+    clearFrame(framebuffer, frame);
+
+    LL_iterator(datastore->pixels, pixel_elem) {
+        Pixel* pixel = (Pixel*)pixel_elem->ptr;
+        if (pixel->pos->x >= framebuffer->width || pixel->pos->y >= framebuffer->height) {
+            continue;
+        }
+
+        uint8_t* rgb = frame + ((size_t)pixel->pos->y * framebuffer->width + pixel->pos->x) * FRAMEBUFFER_CHANNELS;
+        rgb[0] = pixel->color->r;
+        rgb[1] = pixel->color->g;
+        rgb[2] = pixel->color->b;
+    }
+
+    return false;
+}
+
+bool copyFrame (Framebuffer* framebuffer, const uint8_t* frame) {
+    if (!framebuffer || !frame) {
+        return true;
+    }
+
+    memcpy(framebuffer->frames[framebuffer->back], frame, framebuffer->frameSize);
+
+    return false;
+}
+
+bool copyFrameRegion (Framebuffer* framebuffer, const uint8_t* frame, uint16_t frameWidth, uint16_t frameHeight, uint16_t x, uint16_t y) {
+    if (!framebuffer || !frame || (uint32_t)x + framebuffer->width > frameWidth ||
+        (uint32_t)y + framebuffer->height > frameHeight) {
+        return true;
+    }
+
+    // One row of the rectangle at a time
+    size_t rowSize = (size_t)framebuffer->width * FRAMEBUFFER_CHANNELS;
+    uint8_t* back = framebuffer->frames[framebuffer->back];
+    for (uint16_t row = 0; row < framebuffer->height; row++) {
+        memcpy(back + row * rowSize,
+            frame + (((size_t)y + row) * frameWidth + x) * FRAMEBUFFER_CHANNELS, rowSize);
+    }
+
+    return false;
+}
+
+const uint8_t* getBackFrame (Framebuffer* framebuffer) {
+    if (!framebuffer) {
+        return NULL;
+    }
+
+    return framebuffer->frames[framebuffer->back];
+}
+
+void publishFrame (Framebuffer* framebuffer) {
+    if (!framebuffer) {
+        return;
+    }
+
+    uint64_t sequence = framebuffer->published + 1;
+    framebuffer->sequences[framebuffer->back] = sequence;
+    if (framebuffer->shared) {
+        writeSharedFrame(framebuffer->shared, framebuffer->frames[framebuffer->back], sequence);
+    }
+
+    // Release the frame to the consumer, and get whichever slot it is not reading
+    uint8_t previous = __atomic_exchange_n(&framebuffer->ready, framebuffer->back | FRAMEBUFFER_FRESH, __ATOMIC_ACQ_REL);
+    framebuffer->back = previous & ~FRAMEBUFFER_FRESH;
+
+    // Stored before taking the mutex, so a consumer about to wait either sees it or gets woken
+    __atomic_store_n(&framebuffer->published, sequence, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&framebuffer->mutex);
+    pthread_cond_signal(&framebuffer->newFrame);
+    pthread_mutex_unlock(&framebuffer->mutex);
+}
+
+const uint8_t* acquireFrame (Framebuffer* framebuffer, uint64_t* sequence) {
+    if (!framebuffer) {
+        return NULL;
+    }
+
+    // Only swap when there is a frame the consumer has not seen, otherwise keep the current one
+    if (__atomic_load_n(&framebuffer->ready, __ATOMIC_ACQUIRE) & FRAMEBUFFER_FRESH) {
+        uint8_t previous = __atomic_exchange_n(&framebuffer->ready, framebuffer->front, __ATOMIC_ACQ_REL);
+        framebuffer->front = previous & ~FRAMEBUFFER_FRESH;
+    }
+
+    if (sequence) {
+        *sequence = framebuffer->sequences[framebuffer->front];
+    }
+
+    return framebuffer->frames[framebuffer->front];
+}
+
+bool waitForFrame (Framebuffer* framebuffer, uint64_t sequence) {
+    if (!framebuffer) {
+        return true;
+    }
+
+    pthread_mutex_lock(&framebuffer->mutex);
+    while (!framebuffer->closed && __atomic_load_n(&framebuffer->published, __ATOMIC_ACQUIRE) <= sequence) {
+        pthread_cond_wait(&framebuffer->newFrame, &framebuffer->mutex);
+    }
+    bool closed = framebuffer->closed;
+    pthread_mutex_unlock(&framebuffer->mutex);
+
+    return closed;
+}
+
+void closeFramebuffer (Framebuffer* framebuffer) {
+    if (!framebuffer) {
+        return;
+    }
+
+    pthread_mutex_lock(&framebuffer->mutex);
+    framebuffer->closed = true;
+    pthread_cond_signal(&framebuffer->newFrame);
+    pthread_mutex_unlock(&framebuffer->mutex);
+}
@@ -0,0 +1,158 @@
+#ifndef __FRAMEBUFFER__
+#define __FRAMEBUFFER__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct _framebuffer Framebuffer;
+
+#include "Datastore.h"
+#include "Pixel.h"
+#include "SharedFrame.h"
+
+#define FRAMEBUFFER_SLOTS       3
+#define FRAMEBUFFER_FRESH       0x4     // Flag of the ready slot, set until the consumer takes the frame
+#define FRAMEBUFFER_CHANNELS    3       // Bytes per pixel: packed RGB
+
+
+/**
+ * @brief Frames of packed RGB pixels handed from the rules thread to the output thread
+ * without locks. Pixel (x, y) starts at byte (y*width + x)*FRAMEBUFFER_CHANNELS.
+ *
+ * There are three slots: the producer renders into back, the consumer reads front, and
+ * ready holds the last published frame. Both sides only swap their own slot with ready
+ * through an atomic exchange, so the producer never waits for the consumer and the
+ * consumer always gets whole frames, skipping the ones it was too slow to see.
+ *
+ * A consumer with nothing else to do can sleep until a new frame is published. The mutex
+ * only guards that wait: the producer takes it just to wake the consumer.
+ *
+ * Published frames can also be exported to other processes through shared memory.
+ *
+ */
+struct _framebuffer {
+    uint16_t width;
+    uint16_t height;
+    size_t frameSize;
+    uint8_t* frames[FRAMEBUFFER_SLOTS];
+    uint64_t sequences[FRAMEBUFFER_SLOTS];
+    uint8_t back;
+    uint8_t front;
+    uint8_t ready;
+    uint64_t published;
+    pthread_mutex_t mutex;
+    pthread_cond_t newFrame;
+    bool closed;
+    SharedFrame* shared;
+};
+
+/**
+ * @brief Create a Framebuffer object, with every frame filled with the default pixel color
+ *
+ * @param width Number of columns
+ * @param height Number of rows
+ * @return Framebuffer* Pointer to the new Framebuffer object. NULL if error.
+ */
+Framebuffer* createFramebuffer (uint16_t width, uint16_t height);
+
+/**
+ * @brief Delete a Framebuffer object
+ *
+ * @param framebuffer Pointer to the Framebuffer object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteFramebuffer (Framebuffer* framebuffer);
+
+/**
+ * @brief Exports every frame published from now on in a POSIX shared memory segment
+ *
+ * @param framebuffer Pointer to the Framebuffer object
+ * @param name Name of the segment, as given to shm_open
+ * @return true Error
+ * @return false All good
+ */
+bool exportFramebuffer (Framebuffer* framebuffer, const char* name);
+
+/**
+ * @brief Draws the pixels of a datastore into the back frame. Pixels are read without their
+ * mutex, so it must run on the thread updating the pixel colors.
+ * Pixels outside the frame are left out.
+ *
+ * @param framebuffer Pointer to the Framebuffer object
+ * @param datastore Pointer to the Datastore object
+ * @return true Error
+ * @return false All good
+ */
+bool renderFrame (Framebuffer* framebuffer, Datastore* datastore);
+
+/**
+ * @brief Copies a whole frame into the back frame, for framebuffers fed by another one
+ *
+ * @param framebuffer Pointer to the Framebuffer object
+ * @param frame Packed RGB pixels of the same size
+ * @return true Error
+ * @return false All good
+ */
+bool copyFrame (Framebuffer* framebuffer, const uint8_t* frame);
+
+/**
+ * @brief Copies a rectangle of a bigger frame into the back frame, for framebuffers
+ * showing part of the matrix. The rectangle has the size of the framebuffer.
+ *
+ * @param framebuffer Pointer to the Framebuffer object
+ * @param frame Packed RGB pixels of the bigger frame
+ * @param frameWidth Number of columns of the bigger frame
+ * @param frameHeight Number of rows of the bigger frame
+ * @param x First column of the rectangle
+ * @param y First row of the rectangle
+ * @return true Error, the rectangle does not fit in the bigger frame
+ * @return false All good
+ */
+bool copyFrameRegion (Framebuffer* framebuffer, const uint8_t* frame, uint16_t frameWidth, uint16_t frameHeight, uint16_t x, uint16_t y);
+
+/**
+ * @brief Get the back frame, as rendered so far. Producer side only.
+ *
+ * @param framebuffer Pointer to the Framebuffer object
+ * @return const uint8_t* Pixels of the back frame. NULL if error.
+ */
+const uint8_t* getBackFrame (Framebuffer* framebuffer);
+
+/**
+ * @brief Makes the back frame the latest one and takes a new back frame. Producer side only.
+ *
+ * @param framebuffer Pointer to the Framebuffer object
+ */
+void publishFrame (Framebuffer* framebuffer);
+
+/**
+ * @brief Gets the latest published frame. Consumer side only.
+ * The frame stays valid and unchanged until the next call.
+ *
+ * @param framebuffer Pointer to the Framebuffer object
+ * @param sequence Filled with the number of the frame, 0 before the first one is published. May be NULL.
+ * @return const uint8_t* Pixels of the frame. NULL if error.
+ */
+const uint8_t* acquireFrame (Framebuffer* framebuffer, uint64_t* sequence);
+
+/**
+ * @brief Waits until a frame newer than the given one is published. Consumer side only.
+ *
+ * @param framebuffer Pointer to the Framebuffer object
+ * @param sequence Number of the last frame acquired
+ * @return true Error, or the framebuffer was closed
+ * @return false A newer frame is ready to be acquired
+ */
+bool waitForFrame (Framebuffer* framebuffer, uint64_t sequence);
+
+/**
+ * @brief Wakes the consumer waiting for a frame and makes every later wait return right away
+ *
+ * @param framebuffer Pointer to the Framebuffer object
+ */
+void closeFramebuffer (Framebuffer* framebuffer);
+
+#endif
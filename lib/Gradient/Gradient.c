@@ -0,0 +1,75 @@
+#include <string.h>
+
+#include "Gradient.h"
+
+// Interpolates a component between two stops, rounding to the nearest
+uint8_t interpolateComponent (uint8_t from, uint8_t to, uint32_t position, uint32_t span) {
+    int32_t delta = ((int32_t)to - from) * (int32_t)position;
+    int32_t half = (int32_t)span / 2;
+
+    return (uint8_t)(from + (delta >= 0 ? delta + half : delta - half) / (int32_t)span);
+}
+
+Gradient* createGradient (const Color* stops, uint8_t nStops) {
+    if (!stops || !nStops || nStops > GRADIENT_MAX_STOPS) {
+        return NULL;
+    }
+
+    Gradient* gradient = (Gradient*)malloc(sizeof(Gradient));
+    if (!gradient) {
+        return NULL;
+    }
+
+    gradient->nStops = nStops;
+    memcpy(gradient->stops, stops, nStops*sizeof(Color));
+
+    // Step i sits at i*(nStops-1)/(GRADIENT_STEPS-1) stops from the first one
+    uint32_t span = GRADIENT_STEPS - 1;
+    for (uint32_t i = 0; i < GRADIENT_STEPS; i++) {
+        uint32_t position = i * (nStops - 1);
+        uint32_t stop = position / span;
+        if (stop >= (uint32_t)nStops - 1) {
+            gradient->lut[i] = stops[nStops - 1];
+            continue;
+        }
+
+        const Color* from = &stops[stop];
+        const Color* to = &stops[stop + 1];
+        position %= span;
+        gradient->lut[i].r = interpolateComponent(from->r, to->r, position, span);
+        gradient->lut[i].g = interpolateComponent(from->g, to->g, position, span);
+        gradient->lut[i].b = interpolateComponent(from->b, to->b, position, span);
+    }
+
+    return gradient;
+}
+
+Gradient* createDefaultGradient () {
+    Color stops[2] = {{0, 0, 0}, {0, 0, 255}};
+
+    return createGradient(stops, 2);
+}
+
+bool deleteGradient (Gradient* gradient) {
+    if (!gradient) {
+        return true;
+    }
+
+    free(gradient);
+
+    return false;
+}
+
+uint8_t getGradientStep (float value, float scale, float offset) {
+    float step = value * scale + offset;
+
+    // Written so NaN lands on the first step
+    if (!(step > 0)) {
+        return 0;
+    }
+    if (step >= GRADIENT_STEPS - 1) {
+        return GRADIENT_STEPS - 1;
+    }
+
+    return (uint8_t)step;
+}
@@ -0,0 +1,64 @@
+#ifndef __GRADIENT__
+#define __GRADIENT__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct _gradient Gradient;
+
+#include "Color.h"
+
+#define GRADIENT_MAX_STOPS  8
+#define GRADIENT_STEPS      256     // Colors of the lookup table, one per step of the sensor range
+
+
+/**
+ * @brief Colors a sensor range is mapped to. The stops are spread evenly over the range,
+ * the first one at its minimum and the last one at its maximum, and the colors in between
+ * are interpolated once into a lookup table.
+ *
+ */
+struct _gradient {
+    uint8_t nStops;
+    Color stops[GRADIENT_MAX_STOPS];
+    Color lut[GRADIENT_STEPS];
+};
+
+/**
+ * @brief Create a Gradient object
+ *
+ * @param stops Colors of the gradient, from the minimum to the maximum of the range
+ * @param nStops Number of stops, from 1 to GRADIENT_MAX_STOPS
+ * @return Gradient* Pointer to the new Gradient object. NULL if error.
+ */
+Gradient* createGradient (const Color* stops, uint8_t nStops);
+
+/**
+ * @brief Create a Gradient object going from black to blue, the colors sensors are shown with by default
+ *
+ * @return Gradient* Pointer to the new Gradient object. NULL if error.
+ */
+Gradient* createDefaultGradient ();
+
+/**
+ * @brief Delete a Gradient object
+ *
+ * @param gradient Pointer to the Gradient object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteGradient (Gradient* gradient);
+
+/**
+ * @brief Get the step of the lookup table for a value, saturating outside of the range.
+ * The step is value*scale + offset, truncated.
+ *
+ * @param value Value to map
+ * @param scale GRADIENT_STEPS-1 over the width of the range
+ * @param offset Step of a value of 0
+ * @return uint8_t Step of the lookup table
+ */
+uint8_t getGradientStep (float value, float scale, float offset);
+
+#endif
@@ -0,0 +1,115 @@
+#include <string.h>
+
+#include "HashTable.h"
+
+// Fibonacci hashing: spreads consecutive IDs over the whole table
+#define HASH_SLOT(table, key) ((uint32_t)((key) * 2654435769u) & ((table)->nSlots - 1))
+
+HashTable* createHashTable (uint32_t expected) {
+    uint32_t nSlots = HASH_TABLE_MIN_SLOTS;
+    while (nSlots < 2*(uint64_t)expected && nSlots < (UINT32_MAX >> 1)) {
+        nSlots <<= 1;
+    }
+
+    HashTable* table = (HashTable*)malloc(sizeof(HashTable));
+    if (!table) {
+        return NULL;
+    }
+
+    table->entries = (HashEntry*)calloc(nSlots, sizeof(HashEntry));
+    if (!table->entries) {
+        free(table);
+        return NULL;
+    }
+
+    table->nSlots = nSlots;
+    table->size = 0;
+
+    return table;
+}
+
+bool deleteHashTable (HashTable* table) {
+    if (!table) {
+        return true;
+    }
+
+    free(table->entries);
+    free(table);
+
+    return false;
+}
+
+// Doubles the number of slots, placing every entry again
+bool growHashTable (HashTable* table) {
+    HashTable grown;
+    grown.nSlots = table->nSlots << 1;
+    grown.size = table->size;
+    grown.entries = (HashEntry*)calloc(grown.nSlots, sizeof(HashEntry));
+    if (!grown.entries) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < table->nSlots; i++) {
+        HashEntry* entry = &table->entries[i];
+        if (!entry->value) {
+            continue;
+        }
+
+        uint32_t slot = HASH_SLOT(&grown, entry->key);
+        while (grown.entries[slot].value) {
+            slot = (slot + 1) & (grown.nSlots - 1);
+        }
+        grown.entries[slot] = *entry;
+    }
+
+    free(table->entries);
+    *table = grown;
+
+    return false;
+}
+
+bool insertHashTable (HashTable* table, uint32_t key, void* value, void** existing) {
+    if (!table || !value) {
+        return true;
+    }
+
+    if (2*(table->size + 1) > table->nSlots && growHashTable(table)) {
+        return true;
+    }
+
+    uint32_t slot = HASH_SLOT(table, key);
+    while (table->entries[slot].value) {
+        if (table->entries[slot].key == key) {
+            if (existing) {
+                *existing = table->entries[slot].value;
+            }
+            return false;
+        }
+        slot = (slot + 1) & (table->nSlots - 1);
+    }
+
+    table->entries[slot].key = key;
+    table->entries[slot].value = value;
+    table->size++;
+    if (existing) {
+        *existing = NULL;
+    }
+
+    return false;
+}
+
+void* findInHashTable (HashTable* table, uint32_t key) {
+    if (!table) {
+        return NULL;
+    }
+
+    uint32_t slot = HASH_SLOT(table, key);
+    while (table->entries[slot].value) {
+        if (table->entries[slot].key == key) {
+            return table->entries[slot].value;
+        }
+        slot = (slot + 1) & (table->nSlots - 1);
+    }
+
+    return NULL;
+}
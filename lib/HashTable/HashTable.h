@@ -0,0 +1,71 @@
+#ifndef __HASH_TABLE__
+#define __HASH_TABLE__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct _hash_table HashTable;
+typedef struct _hash_entry HashEntry;
+
+#define HASH_TABLE_MIN_SLOTS    16
+
+// Key of a position, for tables of pixels
+#define HASH_POSITION_KEY(x, y) (((uint32_t)(x) << 16) | (uint32_t)(y))
+
+
+struct _hash_entry {
+    uint32_t key;
+    void* value;
+};
+
+/**
+ * @brief Map from integer keys to non NULL pointers, with open addressing and linear probing.
+ * The number of slots is a power of two and kept at least twice the number of entries.
+ *
+ */
+struct _hash_table {
+    uint32_t nSlots;
+    uint32_t size;
+    HashEntry* entries;
+};
+
+/**
+ * @brief Create a HashTable object
+ *
+ * @param expected Number of entries expected, so the table does not have to grow while filled
+ * @return HashTable* Pointer to the new HashTable object. NULL if error.
+ */
+HashTable* createHashTable (uint32_t expected);
+
+/**
+ * @brief Delete a HashTable object. The values are not freed.
+ *
+ * @param table Pointer to the HashTable object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteHashTable (HashTable* table);
+
+/**
+ * @brief Inserts a value, unless the key is already in the table
+ *
+ * @param table Pointer to the HashTable object
+ * @param key Key of the value
+ * @param value Value to insert. Must not be NULL.
+ * @param existing Filled with the value already stored under the key, NULL if it was inserted. May be NULL.
+ * @return true Error
+ * @return false All good, even if the key was already there
+ */
+bool insertHashTable (HashTable* table, uint32_t key, void* value, void** existing);
+
+/**
+ * @brief Get the value stored under a key
+ *
+ * @param table Pointer to the HashTable object
+ * @param key Key to look for
+ * @return void* Value. NULL if the key is not in the table.
+ */
+void* findInHashTable (HashTable* table, uint32_t key);
+
+#endif
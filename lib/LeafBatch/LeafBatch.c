@@ -0,0 +1,445 @@
+#include "LeafBatch.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define LEAF_KERNEL_X86
+#endif
+
+#define LEAF_BATCH_INITIAL_SIZE 64
+
+LeafBatch* createLeafBatch () {
+    LeafBatch* batch = (LeafBatch*)malloc(sizeof(LeafBatch));
+    if (!batch) {
+        return NULL;
+    }
+
+    batch->size = 0;
+    batch->reserved = 0;
+    batch->nHysteresis = 0;
+    batch->sensors = NULL;
+    batch->raw = NULL;
+    for (uint8_t r = 0; r < LEAF_MAX_RANGES; r++) {
+        batch->low[r] = NULL;
+        batch->high[r] = NULL;
+        batch->holdLow[r] = NULL;
+        batch->holdHigh[r] = NULL;
+    }
+    batch->mask = NULL;
+    batch->holdMask = NULL;
+    batch->staleMask = NULL;
+    batch->nAggregates = 0;
+    batch->aggregates = NULL;
+    batch->nWindows = 0;
+    batch->windows = NULL;
+
+    return batch;
+}
+
+bool deleteLeafBatch (LeafBatch* batch) {
+    if (!batch) {
+        return true;
+    }
+
+    free(batch->sensors);
+    free(batch->raw);
+    for (uint8_t r = 0; r < LEAF_MAX_RANGES; r++) {
+        free(batch->low[r]);
+        free(batch->high[r]);
+        free(batch->holdLow[r]);
+        free(batch->holdHigh[r]);
+    }
+    free(batch->mask);
+    free(batch->holdMask);
+    free(batch->staleMask);
+    free(batch->aggregates);
+    free(batch->windows);
+    free(batch);
+
+    return false;
+}
+
+#define GROW_ARRAY(array, count) do { \
+        void* aux = realloc((array), (count)*sizeof(*(array))); \
+        if (!aux) { \
+            return true; \
+        } \
+        (array) = aux; \
+    } while (0)
+
+bool growLeafBatch (LeafBatch* batch) {
+    uint32_t reserved = batch->reserved ? batch->reserved*2 : LEAF_BATCH_INITIAL_SIZE;
+
+    GROW_ARRAY(batch->sensors, reserved);
+    GROW_ARRAY(batch->raw, reserved);
+    for (uint8_t r = 0; r < LEAF_MAX_RANGES; r++) {
+        GROW_ARRAY(batch->low[r], reserved);
+        GROW_ARRAY(batch->high[r], reserved);
+        GROW_ARRAY(batch->holdLow[r], reserved);
+        GROW_ARRAY(batch->holdHigh[r], reserved);
+    }
+    GROW_ARRAY(batch->mask, reserved/64);
+    GROW_ARRAY(batch->holdMask, reserved/64);
+    GROW_ARRAY(batch->staleMask, reserved/64);
+
+    // New words start with no leaf holding
+    memset(batch->mask + batch->reserved/64, 0, (reserved - batch->reserved)/64*sizeof(uint64_t));
+
+    batch->reserved = reserved;
+
+    return false;
+}
+
+// Largest float that is not greater than d
+float floatBelow (double d) {
+    float f = (float)d;
+    if ((double)f > d) {
+        f = nextafterf(f, -INFINITY);
+    }
+    return f;
+}
+
+// Smallest float that is not less than d
+float floatAbove (double d) {
+    float f = (float)d;
+    if ((double)f < d) {
+        f = nextafterf(f, INFINITY);
+    }
+    return f;
+}
+
+void getConditionBounds (uint16_t operation, uint16_t value, float* low, float* high) {
+    // Invalid operations never hold
+    *low = INFINITY;
+    *high = -INFINITY;
+
+    switch (operation) {
+        case TYPE_RULE_LESS_THEN:
+            *low = -INFINITY;
+            *high = value;
+            break;
+
+        case TYPE_RULE_GREATER_THEN:
+            *low = value;
+            *high = INFINITY;
+            break;
+
+        case TYPE_RULE_EQUAL_TO:
+            *low = nextafterf(value, -INFINITY);
+            *high = nextafterf(value, INFINITY);
+            break;
+
+        case TYPE_RULE_WITHIN_MARGIN:
+            // testRuleCondition compares against these bounds in double precision
+            *low = floatBelow(((float)value)*(0.95));
+            *high = floatAbove(((float)value)*(1.05));
+            break;
+    }
+}
+
+int32_t addAggregateLeaf (LeafBatch* batch, uint32_t leaf, uint8_t operand, float low, float high, uint16_t hysteresis) {
+    LeafAggregate* aggregates = (LeafAggregate*)realloc(batch->aggregates, (batch->nAggregates+1)*sizeof(LeafAggregate));
+    if (!aggregates) {
+        return -1;
+    }
+    batch->aggregates = aggregates;
+
+    LeafAggregate* aggregate = &batch->aggregates[batch->nAggregates++];
+    aggregate->leaf = leaf;
+    aggregate->operand = operand;
+    aggregate->held = false;
+    aggregate->low = low;
+    aggregate->high = high;
+    aggregate->holdLow = (low <= high) ? low - hysteresis : low;
+    aggregate->holdHigh = (low <= high) ? high + hysteresis : high;
+
+    return leaf;
+}
+
+int32_t addWindowLeaf (LeafBatch* batch, uint32_t leaf, Rule* rule) {
+    LeafWindow* windows = (LeafWindow*)realloc(batch->windows, (batch->nWindows+1)*sizeof(LeafWindow));
+    if (!windows) {
+        return -1;
+    }
+    batch->windows = windows;
+
+    LeafWindow* window = &batch->windows[batch->nWindows++];
+    window->leaf = leaf;
+    window->operation = rule->operation;
+    window->value = rule->value;
+    window->count = rule->count;
+    initSensorWindow(&window->window, rule->window, rule->value);
+
+    return leaf;
+}
+
+int32_t addLeafToBatch (LeafBatch* batch, Sensor* sensor, Rule* rule) {
+    if (!batch || !sensor || !rule) {
+        return -1;
+    }
+
+    uint16_t operation = rule->operation,
+        value = rule->value,
+        hysteresis = rule->hysteresis;
+    uint8_t operand = rule->operand;
+    bool windowed = isWindowRuleOperation(operation);
+
+    float low, high;
+    uint16_t rangeLow[LEAF_MAX_RANGES],
+        rangeHigh[LEAF_MAX_RANGES],
+        holdLow[LEAF_MAX_RANGES],
+        holdHigh[LEAF_MAX_RANGES];
+
+    getConditionBounds(operation, value, &low, &high);
+
+    if (windowed || operand != SENSOR_OPERAND_VALUE) {
+        // Tested in physical units by evaluateLeafBatch: empty raw ranges, the kernel never sets it
+        for (uint8_t r = 0; r < LEAF_MAX_RANGES; r++) {
+            rangeLow[r] = holdLow[r] = UINT16_MAX;
+            rangeHigh[r] = holdHigh[r] = 0;
+        }
+    }
+    else {
+        if (invertSensorCalculator(sensor->type, low, high, rangeLow, rangeHigh)) {
+            return -1;
+        }
+
+        // The hold range is the condition widened by the hysteresis on both sides
+        if (hysteresis && low <= high) {
+            if (invertSensorCalculator(sensor->type, low - hysteresis, high + hysteresis, holdLow, holdHigh)) {
+                return -1;
+            }
+        }
+        else {
+            memcpy(holdLow, rangeLow, sizeof(rangeLow));
+            memcpy(holdHigh, rangeHigh, sizeof(rangeHigh));
+        }
+    }
+
+    if (batch->size == batch->reserved && growLeafBatch(batch)) {
+        return -1;
+    }
+
+    uint32_t leaf = batch->size++;
+
+    batch->sensors[leaf] = sensor;
+    batch->raw[leaf] = 0;
+    for (uint8_t r = 0; r < LEAF_MAX_RANGES; r++) {
+        batch->low[r][leaf] = rangeLow[r];
+        batch->high[r][leaf] = rangeHigh[r];
+        batch->holdLow[r][leaf] = holdLow[r];
+        batch->holdHigh[r][leaf] = holdHigh[r];
+    }
+    if (windowed) {
+        if (addWindowLeaf(batch, leaf, rule) < 0) {
+            batch->size--;
+            return -1;
+        }
+    }
+    else if (operand != SENSOR_OPERAND_VALUE) {
+        if (addAggregateLeaf(batch, leaf, operand, low, high, hysteresis) < 0) {
+            batch->size--;
+            return -1;
+        }
+    }
+    else {
+        batch->nHysteresis += (hysteresis != 0);
+    }
+
+    return leaf;
+}
+
+void leafKernelScalar (const uint16_t* raw, uint16_t* const low[], uint16_t* const high[], uint32_t start, uint32_t n, uint64_t* mask) {
+    for (uint32_t i = start; i < n; i++) {
+        bool holds = false;
+        for (uint8_t r = 0; r < LEAF_MAX_RANGES; r++) {
+            holds |= (raw[i] >= low[r][i]) & (raw[i] <= high[r][i]);
+        }
+
+        if (holds) {
+            mask[i >> 6] |= (uint64_t)1 << (i & 63);
+        }
+    }
+}
+
+#ifdef LEAF_KERNEL_X86
+
+// SSE2/AVX2 only compare signed 16 bit integers: flipping the sign bit keeps the unsigned order
+
+__attribute__((target("avx2")))
+void leafKernelAVX2 (const uint16_t* raw, uint16_t* const low[], uint16_t* const high[], uint32_t n, uint64_t* mask) {
+    const __m256i bias = _mm256_set1_epi16((short)0x8000),
+        ones = _mm256_set1_epi16(-1);
+
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(raw+i)), bias);
+        __m256i holds = _mm256_setzero_si256();
+
+        for (uint8_t r = 0; r < LEAF_MAX_RANGES; r++) {
+            __m256i lo = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(low[r]+i)), bias);
+            __m256i hi = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(high[r]+i)), bias);
+            __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi16(lo, x), _mm256_cmpgt_epi16(x, hi));
+            holds = _mm256_or_si256(holds, _mm256_andnot_si256(outside, ones));
+        }
+
+        __m128i packed = _mm_packs_epi16(_mm256_castsi256_si128(holds), _mm256_extracti128_si256(holds, 1));
+        mask[i >> 6] |= (uint64_t)(_mm_movemask_epi8(packed) & 0xFFFF) << (i & 63);
+    }
+
+    leafKernelScalar(raw, low, high, i, n, mask);
+}
+
+void leafKernelSSE2 (const uint16_t* raw, uint16_t* const low[], uint16_t* const high[], uint32_t n, uint64_t* mask) {
+    const __m128i bias = _mm_set1_epi16((short)0x8000),
+        ones = _mm_set1_epi16(-1);
+
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(raw+i)), bias);
+        __m128i holds = _mm_setzero_si128();
+
+        for (uint8_t r = 0; r < LEAF_MAX_RANGES; r++) {
+            __m128i lo = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(low[r]+i)), bias);
+            __m128i hi = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(high[r]+i)), bias);
+            __m128i outside = _mm_or_si128(_mm_cmpgt_epi16(lo, x), _mm_cmpgt_epi16(x, hi));
+            holds = _mm_or_si128(holds, _mm_andnot_si128(outside, ones));
+        }
+
+        __m128i packed = _mm_packs_epi16(holds, _mm_setzero_si128());
+        mask[i >> 6] |= (uint64_t)(_mm_movemask_epi8(packed) & 0xFF) << (i & 63);
+    }
+
+    leafKernelScalar(raw, low, high, i, n, mask);
+}
+
+#endif
+
+void leafKernel (const uint16_t* raw, uint16_t* const low[], uint16_t* const high[], uint32_t n, uint64_t* mask) {
+    memset(mask, 0, ((n + 63) / 64) * sizeof(uint64_t));
+
+#ifdef LEAF_KERNEL_X86
+    if (__builtin_cpu_supports("avx2")) {
+        leafKernelAVX2(raw, low, high, n, mask);
+    }
+    else {
+        leafKernelSSE2(raw, low, high, n, mask);
+    }
+#else
+    leafKernelScalar(raw, low, high, 0, n, mask);
+#endif
+}
+
+bool evaluateAggregateLeaves (LeafBatch* batch) {
+    for (uint32_t i = 0; i < batch->nAggregates; i++) {
+        LeafAggregate* aggregate = &batch->aggregates[i];
+        Sensor* sensor = batch->sensors[aggregate->leaf];
+
+        if (sensor->stale) {
+            aggregate->held = false;
+            continue;
+        }
+
+        float value = getSensorOperandValue(sensor, aggregate->operand);
+
+        bool holds = (value > aggregate->low && value < aggregate->high) ||
+            (aggregate->held && value > aggregate->holdLow && value < aggregate->holdHigh);
+        aggregate->held = holds;
+
+        if (holds) {
+            batch->mask[aggregate->leaf >> 6] |= (uint64_t)1 << (aggregate->leaf & 63);
+        }
+    }
+
+    return false;
+}
+
+bool evaluateWindowLeaves (LeafBatch* batch, uint64_t now) {
+    for (uint32_t i = 0; i < batch->nWindows; i++) {
+        LeafWindow* leafWindow = &batch->windows[i];
+        SensorWindow* window = &leafWindow->window;
+
+        Sensor* sensor = batch->sensors[leafWindow->leaf];
+
+        // The window keeps following the history while stale, it just never holds
+        if (updateSensorWindow(sensor, window, now) || sensor->stale) {
+            // No history, never holds
+            continue;
+        }
+
+        uint32_t count = getSensorWindowCount(window);
+        bool holds = false;
+        switch (leafWindow->operation) {
+            case TYPE_RULE_RATE_OF_CHANGE:
+                holds = (count > 1) && fabsf(window->change) > leafWindow->value;
+                break;
+
+            case TYPE_RULE_MOVING_AVERAGE:
+                holds = count && (window->sum / count) > leafWindow->value;
+                break;
+
+            case TYPE_RULE_SUSTAINED_ABOVE:
+                holds = window->streak && (now - window->streakStart) >= window->duration;
+                break;
+
+            case TYPE_RULE_COUNT_ABOVE:
+                holds = window->above >= leafWindow->count;
+                break;
+        }
+
+        if (holds) {
+            batch->mask[leafWindow->leaf >> 6] |= (uint64_t)1 << (leafWindow->leaf & 63);
+        }
+    }
+
+    return false;
+}
+
+bool evaluateLeafBatch (LeafBatch* batch, uint64_t now) {
+    if (!batch) {
+        return true;
+    }
+
+    if (!batch->size) {
+        return false;
+    }
+
+    // Gather the raw values so the kernel runs over contiguous memory
+    uint32_t nWords = (batch->size + 63) / 64;
+    bool anyStale = false;
+    memset(batch->staleMask, 0, nWords*sizeof(uint64_t));
+    for (uint32_t i = 0; i < batch->size; i++) {
+        Sensor* sensor = batch->sensors[i];
+        batch->raw[i] = getSensorRawValue(sensor);
+        if (sensor->stale) {
+            batch->staleMask[i >> 6] |= (uint64_t)1 << (i & 63);
+            anyStale = true;
+        }
+    }
+
+    if (!batch->nHysteresis) {
+        leafKernel(batch->raw, batch->low, batch->high, batch->size, batch->mask);
+    } else {
+        // The hold range contains the enter range, so a leaf holds if it enters,
+        // or if it held before and is still inside its hold range
+        leafKernel(batch->raw, batch->holdLow, batch->holdHigh, batch->size, batch->holdMask);
+        for (uint32_t w = 0; w < nWords; w++) {
+            batch->holdMask[w] &= batch->mask[w];
+        }
+
+        leafKernel(batch->raw, batch->low, batch->high, batch->size, batch->mask);
+        for (uint32_t w = 0; w < nWords; w++) {
+            batch->mask[w] |= batch->holdMask[w];
+        }
+    }
+
+    // Stale readings never hold, so a leaf coming back from stale has to enter again
+    if (anyStale) {
+        for (uint32_t w = 0; w < nWords; w++) {
+            batch->mask[w] &= ~batch->staleMask[w];
+        }
+    }
+
+    return evaluateAggregateLeaves(batch) || evaluateWindowLeaves(batch, now);
+}
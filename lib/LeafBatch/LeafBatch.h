@@ -0,0 +1,143 @@
+#ifndef __LEAF_BATCH__
+#define __LEAF_BATCH__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct _leaf_batch LeafBatch;
+typedef struct _leaf_aggregate LeafAggregate;
+typedef struct _leaf_window LeafWindow;
+
+#include "Sensor.h"
+#include "SensorHistory.h"
+#include "Rule.h"
+
+#define LEAF_MAX_RANGES SENSOR_MAX_SEGMENTS
+
+
+/**
+ * @brief Leaf comparing an aggregate of the sensor history.
+ * Holds while the aggregate is in (low, high), or in (holdLow, holdHigh) if it held before.
+ *
+ */
+struct _leaf_aggregate {
+    uint32_t leaf;
+    uint8_t operand;
+    bool held;
+    float low;
+    float high;
+    float holdLow;
+    float holdHigh;
+};
+
+/**
+ * @brief Leaf with a windowed operation, kept up to date incrementally from the sensor history
+ *
+ */
+struct _leaf_window {
+    uint32_t leaf;
+    uint16_t operation;
+    uint16_t value;
+    uint16_t count;
+    SensorWindow window;
+};
+
+/**
+ * @brief Leaf conditions (sensor compared against a rule value) stored as
+ * structure of arrays so they can be evaluated many at a time.
+ *
+ * The rule value is turned into ranges of raw sensor values once, by
+ * inverting the sensor calculator, so evaluating a leaf is a couple of
+ * integer compares on the raw value with no conversion to physical units.
+ *
+ * Leaves with hysteresis also keep a wider hold range: a leaf that held on
+ * the previous evaluation keeps holding while inside it.
+ *
+ * Leaves whose sensor is stale never hold.
+ *
+ * Leaves comparing an aggregate of the sensor history, and leaves with a
+ * windowed operation, have no raw value to test: their raw ranges are empty
+ * and they are tested in physical units after the kernel runs.
+ *
+ */
+struct _leaf_batch {
+    uint32_t size;
+    uint32_t reserved;
+    uint32_t nHysteresis;
+    Sensor** sensors;
+    uint16_t* raw;
+    uint16_t* low[LEAF_MAX_RANGES];
+    uint16_t* high[LEAF_MAX_RANGES];
+    uint16_t* holdLow[LEAF_MAX_RANGES];
+    uint16_t* holdHigh[LEAF_MAX_RANGES];
+    uint64_t* mask;
+    uint64_t* holdMask;
+    uint64_t* staleMask;
+    uint32_t nAggregates;
+    LeafAggregate* aggregates;
+    uint32_t nWindows;
+    LeafWindow* windows;
+};
+
+/**
+ * @brief Create a LeafBatch object
+ *
+ * @return LeafBatch* Pointer to the new LeafBatch object. NULL if error.
+ */
+LeafBatch* createLeafBatch ();
+
+/**
+ * @brief Delete a LeafBatch object
+ *
+ * @param batch Pointer to the LeafBatch object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteLeafBatch (LeafBatch* batch);
+
+/**
+ * @brief Adds the condition of a rule on one of its sensors to the batch,
+ * converting the rule value to raw sensor units when possible
+ *
+ * @param batch Pointer to the LeafBatch object
+ * @param sensor Sensor to be tested
+ * @param rule Rule holding the operation, value, hysteresis, operand and window of the condition
+ * @return int32_t Index of the new leaf. -1 if error.
+ */
+int32_t addLeafToBatch (LeafBatch* batch, Sensor* sensor, Rule* rule);
+
+/**
+ * @brief Get the open interval (low, high) of physical values that verify a rule condition.
+ * The bounds are picked so float compares give exactly the same answer as testRuleCondition.
+ *
+ * @param operation Rule operation
+ * @param value Rule value
+ * @param low Pointer to the lower bound to fill
+ * @param high Pointer to the upper bound to fill
+ */
+void getConditionBounds (uint16_t operation, uint16_t value, float* low, float* high);
+
+/**
+ * @brief Loads the current raw value of every leaf sensor and evaluates all leaves,
+ * filling the batch bitmask. Leaves that held on the previous call are tested
+ * against their hold range.
+ *
+ * @param batch Pointer to the LeafBatch object
+ * @param now Current monotonic time, in milliseconds
+ * @return true Error
+ * @return false All good
+ */
+bool evaluateLeafBatch (LeafBatch* batch, uint64_t now);
+
+/**
+ * @brief Evaluates n leaf conditions from raw values, writing one bit per leaf in mask.
+ * A leaf holds if the raw value is inside any of its inclusive ranges.
+ * Uses AVX2 or SSE2 when available, falling back to scalar code.
+ *
+ */
+void leafKernel (const uint16_t* raw, uint16_t* const low[], uint16_t* const high[], uint32_t n, uint64_t* mask);
+
+#define isLeafSatisfied(batch, leaf) (((batch)->mask[(leaf) >> 6] >> ((leaf) & 63)) & 1)
+
+#endif
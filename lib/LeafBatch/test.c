@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "LeafBatch.h"
+#include "Datastore.h"
+#include "Room.h"
+#include "Node.h"
+#include "Sensor.h"
+#include "Rule.h"
+
+// Raw thresholds must give the same result as converting the raw value and comparing in physical units.
+// Every rule is checked at the raw values around the points where its outcome flips, and at the ends of the
+// ranges found by invertSensorCalculator, both through the ranges themselves and through leafKernel.
+
+#define SENSOR_TYPES    5
+
+typedef struct {
+    Sensor* sensor;
+    Rule* rule;
+    uint16_t raw;
+} LeafCase;
+
+static sensorValueCalculator* const calculators[SENSOR_TYPES] = {
+    TYPE_SENSOR_VOLTAGE_VALUE_CALCULATOR,
+    TYPE_SENSOR_TEMPERATURE_VALUE_CALCULATOR,
+    TYPE_SENSOR_HUMIDITY_VALUE_CALCULATOR,
+    TYPE_SENSOR_LIGHT_VALUE_CALCULATOR,
+    TYPE_SENSOR_CURRENT_VALUE_CALCULATOR,
+};
+
+static const uint16_t operations[] = {
+    TYPE_RULE_LESS_THEN,
+    TYPE_RULE_GREATER_THEN,
+    TYPE_RULE_EQUAL_TO,
+    TYPE_RULE_WITHIN_MARGIN,
+};
+
+static const uint16_t values[] = {0, 1, 2, 5, 10, 20, 25, 30, 50, 100, 500, 1000, 3000, 10000, UINT16_MAX};
+
+static LeafCase* cases = NULL;
+static uint32_t nCases = 0;
+static uint32_t nFailures = 0;
+
+bool expectedOutcome (Sensor* sensor, Rule* rule, uint16_t raw) {
+    return testRuleCondition(rule->operation, calculators[sensor->type](raw), rule->value);
+}
+
+bool addCase (Sensor* sensor, Rule* rule, int32_t raw) {
+    if (raw < 0 || raw > UINT16_MAX) {
+        return false;
+    }
+
+    LeafCase* grown = (LeafCase*)realloc(cases, (nCases+1)*sizeof(LeafCase));
+    if (!grown) {
+        return true;
+    }
+    cases = grown;
+    cases[nCases++] = (LeafCase){sensor, rule, raw};
+
+    return false;
+}
+
+// Adds the raw values around every flip of the rule outcome and around the ends of the inverted ranges
+bool addBoundaryCases (Sensor* sensor, Rule* rule) {
+    bool error = addCase(sensor, rule, 0) || addCase(sensor, rule, UINT16_MAX);
+
+    bool previous = expectedOutcome(sensor, rule, 0);
+    for (int32_t raw = 1; raw <= UINT16_MAX && !error; raw++) {
+        bool outcome = expectedOutcome(sensor, rule, raw);
+        if (outcome != previous) {
+            error = addCase(sensor, rule, raw - 2) || addCase(sensor, rule, raw - 1) ||
+                addCase(sensor, rule, raw) || addCase(sensor, rule, raw + 1);
+        }
+        previous = outcome;
+    }
+
+    float low, high;
+    uint16_t rangeLow[SENSOR_MAX_SEGMENTS], rangeHigh[SENSOR_MAX_SEGMENTS];
+    getConditionBounds(rule->operation, rule->value, &low, &high);
+    if (invertSensorCalculator(sensor->type, low, high, rangeLow, rangeHigh)) {
+        return true;
+    }
+
+    for (uint8_t r = 0; r < SENSOR_MAX_SEGMENTS && !error; r++) {
+        if (rangeLow[r] > rangeHigh[r]) {
+            continue;
+        }
+        error = addCase(sensor, rule, (int32_t)rangeLow[r] - 1) || addCase(sensor, rule, rangeLow[r]) ||
+            addCase(sensor, rule, rangeHigh[r]) || addCase(sensor, rule, (int32_t)rangeHigh[r] + 1);
+    }
+
+    return error;
+}
+
+void reportFailure (const char* check, LeafCase* leafCase, bool got) {
+    nFailures++;
+    fprintf(stderr, "%s: sensor type %u, operation %u, value %u, raw %u (%f): got %d, expected %d\n",
+        check, leafCase->sensor->type, leafCase->rule->operation, leafCase->rule->value, leafCase->raw,
+        calculators[leafCase->sensor->type](leafCase->raw), got, !got);
+}
+
+// The raw value must be in one of the ranges exactly when the condition holds
+void checkInvertedRanges (LeafCase* leafCase) {
+    float low, high;
+    uint16_t rangeLow[SENSOR_MAX_SEGMENTS], rangeHigh[SENSOR_MAX_SEGMENTS];
+    getConditionBounds(leafCase->rule->operation, leafCase->rule->value, &low, &high);
+    invertSensorCalculator(leafCase->sensor->type, low, high, rangeLow, rangeHigh);
+
+    bool holds = false;
+    for (uint8_t r = 0; r < SENSOR_MAX_SEGMENTS; r++) {
+        holds |= leafCase->raw >= rangeLow[r] && leafCase->raw <= rangeHigh[r];
+    }
+
+    if (holds != expectedOutcome(leafCase->sensor, leafCase->rule, leafCase->raw)) {
+        reportFailure("invertSensorCalculator", leafCase, holds);
+    }
+}
+
+int main () {
+    Datastore* datastore = createDatastore();
+    Room* room = createRoom(datastore, 1);
+    Node* node = createNode(room, 1);
+    LeafBatch* batch = createLeafBatch();
+    if (!datastore || !room || !node || !batch) {
+        fprintf(stderr, "Error creating the datastore\n");
+        return 1;
+    }
+
+    uint16_t ruleID = 1;
+    for (uint8_t type = 0; type < SENSOR_TYPES; type++) {
+        Position pos = {type, 0};
+        Sensor* sensor = createSensor(node, type + 1, type, &pos, 0, UINT16_MAX);
+        if (!sensor) {
+            fprintf(stderr, "Error creating a sensor of type %u\n", type);
+            return 1;
+        }
+
+        for (uint8_t o = 0; o < sizeof(operations)/sizeof(operations[0]); o++) {
+            for (uint8_t v = 0; v < sizeof(values)/sizeof(values[0]); v++) {
+                Rule* rule = createRule(datastore, NULL, ruleID++, operations[o], values[v]);
+                if (!rule || addBoundaryCases(sensor, rule)) {
+                    fprintf(stderr, "Error creating the cases of sensor type %u\n", type);
+                    return 1;
+                }
+            }
+        }
+    }
+
+    // One leaf per case, all of them evaluated by a single kernel call
+    for (uint32_t i = 0; i < nCases; i++) {
+        if (addLeafToBatch(batch, cases[i].sensor, cases[i].rule) != (int32_t)i) {
+            fprintf(stderr, "Error adding a leaf to the batch\n");
+            return 1;
+        }
+        batch->raw[i] = cases[i].raw;
+    }
+    leafKernel(batch->raw, batch->low, batch->high, batch->size, batch->mask);
+
+    for (uint32_t i = 0; i < nCases; i++) {
+        checkInvertedRanges(&cases[i]);
+
+        bool holds = isLeafSatisfied(batch, i);
+        if (holds != expectedOutcome(cases[i].sensor, cases[i].rule, cases[i].raw)) {
+            reportFailure("leafKernel", &cases[i], holds);
+        }
+    }
+
+    printf("LeafBatch: %u boundary cases, %u failures\n", nCases, nFailures);
+
+    deleteLeafBatch(batch);
+    deleteDatastore(datastore);
+    free(cases);
+
+    return nFailures != 0;
+}
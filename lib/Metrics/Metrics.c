@@ -0,0 +1,412 @@
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "Metrics.h"
+
+#define METRICS_SUB_BUCKET_BITS     2   // log2 of METRICS_SUB_BUCKETS
+#define METRICS_REQUEST_TIMEOUT     100 // Time, in ms, a client gets to send its request
+#define METRICS_ACCEPT_TIMEOUT      200 // Time, in ms, between checks for the server being stopped
+
+typedef struct {
+    const char* name;
+    const char* help;
+} MetricInfo;
+
+// Everything a thread counts, on cache lines no other thread writes to
+typedef struct {
+    uint64_t counters[METRICS_COUNTERS];
+    uint64_t sums[METRICS_HISTOGRAMS];
+    uint64_t buckets[METRICS_HISTOGRAMS][METRICS_HISTOGRAM_BUCKETS];
+} __attribute__((aligned(64))) MetricsShard;
+
+static const MetricInfo counterInfo[METRICS_COUNTERS] = {
+    {"gas_packets_total", "Packets read from the input stream."},
+    {"gas_packet_errors_total", "Packets with fields that are not hex numbers."},
+    {"gas_packets_unknown_node_total", "Packets from nodes missing in the configuration."},
+    {"gas_rule_passes_total", "Passes over the rules, each one followed by a frame."},
+    {"gas_db_queries_total", "Queries run on the database."},
+    {"gas_db_errors_total", "Queries that failed or could not be sent."},
+    {"gas_frames_total", "Frames written, all outputs together."},
+    {"gas_config_reloads_total", "Configuration reloads."},
+    {"gas_config_reload_errors_total", "Configuration reloads that kept the running configuration because of errors."},
+};
+
+static const MetricInfo gaugeInfo[METRICS_GAUGES] = {
+    {"gas_output_sinks", "Outputs still being written."},
+    {"gas_stale_sensors", "Sensors that stopped reporting."},
+};
+
+static const MetricInfo histogramInfo[METRICS_HISTOGRAMS] = {
+    {"gas_rule_pass_seconds", "Time taken by a pass over the rules, drawing and publishing its frame."},
+    {"gas_db_query_seconds", "Time taken by a database query."},
+    {"gas_frame_write_seconds", "Time taken to encode and write a frame to an output."},
+    {"gas_config_reload_seconds", "Time taken by a configuration reload."},
+    {"gas_sample_ingest_seconds", "Time from a sample being received to its value being stored."},
+    {"gas_sample_rules_seconds", "Time from a sample being received to the end of the rule pass evaluating it."},
+    {"gas_sample_pixel_seconds", "Time from a sample being received to the pixel of its sensor being updated."},
+    {"gas_sample_frame_seconds", "Time from a sample being received to the frame showing it being handed to the outputs."},
+    {"gas_sample_db_seconds", "Time from a sample being received to its row being inserted in sinf.sensor_state."},
+};
+
+// Quantiles exported for every histogram
+static const double metricQuantiles[] = {0.5, 0.99, 0.999};
+#define METRICS_QUANTILES (sizeof(metricQuantiles)/sizeof(metricQuantiles[0]))
+
+static MetricsShard metricsShards[METRICS_SHARDS];
+static int64_t metricsGauges[METRICS_GAUGES];
+static uint32_t metricsNextShard = 0;
+static __thread MetricsShard* metricsShard = NULL;
+
+// Shard of the calling thread, handed out on first use
+MetricsShard* getMetricsShard () {
+    if (!metricsShard) {
+        uint32_t shard = __atomic_fetch_add(&metricsNextShard, 1, __ATOMIC_RELAXED);
+        metricsShard = &metricsShards[shard % METRICS_SHARDS];
+    }
+
+    return metricsShard;
+}
+
+// Values below METRICS_SUB_BUCKETS get a bucket each, then every power of two is split in METRICS_SUB_BUCKETS
+uint32_t getMetricBucket (uint64_t time) {
+    if (time < METRICS_SUB_BUCKETS) {
+        return (uint32_t)time;
+    }
+
+    uint32_t exponent = 63 - __builtin_clzll(time);
+    uint32_t sub = (time >> (exponent - METRICS_SUB_BUCKET_BITS)) & (METRICS_SUB_BUCKETS - 1);
+
+    return (exponent - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKETS + sub;
+}
+
+void addMetricCount (uint8_t counter, uint64_t n) {
+    if (counter >= METRICS_COUNTERS) {
+        return;
+    }
+
+    // Atomic only for the threads beyond METRICS_SHARDS sharing a shard, uncontended otherwise
+    __atomic_add_fetch(&getMetricsShard()->counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void setMetricGauge (uint8_t gauge, int64_t value) {
+    if (gauge >= METRICS_GAUGES) {
+        return;
+    }
+
+    __atomic_store_n(&metricsGauges[gauge], value, __ATOMIC_RELAXED);
+}
+
+void addMetricGauge (uint8_t gauge, int64_t delta) {
+    if (gauge >= METRICS_GAUGES) {
+        return;
+    }
+
+    __atomic_add_fetch(&metricsGauges[gauge], delta, __ATOMIC_RELAXED);
+}
+
+void recordMetricTime (uint8_t histogram, uint64_t time) {
+    if (histogram >= METRICS_HISTOGRAMS) {
+        return;
+    }
+
+    MetricsShard* shard = getMetricsShard();
+    __atomic_add_fetch(&shard->buckets[histogram][getMetricBucket(time)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shard->sums[histogram], time, __ATOMIC_RELAXED);
+}
+
+// First value past a bucket
+uint64_t getMetricBucketEnd (uint32_t bucket) {
+    if (bucket < METRICS_SUB_BUCKETS) {
+        return bucket + 1;
+    }
+
+    uint32_t exponent = bucket / METRICS_SUB_BUCKETS + METRICS_SUB_BUCKET_BITS - 1;
+    uint64_t sub = bucket % METRICS_SUB_BUCKETS;
+    if (bucket == METRICS_HISTOGRAM_BUCKETS - 1) {
+        return UINT64_MAX;
+    }
+
+    return (METRICS_SUB_BUCKETS + sub + 1) << (exponent - METRICS_SUB_BUCKET_BITS);
+}
+
+// Sums the buckets of a histogram over all shards, returning the number of records
+uint64_t aggregateHistogram (uint8_t histogram, uint64_t* buckets, uint64_t* sum) {
+    uint64_t count = 0;
+    memset(buckets, 0, METRICS_HISTOGRAM_BUCKETS*sizeof(uint64_t));
+    *sum = 0;
+    for (uint32_t shard = 0; shard < METRICS_SHARDS; shard++) {
+        for (uint32_t b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++) {
+            uint64_t n = __atomic_load_n(&metricsShards[shard].buckets[histogram][b], __ATOMIC_RELAXED);
+            buckets[b] += n;
+            count += n;
+        }
+        *sum += __atomic_load_n(&metricsShards[shard].sums[histogram], __ATOMIC_RELAXED);
+    }
+
+    return count;
+}
+
+// Upper bound of the bucket where the quantile falls
+uint64_t findQuantile (const uint64_t* buckets, uint64_t count, double quantile) {
+    if (!count) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(quantile * count);
+    if (rank >= count) {
+        rank = count - 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > rank) {
+            return getMetricBucketEnd(b);
+        }
+    }
+
+    return UINT64_MAX;
+}
+
+uint64_t getMetricQuantile (uint8_t histogram, double quantile) {
+    if (histogram >= METRICS_HISTOGRAMS) {
+        return 0;
+    }
+
+    uint64_t buckets[METRICS_HISTOGRAM_BUCKETS], sum;
+    uint64_t count = aggregateHistogram(histogram, buckets, &sum);
+
+    return findQuantile(buckets, count, quantile);
+}
+
+bool writeLatencyReport (FILE* stream) {
+    if (!stream) {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < METRICS_HISTOGRAMS; i++) {
+        uint64_t buckets[METRICS_HISTOGRAM_BUCKETS], sum;
+        uint64_t count = aggregateHistogram(i, buckets, &sum);
+        if (!count) {
+            continue;
+        }
+
+        fprintf(stream, "%-28s %10llu records, p50 %9.3f ms, p99 %9.3f ms, p999 %9.3f ms\n",
+            histogramInfo[i].name, (unsigned long long)count,
+            findQuantile(buckets, count, 0.5) / 1e6,
+            findQuantile(buckets, count, 0.99) / 1e6,
+            findQuantile(buckets, count, 0.999) / 1e6);
+    }
+
+    return ferror(stream) != 0;
+}
+
+uint64_t getMetricCount (uint8_t counter) {
+    if (counter >= METRICS_COUNTERS) {
+        return 0;
+    }
+
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < METRICS_SHARDS; i++) {
+        count += __atomic_load_n(&metricsShards[i].counters[counter], __ATOMIC_RELAXED);
+    }
+
+    return count;
+}
+
+bool writeMetrics (FILE* stream) {
+    if (!stream) {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < METRICS_COUNTERS; i++) {
+        fprintf(stream, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+            counterInfo[i].name, counterInfo[i].help, counterInfo[i].name,
+            counterInfo[i].name, (unsigned long long)getMetricCount(i));
+    }
+
+    for (uint8_t i = 0; i < METRICS_GAUGES; i++) {
+        fprintf(stream, "# HELP %s %s\n# TYPE %s gauge\n%s %lld\n",
+            gaugeInfo[i].name, gaugeInfo[i].help, gaugeInfo[i].name,
+            gaugeInfo[i].name, (long long)__atomic_load_n(&metricsGauges[i], __ATOMIC_RELAXED));
+    }
+
+    for (uint8_t i = 0; i < METRICS_HISTOGRAMS; i++) {
+        const char* name = histogramInfo[i].name;
+        fprintf(stream, "# HELP %s %s\n# TYPE %s histogram\n", name, histogramInfo[i].help, name);
+
+        // Aggregate the shards, the count being the sum of the buckets keeps +Inf consistent with them
+        uint64_t buckets[METRICS_HISTOGRAM_BUCKETS], sum;
+        aggregateHistogram(i, buckets, &sum);
+
+        // Powers of two are bucket boundaries: every bucket below 2^exponent starts before getMetricBucket(2^exponent)
+        uint64_t count = 0;
+        uint32_t b = 0;
+        for (uint32_t exponent = METRICS_EXPORT_MIN_EXPONENT; exponent <= METRICS_EXPORT_MAX_EXPONENT; exponent++) {
+            for (; b < getMetricBucket((uint64_t)1 << exponent); b++) {
+                count += buckets[b];
+            }
+            fprintf(stream, "%s_bucket{le=\"%.12g\"} %llu\n", name, (double)((uint64_t)1 << exponent) / 1e9, (unsigned long long)count);
+        }
+        for (; b < METRICS_HISTOGRAM_BUCKETS; b++) {
+            count += buckets[b];
+        }
+        fprintf(stream, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9f\n%s_count %llu\n",
+            name, (unsigned long long)count, name, (double)sum / 1e9, name, (unsigned long long)count);
+    }
+
+    // Quantiles computed from the full resolution buckets, for dashboards without histogram_quantile
+    fprintf(stream, "# HELP gas_latency_quantile_seconds Quantiles of the histograms, upper bounds of their buckets.\n"
+        "# TYPE gas_latency_quantile_seconds gauge\n");
+    for (uint8_t i = 0; i < METRICS_HISTOGRAMS; i++) {
+        uint64_t buckets[METRICS_HISTOGRAM_BUCKETS], sum;
+        uint64_t count = aggregateHistogram(i, buckets, &sum);
+        for (uint8_t q = 0; q < METRICS_QUANTILES; q++) {
+            fprintf(stream, "gas_latency_quantile_seconds{histogram=\"%s\",quantile=\"%g\"} %.9g\n",
+                histogramInfo[i].name, metricQuantiles[q], findQuantile(buckets, count, metricQuantiles[q]) / 1e9);
+        }
+    }
+
+    return ferror(stream) != 0;
+}
+
+// Writes all of a buffer to a socket, never raising SIGPIPE
+bool sendAll (int fd, const char* buffer, size_t length) {
+    while (length) {
+        ssize_t sent = send(fd, buffer, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            return true;
+        }
+        buffer += sent;
+        length -= sent;
+    }
+
+    return false;
+}
+
+void serveMetrics (int client) {
+    // Clients that send nothing, like nc, just get the text
+    char request[512];
+    ssize_t length = 0;
+    struct pollfd pending = {client, POLLIN, 0};
+    if (poll(&pending, 1, METRICS_REQUEST_TIMEOUT) > 0) {
+        length = recv(client, request, sizeof(request) - 1, 0);
+    }
+    bool http = length >= 4 && !strncmp(request, "GET ", 4);
+
+    char* body = NULL;
+    size_t bodyLength = 0;
+    FILE* stream = open_memstream(&body, &bodyLength);
+    if (!stream) {
+        return;
+    }
+    bool error = writeMetrics(stream);
+    error |= fclose(stream) != 0;
+
+    if (!error) {
+        if (http) {
+            char header[160];
+            int headerLength = snprintf(header, sizeof(header),
+                "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n", bodyLength);
+            error = sendAll(client, header, headerLength);
+        }
+        if (!error) {
+            sendAll(client, body, bodyLength);
+        }
+    }
+
+    free(body);
+}
+
+void* thread_metricsServer (void* arg) {
+    MetricsServer* server = arg;
+
+    while (__atomic_load_n(&server->active, __ATOMIC_ACQUIRE)) {
+        struct pollfd listening = {server->fd, POLLIN, 0};
+        if (poll(&listening, 1, METRICS_ACCEPT_TIMEOUT) <= 0) {
+            continue;
+        }
+
+        int client = accept(server->fd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+
+        serveMetrics(client);
+        close(client);
+    }
+
+    return NULL;
+}
+
+MetricsServer* createMetricsServer (const char* path) {
+    struct sockaddr_un address;
+    if (!path || strlen(path) >= sizeof(address.sun_path)) {
+        return NULL;
+    }
+
+    MetricsServer* server = (MetricsServer*)malloc(sizeof(MetricsServer));
+    if (!server) {
+        return NULL;
+    }
+
+    server->path = (char*)malloc(strlen(path)+1);
+    if (!server->path) {
+        free(server);
+        return NULL;
+    }
+    strcpy(server->path, path);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    server->active = true;
+    server->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    // Remove the socket left by a previous run, but nothing else that happens to be at the path
+    bool blocked = false;
+    struct stat info;
+    if (server->fd >= 0 && lstat(path, &info)) {
+        blocked = errno != ENOENT;
+    }
+    else if (server->fd >= 0) {
+        blocked = !S_ISSOCK(info.st_mode) || unlink(path);
+    }
+
+    if (server->fd < 0 || blocked ||
+        bind(server->fd, (struct sockaddr*)&address, sizeof(address)) ||
+        listen(server->fd, 8) ||
+        pthread_create(&server->thread, NULL, &thread_metricsServer, server)) {
+
+        if (server->fd >= 0) {
+            close(server->fd);
+        }
+        free(server->path);
+        free(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+bool deleteMetricsServer (MetricsServer* server) {
+    if (!server) {
+        return true;
+    }
+
+    __atomic_store_n(&server->active, false, __ATOMIC_RELEASE);
+    pthread_join(server->thread, NULL);
+
+    close(server->fd);
+    unlink(server->path);
+    free(server->path);
+    free(server);
+
+    return false;
+}
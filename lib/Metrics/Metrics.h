@@ -0,0 +1,152 @@
+#ifndef __METRICS__
+#define __METRICS__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct _metrics_server MetricsServer;
+
+// Counters, only ever going up
+#define METRIC_PACKETS                  0   // Packets read from the input stream
+#define METRIC_PACKET_ERRORS            1   // Packets with fields that are not hex numbers
+#define METRIC_PACKETS_UNKNOWN          2   // Packets from a node missing in the configuration
+#define METRIC_RULE_PASSES              3
+#define METRIC_DB_QUERIES               4
+#define METRIC_DB_ERRORS                5
+#define METRIC_FRAMES                   6   // Frames written, all outputs together
+#define METRIC_CONFIG_RELOADS           7
+#define METRIC_CONFIG_RELOAD_ERRORS     8
+#define METRICS_COUNTERS                9
+
+// Gauges, set to the current value of something
+#define METRIC_OUTPUT_SINKS             0   // Outputs still being written
+#define METRIC_STALE_SENSORS            1
+#define METRICS_GAUGES                  2
+
+// Histograms of durations, in nanoseconds
+#define METRIC_RULE_PASS_TIME           0
+#define METRIC_DB_QUERY_TIME            1
+#define METRIC_FRAME_WRITE_TIME         2
+#define METRIC_CONFIG_RELOAD_TIME       3
+#define METRIC_SAMPLE_INGEST_TIME       4   // From a sample being received to its value being stored in the sensor
+#define METRIC_SAMPLE_RULES_TIME        5   // ... to the end of the rule pass evaluating it, actuator pixels included
+#define METRIC_SAMPLE_PIXEL_TIME        6   // ... to the pixel of its sensor being updated
+#define METRIC_SAMPLE_FRAME_TIME        7   // ... to the frame showing it being handed to the outputs
+#define METRIC_SAMPLE_DB_TIME           8   // ... to its row being inserted in sinf.sensor_state
+#define METRICS_HISTOGRAMS              9
+
+#define METRICS_SHARDS                  16  // Threads beyond this share shards
+#define METRICS_SUB_BUCKETS             4   // Buckets per power of two, for a precision of 25%
+#define METRICS_HISTOGRAM_BUCKETS       252 // Enough for any 64 bit duration
+#define METRICS_EXPORT_MIN_EXPONENT     10  // Histograms are exported with le from 2^10 ns, about 1 us,
+#define METRICS_EXPORT_MAX_EXPONENT     35  // up to 2^35 ns, about 34 s
+
+
+/**
+ * @brief Unix domain socket serving the metrics in the Prometheus text format.
+ * Every connection gets the current values and is closed. Requests starting with
+ * GET are answered as HTTP, so the socket can be scraped through a proxy or curl
+ * --unix-socket, anything else just gets the text.
+ *
+ */
+struct _metrics_server {
+    char* path;
+    int fd;
+    pthread_t thread;
+    bool active;
+};
+
+/**
+ * @brief Adds to a counter. Each thread counts in a shard of its own, so this never
+ * contends with other threads, and shards are only summed when the metrics are read.
+ *
+ * @param counter One of the counter METRIC_*
+ * @param n Amount to add
+ */
+void addMetricCount (uint8_t counter, uint64_t n);
+
+/**
+ * @brief Sets a gauge
+ *
+ * @param gauge One of the gauge METRIC_*
+ * @param value New value
+ */
+void setMetricGauge (uint8_t gauge, int64_t value);
+
+/**
+ * @brief Adds to a gauge
+ *
+ * @param gauge One of the gauge METRIC_*
+ * @param delta Amount to add, negative to subtract
+ */
+void addMetricGauge (uint8_t gauge, int64_t delta);
+
+/**
+ * @brief Records a duration in a histogram. Durations are counted in log-linear buckets,
+ * METRICS_SUB_BUCKETS per power of two, in the shard of the calling thread.
+ *
+ * @param histogram One of the histogram METRIC_*
+ * @param time Duration in nanoseconds
+ */
+void recordMetricTime (uint8_t histogram, uint64_t time);
+
+/**
+ * @brief Get the value of a counter, summed over all threads
+ *
+ * @param counter One of the counter METRIC_*
+ * @return uint64_t Value of the counter
+ */
+uint64_t getMetricCount (uint8_t counter);
+
+/**
+ * @brief Get a quantile of a histogram, summed over all threads. The value is the upper
+ * bound of the bucket holding the quantile, so it is never below the real one.
+ *
+ * @param histogram One of the histogram METRIC_*
+ * @param quantile Quantile, between 0 and 1
+ * @return uint64_t Duration in nanoseconds. 0 if nothing was recorded.
+ */
+uint64_t getMetricQuantile (uint8_t histogram, double quantile);
+
+/**
+ * @brief Writes, for every histogram with records, its count and its p50, p99 and p999 in ms.
+ * Meant for people, see writeMetrics for scrapers.
+ *
+ * @param stream Stream to write to
+ * @return true Error
+ * @return false All good
+ */
+bool writeLatencyReport (FILE* stream);
+
+/**
+ * @brief Writes all metrics in the Prometheus text exposition format.
+ * The p50, p99 and p999 of every histogram are exported as gas_latency_quantile_seconds too.
+ *
+ * @param stream Stream to write to
+ * @return true Error
+ * @return false All good
+ */
+bool writeMetrics (FILE* stream);
+
+/**
+ * @brief Create a MetricsServer object, listening on a Unix domain socket with a thread of its own.
+ * A socket left at the path by a previous run is replaced. Any other file there is an error.
+ *
+ * @param path Path of the socket
+ * @return MetricsServer* Pointer to the new MetricsServer object. NULL if error.
+ */
+MetricsServer* createMetricsServer (const char* path);
+
+/**
+ * @brief Stop the thread of a MetricsServer, remove its socket and delete the object
+ *
+ * @param server Pointer to the MetricsServer object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteMetricsServer (MetricsServer* server);
+
+#endif
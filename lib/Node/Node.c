@@ -1,4 +1,50 @@
 #include "Node.h"
+#include "Clock.h"
+
+// Tells if a report older than period*NODE_STALE_PERIODS is stale, and lowers deadline to when it would be
+bool isReportStale (uint64_t lastSeen, uint32_t period, uint64_t now, uint64_t* deadline) {
+    if (!period) {
+        return false;
+    }
+
+    uint64_t expires = lastSeen + (uint64_t)period*NODE_STALE_PERIODS;
+    if (now > expires) {
+        return true;
+    }
+
+    if (expires < *deadline) {
+        *deadline = expires;
+    }
+    return false;
+}
+
+void checkNodeLiveness (Timer* timer, void* arg) {
+    Node* node = arg;
+    Datastore* datastore = node->parentRoom->parentDatastore;
+    uint64_t now = getMonotonicTime(),
+        deadline = UINT64_MAX;
+    bool anyStale = false;
+
+    node->stale = isReportStale(__atomic_load_n(&node->lastSeen, __ATOMIC_RELAXED), node->period, now, &deadline);
+    anyStale |= node->stale;
+
+    LL_iterator(node->sensors, sensor_elem) {
+        Sensor* sensor = sensor_elem->ptr;
+        uint32_t period = sensor->period ? sensor->period : node->period;
+
+        sensor->stale = isReportStale(__atomic_load_n(&sensor->lastSeen, __ATOMIC_RELAXED), period, now, &deadline);
+        anyStale |= sensor->stale;
+    }
+
+    // Stale entries are polled every tick to notice them coming back
+    if (anyStale) {
+        deadline = now + NODE_LIVENESS_TICK;
+    }
+
+    if (deadline != UINT64_MAX) {
+        scheduleTimer(datastore->livenessTimers, timer, deadline/NODE_LIVENESS_TICK + 1);
+    }
+}
 
 Node* createNode (Room* room, uint16_t id) {
     if (!room) {
@@ -6,7 +52,7 @@ Node* createNode (Room* room, uint16_t id) {
     }
 
     Datastore* datastore = room->parentDatastore;
-    if (findNodeByID(datastore, id)) {
+    if (!datastore->bulkLoad && findNodeByID(datastore, id)) {
         return NULL;
     }
 
@@ -43,6 +89,10 @@ Node* createNode (Room* room, uint16_t id) {
     node->listPtr = elem;
     node->sensors = sensors;
     node->actuators = actuators;
+    node->lastSeen = getMonotonicTime();
+    node->period = 0;
+    node->stale = false;
+    initTimer(&node->livenessTimer, &checkNodeLiveness, node);
 
     return node;
 }
@@ -57,6 +107,8 @@ bool deleteNode (Node* node) {
 
     list_element* aux;
 
+    cancelTimer(&node->livenessTimer);
+
 
     // Delete all node's sensors
     aux = listStart(node->sensors);
@@ -103,6 +155,43 @@ bool setNodeID (Node* node, uint16_t id) {
     return 0;
 }
 
+bool setNodePeriod (Node* node, uint32_t period) {
+    if (!node) {
+        return true;
+    }
+
+    node->period = period;
+
+    return watchNodeLiveness(node);
+}
+
+bool isNodeStale (Node* node) {
+    if (!node) {
+        return false;
+    }
+
+    return node->stale;
+}
+
+bool watchNodeLiveness (Node* node) {
+    if (!node) {
+        return true;
+    }
+
+    TimerWheel* wheel = node->parentRoom->parentDatastore->livenessTimers;
+    return scheduleTimer(wheel, &node->livenessTimer, wheel->now + 1);
+}
+
+bool updateNodeLiveness (Datastore* datastore) {
+    if (!datastore) {
+        return true;
+    }
+
+    advanceTimerWheel(datastore->livenessTimers, getMonotonicTime()/NODE_LIVENESS_TICK);
+
+    return false;
+}
+
 Node* findNodeByID (Datastore* datastore, uint16_t nodeID) {
     if (!datastore) {
         return NULL;
@@ -13,10 +13,21 @@ typedef struct _node Node;
 #include "Room.h"
 #include "Sensor.h"
 #include "Actuator.h"
+#include "TimerWheel.h"
+
+#define NODE_STALE_PERIODS      3       // Missed reports before a node or sensor turns stale
+#define NODE_LIVENESS_TICK      250     // Resolution of the liveness sweeper, in milliseconds
+#define NODE_LIVENESS_SLOTS     256
+
+// Pixel color of stale sensors and of the actuators of stale nodes
+#define NODE_STALE_RED          64
+#define NODE_STALE_GREEN        64
+#define NODE_STALE_BLUE         64
 
 
 /**
  * @brief Structure to hold all data concerning a Node.
+ * lastSeen is the monotonic time (ms) of the last report of any of its sensors.
  * 
  */
 struct _node {
@@ -25,6 +36,10 @@ struct _node {
     list_element* listPtr;
     list* sensors;
     list* actuators;
+    uint64_t lastSeen;
+    uint32_t period;
+    bool stale;
+    Timer livenessTimer;
 };
 
 /**
@@ -64,6 +79,45 @@ bool setNodeID (Node* node, uint16_t id);
  */
 Node* findNodeByID (Datastore* datastore, uint16_t nodeID);
 
+/**
+ * @brief Sets how often the node is expected to report. The node and its sensors turn
+ * stale when they miss NODE_STALE_PERIODS reports in a row.
+ * 
+ * @param node Pointer to the Node object
+ * @param period Expected time between reports, in milliseconds. 0 to stop tracking the node.
+ * @return true Error
+ * @return false All good
+ */
+bool setNodePeriod (Node* node, uint32_t period);
+
+/**
+ * @brief Tells if the node stopped reporting
+ * 
+ * @param node Pointer to the Node object
+ * @return true Node is stale
+ * @return false Node is alive, NULL or not tracked
+ */
+bool isNodeStale (Node* node);
+
+/**
+ * @brief Makes the liveness sweeper check the node and its sensors on its next run
+ * 
+ * @param node Pointer to the Node object
+ * @return true Error
+ * @return false All good
+ */
+bool watchNodeLiveness (Node* node);
+
+/**
+ * @brief Runs the liveness sweeper of the datastore. Only the nodes whose deadline
+ * passed are checked; a node that reported since is simply re-armed.
+ * 
+ * @param datastore Pointer to the Datastore object
+ * @return true Error
+ * @return false All good
+ */
+bool updateNodeLiveness (Datastore* datastore);
+
 bool moveNodeToRoom (Node* node, Room* room, list* queryList);
 
 void prepareNodeQueries (list* queryList);
@@ -0,0 +1,209 @@
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "OutputSink.h"
+#include "Metrics.h"
+#include "Clock.h"
+
+void* thread_outputSink (void* arg) {
+    OutputSink* sink = arg;
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    long period = sink->maxFps ? 1000000000L / sink->maxFps : 0;
+
+    while (__atomic_load_n(&sink->active, __ATOMIC_ACQUIRE)) {
+        uint64_t sequence;
+        const uint8_t* frame = acquireFrame(sink->framebuffer, &sequence);
+        uint64_t start = getMonotonicTimeNs();
+        bool written;
+        if (writeFrame(sink->writer, frame, sequence, &written)) {
+            // Reader gone or device error: drop this sink, the others keep going
+            fprintf(stderr, "Error writing to %s, output stopped.\n", sink->path);
+            break;
+        }
+
+        // Delta frames with no change send nothing and are not counted
+        if (written) {
+            recordMetricTime(METRIC_FRAME_WRITE_TIME, getMonotonicTimeNs() - start);
+            addMetricCount(METRIC_FRAMES, 1);
+        }
+
+        // Uncapped: write again as soon as there is a new frame
+        if (!period) {
+            if (waitForFrame(sink->framebuffer, sequence)) {
+                break;
+            }
+            continue;
+        }
+
+        // Sleep until the next slot, skipping the ones missed by a slow write
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        do {
+            next.tv_nsec += period;
+            while (next.tv_nsec >= 1000000000L) {
+                next.tv_nsec -= 1000000000L;
+                next.tv_sec++;
+            }
+        } while (next.tv_sec < now.tv_sec || (next.tv_sec == now.tv_sec && next.tv_nsec <= now.tv_nsec));
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    addMetricGauge(METRIC_OUTPUT_SINKS, -1);
+
+    return NULL;
+}
+
+OutputSink* createOutputSink (const char* path, uint8_t format, uint32_t maxFps, bool delta, uint32_t keyframePeriod, uint16_t width, uint16_t height) {
+    if (!path) {
+        return NULL;
+    }
+
+    OutputSink* sink = (OutputSink*)malloc(sizeof(OutputSink));
+    if (!sink) {
+        return NULL;
+    }
+
+    sink->path = (char*)malloc(strlen(path)+1);
+    if (!sink->path) {
+        free(sink);
+        return NULL;
+    }
+    strcpy(sink->path, path);
+
+    sink->stream = fopen(path, "w");
+    sink->framebuffer = createFramebuffer(width, height);
+    sink->writer = sink->stream ? createFrameWriter(sink->stream, format, width, height) : NULL;
+    sink->maxFps = maxFps;
+    sink->cropped = false;
+    sink->x = 0;
+    sink->y = 0;
+    sink->sourceWidth = width;
+    sink->sourceHeight = height;
+    sink->active = true;
+
+    // Counted before the thread starts, so a thread failing right away never takes the gauge below zero
+    addMetricGauge(METRIC_OUTPUT_SINKS, 1);
+    if (!sink->stream || !sink->framebuffer || !sink->writer ||
+        (delta && setFrameWriterDelta(sink->writer, keyframePeriod)) ||
+        pthread_create(&sink->thread, NULL, &thread_outputSink, sink)) {
+
+        addMetricGauge(METRIC_OUTPUT_SINKS, -1);
+        deleteFrameWriter(sink->writer);
+        deleteFramebuffer(sink->framebuffer);
+        if (sink->stream) {
+            fclose(sink->stream);
+        }
+        free(sink->path);
+        free(sink);
+        return NULL;
+    }
+
+    return sink;
+}
+
+bool parseOutputSinkNumber (const char* text, uint32_t* value) {
+    if (!text || !value) {
+        return true;
+    }
+
+    // strtoull takes leading spaces and signs, wrapping negative numbers around: digits only
+    if (*text < '0' || *text > '9') {
+        return true;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (errno || *end || parsed > UINT32_MAX) {
+        return true;
+    }
+
+    *value = (uint32_t)parsed;
+
+    return false;
+}
+
+OutputSink* createOutputSinkFromSpec (const char* spec, uint16_t width, uint16_t height) {
+    if (!spec) {
+        return NULL;
+    }
+
+    char* fields = (char*)malloc(strlen(spec)+1);
+    if (!fields) {
+        return NULL;
+    }
+    strcpy(fields, spec);
+
+    char* saveptr;
+    char* path = strtok_r(fields, ",", &saveptr);
+    char* format = strtok_r(NULL, ",", &saveptr);
+    char* fps = strtok_r(NULL, ",", &saveptr);
+    char* keyframe = strtok_r(NULL, ",", &saveptr);
+
+    uint8_t frameFormat = FRAME_FORMAT_TEXT;
+    uint32_t maxFps = OUTPUT_SINK_UNCAPPED;
+    uint32_t keyframePeriod = 0;
+    OutputSink* sink = NULL;
+    if (!path || (format && parseFrameFormat(format, &frameFormat)) ||
+        (fps && parseOutputSinkNumber(fps, &maxFps)) ||
+        (keyframe && parseOutputSinkNumber(keyframe, &keyframePeriod))) {
+        fprintf(stderr, "Invalid output description %s.\n", spec);
+    }
+    else {
+        sink = createOutputSink(path, frameFormat, maxFps, keyframe != NULL, keyframePeriod, width, height);
+    }
+
+    free(fields);
+
+    return sink;
+}
+
+bool deleteOutputSink (OutputSink* sink) {
+    if (!sink) {
+        return true;
+    }
+
+    __atomic_store_n(&sink->active, false, __ATOMIC_RELEASE);
+    closeFramebuffer(sink->framebuffer);
+    pthread_join(sink->thread, NULL);
+
+    deleteFrameWriter(sink->writer);
+    deleteFramebuffer(sink->framebuffer);
+    fclose(sink->stream);
+    free(sink->path);
+    free(sink);
+
+    return false;
+}
+
+bool setOutputSinkRegion (OutputSink* sink, uint16_t x, uint16_t y, uint16_t sourceWidth, uint16_t sourceHeight) {
+    if (!sink || (uint32_t)x + sink->framebuffer->width > sourceWidth ||
+        (uint32_t)y + sink->framebuffer->height > sourceHeight) {
+        return true;
+    }
+
+    sink->cropped = true;
+    sink->x = x;
+    sink->y = y;
+    sink->sourceWidth = sourceWidth;
+    sink->sourceHeight = sourceHeight;
+
+    return false;
+}
+
+void publishOutputSink (OutputSink* sink, const uint8_t* frame) {
+    if (!sink || !frame) {
+        return;
+    }
+
+    if (sink->cropped) {
+        copyFrameRegion(sink->framebuffer, frame, sink->sourceWidth, sink->sourceHeight, sink->x, sink->y);
+    }
+    else {
+        copyFrame(sink->framebuffer, frame);
+    }
+    publishFrame(sink->framebuffer);
+}
@@ -0,0 +1,110 @@
+#ifndef __OUTPUT_SINK__
+#define __OUTPUT_SINK__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef struct _output_sink OutputSink;
+
+#include "Framebuffer.h"
+#include "FrameWriter.h"
+
+#define OUTPUT_SINK_MAX         8
+#define OUTPUT_SINK_UNCAPPED    0   // Frame rate of a sink writing every frame as soon as it is published
+
+
+/**
+ * @brief Destination of the frames, with its own encoding, frame rate cap and thread.
+ *
+ * Each sink gets frames through a Framebuffer of its own, so a slow sink only skips
+ * frames and never holds back the rules thread or the other sinks. A sink stops writing
+ * after an error, e.g. when the reader of its pty or FIFO goes away.
+ * A cropped sink only writes the rectangle of the frames shown by its panel.
+ *
+ */
+struct _output_sink {
+    char* path;
+    FILE* stream;
+    Framebuffer* framebuffer;
+    FrameWriter* writer;
+    uint32_t maxFps;
+    bool cropped;
+    uint16_t x;
+    uint16_t y;
+    uint16_t sourceWidth;
+    uint16_t sourceHeight;
+    pthread_t thread;
+    bool active;
+};
+
+/**
+ * @brief Create an OutputSink object, opening its file and starting its thread
+ *
+ * @param path File to write to. Opened for writing, so it can be a pty or a FIFO.
+ * @param format One of FRAME_FORMAT_*
+ * @param maxFps Most frames written per second. OUTPUT_SINK_UNCAPPED to write every frame published.
+ * @param delta Write delta frames. Binary formats only.
+ * @param keyframePeriod Time, in ms, between full frames when writing delta frames
+ * @param width Number of columns of the frames
+ * @param height Number of rows of the frames
+ * @return OutputSink* Pointer to the new OutputSink object. NULL if error.
+ */
+OutputSink* createOutputSink (const char* path, uint8_t format, uint32_t maxFps, bool delta, uint32_t keyframePeriod, uint16_t width, uint16_t height);
+
+/**
+ * @brief Parses a frame rate or a keyframe period, in ms, as given on the command line
+ *
+ * @param text Decimal number, with nothing before or after it
+ * @param value Filled with the number
+ * @return true Error: empty, not a number, negative or above UINT32_MAX
+ * @return false All good
+ */
+bool parseOutputSinkNumber (const char* text, uint32_t* value);
+
+/**
+ * @brief Create an OutputSink object from a description <path>[,<format>[,<fps>[,<keyframe-ms>]]].
+ * The format is text by default, the rate uncapped, and a keyframe period turns delta frames on.
+ *
+ * @param spec Description of the sink
+ * @param width Number of columns of the frames
+ * @param height Number of rows of the frames
+ * @return OutputSink* Pointer to the new OutputSink object. NULL if error.
+ */
+OutputSink* createOutputSinkFromSpec (const char* spec, uint16_t width, uint16_t height);
+
+/**
+ * @brief Stop the thread of a sink, close its file and delete the OutputSink object
+ *
+ * @param sink Pointer to the OutputSink object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteOutputSink (OutputSink* sink);
+
+/**
+ * @brief Makes a sink write only a rectangle of the frames it is handed, starting at column x
+ * and row y and with the size of the sink. Must be called before the first frame is published.
+ *
+ * @param sink Pointer to the OutputSink object
+ * @param x First column of the rectangle
+ * @param y First row of the rectangle
+ * @param sourceWidth Number of columns of the frames handed to the sink
+ * @param sourceHeight Number of rows of the frames handed to the sink
+ * @return true Error, the rectangle does not fit in the frames
+ * @return false All good
+ */
+bool setOutputSinkRegion (OutputSink* sink, uint16_t x, uint16_t y, uint16_t sourceWidth, uint16_t sourceHeight);
+
+/**
+ * @brief Hands a frame to a sink, to be written when its rate allows. Never blocks.
+ * Only ever called from the thread rendering the frames.
+ *
+ * @param sink Pointer to the OutputSink object
+ * @param frame Packed RGB pixels, as laid out by the Framebuffer
+ */
+void publishOutputSink (OutputSink* sink, const uint8_t* frame);
+
+#endif
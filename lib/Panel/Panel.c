@@ -0,0 +1,77 @@
+#include "Panel.h"
+
+Panel* createPanel (Datastore* datastore, uint16_t x, uint16_t y, uint16_t width, uint16_t height, const char* output) {
+    if (!datastore || !output || !width || !height) {
+        return NULL;
+    }
+
+    if ((uint32_t)x + width > datastore->matrixWidth || (uint32_t)y + height > datastore->matrixHeight) {
+        // The panel goes past the edge of the matrix
+        return NULL;
+    }
+
+    Panel* panel = (Panel*)malloc(sizeof(Panel));
+    if (panel == NULL) {
+        // Memory allocation failed
+        return NULL;
+    }
+
+    panel->output = (char*)malloc(strlen(output)+1);
+    if (panel->output == NULL) {
+        free(panel);
+        return NULL;
+    }
+    strcpy(panel->output, output);
+
+    list_element* elem = listInsert(datastore->panels, panel, NULL);
+    if (elem == NULL) {
+        // Insertion failed
+        free(panel->output);
+        free(panel);
+        return NULL;
+    }
+
+    panel->x = x;
+    panel->y = y;
+    panel->width = width;
+    panel->height = height;
+    panel->format = FRAME_FORMAT_TEXT;
+    panel->maxFps = 0;
+    panel->delta = false;
+    panel->keyframePeriod = 0;
+    panel->parentDatastore = datastore;
+    panel->listPtr = elem;
+
+    return panel;
+}
+
+bool deletePanel (Panel* panel) {
+    if (panel == NULL) {
+        return 1;
+    }
+
+    Datastore* datastore = panel->parentDatastore;
+    list_element* elem = panel->listPtr;
+
+    free(panel->output);
+    free(panel);
+    list_element* res = listRemove(datastore->panels, elem);
+    if (res == NULL && listSize(datastore->panels)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+bool setPanelEncoding (Panel* panel, uint8_t format, uint32_t maxFps, bool delta, uint32_t keyframePeriod) {
+    if (!panel || format > FRAME_FORMAT_RGB565 || (delta && format == FRAME_FORMAT_TEXT)) {
+        return true;
+    }
+
+    panel->format = format;
+    panel->maxFps = maxFps;
+    panel->delta = delta;
+    panel->keyframePeriod = keyframePeriod;
+
+    return false;
+}
@@ -0,0 +1,71 @@
+#ifndef __PANEL__
+#define __PANEL__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "LinkedList.h"
+
+typedef struct _panel Panel;
+
+#include "Datastore.h"
+#include "FrameWriter.h"
+
+
+/**
+ * @brief Physical panel showing a rectangle of the matrix, starting at column x and row y,
+ * with the output stream driving it and how frames are sent there.
+ *
+ */
+struct _panel {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    char* output;
+    uint8_t format;
+    uint32_t maxFps;
+    bool delta;
+    uint32_t keyframePeriod;
+    Datastore* parentDatastore;
+    list_element* listPtr;
+};
+
+/**
+ * @brief Create a Panel object, sending text frames as fast as possible
+ *
+ * @param datastore Datastore in which to be inserted
+ * @param x First column of the panel
+ * @param y First row of the panel
+ * @param width Number of columns of the panel
+ * @param height Number of rows of the panel
+ * @param output Output stream of the panel
+ * @return Panel* The pointer to the new Panel object. NULL if error or if it does not fit in the matrix.
+ */
+Panel* createPanel (Datastore* datastore, uint16_t x, uint16_t y, uint16_t width, uint16_t height, const char* output);
+
+/**
+ * @brief Delete a Panel object
+ *
+ * @param panel The pointer to the Panel object to be deleted
+ * @return true Error
+ * @return false All good
+ */
+bool deletePanel (Panel* panel);
+
+/**
+ * @brief Set how frames are sent to a Panel
+ *
+ * @param panel Pointer to the Panel object
+ * @param format One of FRAME_FORMAT_*
+ * @param maxFps Most frames sent per second. 0 for as fast as possible.
+ * @param delta Send delta frames. Binary formats only.
+ * @param keyframePeriod Time, in ms, between full frames when sending delta frames
+ * @return true Error
+ * @return false All good
+ */
+bool setPanelEncoding (Panel* panel, uint8_t format, uint32_t maxFps, bool delta, uint32_t keyframePeriod);
+
+#endif
@@ -5,7 +5,7 @@ Pixel* createPixel (Datastore* datastore, Color* color, Position* pos) {
         return NULL;
     }
 
-    if (findPixelByPos(datastore, pos)) {
+    if (!datastore->bulkLoad && findPixelByPos(datastore, pos)) {
         return NULL;
     }
 
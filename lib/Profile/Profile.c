@@ -1,11 +1,68 @@
 #include "Profile.h"
 
+// Minute at which the profile becomes active. As in isProfileActiveAt,
+// a window wrapping around midnight only holds from midnight to its end.
+uint16_t getProfileStartMinute (Profile* profile) {
+    int startTimeInMinutes = ((profile->start).tm_hour)*60 + (profile->start).tm_min,
+        endTimeInMinutes = ((profile->end).tm_hour)*60 + (profile->end).tm_min;
+
+    if (endTimeInMinutes > startTimeInMinutes) {
+        return startTimeInMinutes % PROFILE_MINUTES_PER_DAY;
+    }
+    return 0;
+}
+
+// Minute at which the profile becomes inactive
+uint16_t getProfileEndMinute (Profile* profile) {
+    return (((profile->end).tm_hour)*60 + (profile->end).tm_min) % PROFILE_MINUTES_PER_DAY;
+}
+
+// Tick of the next time the local clock shows minuteOfDay, always in the future
+uint64_t nextProfileTick (Datastore* datastore, uint16_t minuteOfDay) {
+    uint16_t delta = (minuteOfDay + PROFILE_MINUTES_PER_DAY - datastore->minuteOfDay) % PROFILE_MINUTES_PER_DAY;
+    if (!delta) {
+        delta = PROFILE_MINUTES_PER_DAY;
+    }
+
+    return datastore->profileTimers->now + delta;
+}
+
+// Recomputes the state of every profile and moves its timers, which are only right
+// as long as the UTC offset they were scheduled with holds
+void rescheduleProfiles (Datastore* datastore) {
+    LL_iterator(datastore->profiles, profile_elem) {
+        Profile* profile = (Profile*)profile_elem->ptr;
+        scheduleTimer(datastore->profileTimers, &profile->startTimer, nextProfileTick(datastore, getProfileStartMinute(profile)));
+        scheduleTimer(datastore->profileTimers, &profile->endTimer, nextProfileTick(datastore, getProfileEndMinute(profile)));
+
+        bool active = isProfileActiveAt(profile, datastore->minuteOfDay);
+        if (active != profile->active) {
+            profile->active = active;
+            wakeRuleSegments(datastore->program, profile);
+        }
+    }
+}
+
+void profileTransition (Timer* timer, void* arg) {
+    Profile* profile = arg;
+    Datastore* datastore = profile->parentDatastore;
+
+    uint16_t minute = (timer == &profile->startTimer) ? getProfileStartMinute(profile) : getProfileEndMinute(profile);
+    scheduleTimer(datastore->profileTimers, timer, nextProfileTick(datastore, minute));
+
+    bool active = isProfileActiveAt(profile, datastore->minuteOfDay);
+    if (active != profile->active) {
+        profile->active = active;
+        wakeRuleSegments(datastore->program, profile);
+    }
+}
+
 Profile* createProfile (Datastore* datastore, uint16_t id, const char* name, const char* start, const char* end) {
     if (!datastore) {
         return NULL;
     }
 
-    if (findProfileByID(datastore, id)) {
+    if (!datastore->bulkLoad && findProfileByID(datastore, id)) {
         // There's already a profile with the specified ID
         return NULL;
     }
@@ -30,16 +87,22 @@ Profile* createProfile (Datastore* datastore, uint16_t id, const char* name, con
         strcpy(profile->name, name);
     }
 
+    profile->start.tm_hour = 0;
+    profile->start.tm_min = 0;
+    profile->end.tm_hour = 0;
+    profile->end.tm_min = 0;
+    // strtok_r: configurations may be parsed while other threads run
+    char* saveptr;
     if (start) {
-        char* hours = strtok(start, ":");
-        char* minutes = strtok(NULL, ":");
+        char* hours = strtok_r(start, ":", &saveptr);
+        char* minutes = strtok_r(NULL, ":", &saveptr);
 
         profile->start.tm_hour = strtol(hours, (char **)NULL, 10);
         profile->start.tm_min = strtol(minutes, (char **)NULL, 10);
     }
     if (end) {
-        char* hours = strtok(end, ":");
-        char* minutes = strtok(NULL, ":");
+        char* hours = strtok_r(end, ":", &saveptr);
+        char* minutes = strtok_r(NULL, ":", &saveptr);
 
         profile->end.tm_hour = strtol(hours, (char **)NULL, 10);
         profile->end.tm_min = strtol(minutes, (char **)NULL, 10);
@@ -55,6 +118,16 @@ Profile* createProfile (Datastore* datastore, uint16_t id, const char* name, con
     }
 
     profile->listPtr = elem;
+    profile->slot = 0;
+    profile->active = false;
+
+    // Compute the current state once, the scheduler keeps it up to date from now on
+    initTimer(&profile->startTimer, &profileTransition, profile);
+    initTimer(&profile->endTimer, &profileTransition, profile);
+    updateProfileSchedule(datastore);
+    profile->active = isProfileActiveAt(profile, datastore->minuteOfDay);
+    scheduleTimer(datastore->profileTimers, &profile->startTimer, nextProfileTick(datastore, getProfileStartMinute(profile)));
+    scheduleTimer(datastore->profileTimers, &profile->endTimer, nextProfileTick(datastore, getProfileEndMinute(profile)));
 
     return profile;
 }
@@ -64,6 +137,9 @@ bool deleteProfile (Profile* profile) {
         return true;
     }
 
+    cancelTimer(&profile->startTimer);
+    cancelTimer(&profile->endTimer);
+
     LL_iterator(profile->parentDatastore->rules, rule_elem) {
         Rule* rule = (Rule*)rule_elem->ptr;
         if (removeProfileFromRule(rule, profile)) {
@@ -127,14 +203,17 @@ bool isProfileActive (Profile* profile) {
         return false;
     }
 
-    time_t rawtime;
-    struct tm *currentTime;
-    time( &rawtime );
-    currentTime = localtime( &rawtime );
+    return profile->active;
+}
+
+bool isProfileActiveAt (Profile* profile, uint16_t minuteOfDay) {
+    if (!profile) {
+        return false;
+    }
 
     int startTimeInMinutes = ((profile->start).tm_hour)*60 + (profile->start).tm_min,
         endTimeInMinutes = ((profile->end).tm_hour)*60 + (profile->end).tm_min,
-        currentTimeInMinutes = (currentTime->tm_hour)*60 + (currentTime->tm_min);
+        currentTimeInMinutes = minuteOfDay;
 
     if (endTimeInMinutes > startTimeInMinutes) {
         int timeWindow = endTimeInMinutes - startTimeInMinutes;
@@ -152,6 +231,36 @@ bool isProfileActive (Profile* profile) {
     return false;
 }
 
+bool updateProfileSchedule (Datastore* datastore) {
+    if (!datastore) {
+        return true;
+    }
+
+    time_t rawtime = time(NULL);
+    if (rawtime < datastore->profileClock) {
+        // Still in the same minute
+        return false;
+    }
+
+    struct tm currentTime;
+    if (!localtime_r(&rawtime, &currentTime)) {
+        return true;
+    }
+
+    datastore->minuteOfDay = (currentTime.tm_hour)*60 + (currentTime.tm_min);
+    datastore->profileClock = (rawtime/60 + 1)*60;
+    advanceTimerWheel(datastore->profileTimers, rawtime/60);
+
+    // The wheel counts UTC minutes and profiles follow the local clock: on a DST or
+    // timezone change every pending transition is off by the difference
+    if (currentTime.tm_gmtoff != datastore->utcOffset) {
+        datastore->utcOffset = currentTime.tm_gmtoff;
+        rescheduleProfiles(datastore);
+    }
+
+    return false;
+}
+
 /**********************************/
 /*        DATABASE QUERIES        */
 /**********************************/
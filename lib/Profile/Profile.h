@@ -9,6 +9,9 @@ typedef struct _profile Profile;
 
 #include "Datastore.h"
 #include "DBLink.h"
+#include "TimerWheel.h"
+
+#define PROFILE_MINUTES_PER_DAY 1440
 
 
 /**
@@ -22,6 +25,10 @@ struct _profile {
     char* name;
     struct tm start;
     struct tm end;
+    bool active;
+    Timer startTimer;
+    Timer endTimer;
+    uint32_t slot;  // Index in the profiles of the compiled rule program, only valid if the program maps it back to this profile
 };
 
 
@@ -64,8 +71,36 @@ Profile* findProfileByID (Datastore* datastore, uint16_t id);
  */
 Profile* findProfileByName (Datastore* datastore, const char* name);
 
+/**
+ * @brief Tells if the profile is active. Reads the state kept by the profile scheduler.
+ * 
+ * @param profile Pointer to the Profile object
+ * @return true Profile is active
+ * @return false Profile is inactive or NULL
+ */
 bool isProfileActive (Profile* profile);
 
+/**
+ * @brief Tells if the profile is active at a given time of the day
+ * 
+ * @param profile Pointer to the Profile object
+ * @param minuteOfDay Minutes since local midnight
+ * @return true Profile is active
+ * @return false Profile is inactive or NULL
+ */
+bool isProfileActiveAt (Profile* profile, uint16_t minuteOfDay);
+
+/**
+ * @brief Moves the profile scheduler of the datastore to the current time.
+ * Profiles whose start or end was reached flip state, and the rules they gate are woken.
+ * Cheap when called more than once per minute: the local time is only computed on minute changes.
+ * 
+ * @param datastore Pointer to the Datastore object
+ * @return true Error
+ * @return false All good
+ */
+bool updateProfileSchedule (Datastore* datastore);
+
 void prepareProfileQueries (list* queryList);
 void preparePriorityProfileQueries (list* queryList);
 
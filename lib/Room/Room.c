@@ -1,7 +1,7 @@
 #include "Room.h"
 
 Room* createRoom (Datastore* datastore, uint16_t id) {
-    if (!datastore || findRoomByID(datastore, id)) {
+    if (!datastore || (!datastore->bulkLoad && findRoomByID(datastore, id))) {
         return NULL;
     }
 
@@ -1,12 +1,13 @@
 #include "Rule.h"
 #include "DBLink.h"
+#include "RuleProgram.h"
 
 Rule* createRule (Datastore* datastore, Rule* parentRule, uint16_t id, uint16_t type, uint16_t value) {
     if (!datastore) {
         return NULL;
     }
 
-    if (findRuleByID(datastore, id)) {
+    if (!datastore->bulkLoad && findRuleByID(datastore, id)) {
         // There's already a rule with the specified ID
         return NULL;
     }
@@ -56,6 +57,13 @@ Rule* createRule (Datastore* datastore, Rule* parentRule, uint16_t id, uint16_t
     rule->value = value;
     rule->childs = childs;
     rule->profiles = profiles;
+    rule->priority = 0;
+    rule->hysteresis = 0;
+    rule->minOnTime = 0;
+    rule->minOffTime = 0;
+    rule->operand = SENSOR_OPERAND_VALUE;
+    rule->window = 0;
+    rule->count = 1;
 
     list_element *elem = NULL,
         *parentRuleElem = NULL;
@@ -92,6 +100,8 @@ Rule* createRule (Datastore* datastore, Rule* parentRule, uint16_t id, uint16_t
     rule->listPtr = elem;
     rule->listPtr_parentRule = parentRuleElem;
 
+    invalidateRuleProgram(datastore);
+
     return rule;
 }
 
@@ -102,6 +112,8 @@ bool deleteRule (Rule* rule) {
 
     uint16_t retVal = 0;
 
+    invalidateRuleProgram(rule->parentDatastore);
+
     deleteList(rule->sensors);
     deleteList(rule->actuators);
     deleteList(rule->profiles);
@@ -151,6 +163,8 @@ bool addSensorToRule (Rule* rule, Sensor* sensor) {
         return true;
     }
 
+    invalidateRuleProgram(rule->parentDatastore);
+
     return false;
 }
 
@@ -165,9 +179,88 @@ bool addActuatorToRule (Rule* rule, Actuator* actuator) {
         return true;
     }
 
+    invalidateRuleProgram(rule->parentDatastore);
+
+    return false;
+}
+
+bool setRulePriority (Rule* rule, uint16_t priority) {
+    if (!rule) {
+        return true;
+    }
+
+    rule->priority = priority;
+    invalidateRuleProgram(rule->parentDatastore);
+
+    return false;
+}
+
+bool setRuleHysteresis (Rule* rule, uint16_t hysteresis) {
+    if (!rule) {
+        return true;
+    }
+
+    rule->hysteresis = hysteresis;
+    invalidateRuleProgram(rule->parentDatastore);
+
+    return false;
+}
+
+bool setRuleDwellTimes (Rule* rule, uint32_t minOnTime, uint32_t minOffTime) {
+    if (!rule) {
+        return true;
+    }
+
+    rule->minOnTime = minOnTime;
+    rule->minOffTime = minOffTime;
+    invalidateRuleProgram(rule->parentDatastore);
+
+    return false;
+}
+
+bool setRuleOperand (Rule* rule, uint8_t operand) {
+    if (!rule || operand > SENSOR_OPERAND_EWMA) {
+        return true;
+    }
+
+    rule->operand = operand;
+    invalidateRuleProgram(rule->parentDatastore);
+
     return false;
 }
 
+bool setRuleWindow (Rule* rule, uint32_t window, uint16_t count) {
+    if (!rule) {
+        return true;
+    }
+
+    rule->window = window;
+    rule->count = count;
+    invalidateRuleProgram(rule->parentDatastore);
+
+    return false;
+}
+
+bool testRuleCondition (uint16_t operation, float val, uint16_t value) {
+    switch(operation) {
+        case TYPE_RULE_LESS_THEN:
+            return val < value;
+
+        case TYPE_RULE_GREATER_THEN:
+            return val > value;
+
+        case TYPE_RULE_EQUAL_TO:
+            return val == value;
+
+        case TYPE_RULE_WITHIN_MARGIN:
+            return (val > ((float)(value))*(0.95)) &&
+                (val < ((float)(value))*(1.05));
+
+        default:
+            return false;
+    }
+}
+
 bool evaluateRule (Rule* rule, bool uploadValues, list* queryList) {
     if (!rule) {
         return false;
@@ -203,41 +296,15 @@ bool evaluateRule (Rule* rule, bool uploadValues, list* queryList) {
     // Test sensor values against rule value given the rule operation
     LL_iterator(rule->sensors, sensor_elem) {
         Sensor* sensor = sensor_elem->ptr;
-        float val = getSensorValue(sensor);
+        float val = getSensorOperandValue(sensor, rule->operand);
 
         if (uploadValues) {
-            uploadSensorValue(sensor, val, queryList);
+            uploadSensorValue(sensor, getSensorValue(sensor), queryList);
         }
         
-        switch(rule->operation) {
-            case TYPE_RULE_LESS_THEN:
-                if ( !(val < rule->value) ) {
-                    return false;
-                }
-                break;
-
-            case TYPE_RULE_GREATER_THEN:
-                if ( !(val > rule->value) ) {
-                    return false;
-                }
-                break;
-
-            case TYPE_RULE_EQUAL_TO:
-                if ( !(val == rule->value) ) {
-                    return false;
-                }
-                break;
-
-            case TYPE_RULE_WITHIN_MARGIN:
-                if ( !((val > ((float)(rule->value))*(0.95)) &&
-                    (val < ((float)(rule->value))*(1.05)) )) {
-                    return false;
-                }
-                break;
-                
-            default:
-                return false;
-                break;
+        // Stale readings never verify a rule
+        if (isSensorStale(sensor) || !testRuleCondition(rule->operation, val, rule->value)) {
+            return false;
         }
     }
 
@@ -250,18 +317,22 @@ bool executeRules (Datastore* datastore, bool uploadValues, list* queryList) {
         return true;
     }
 
-    Color colorActive,
-        colorInactive;
-    
-    // Green
-    colorActive.r = 0;
-    colorActive.g = 255;
-    colorActive.b = 0;
+    // Flip the profiles whose start or end was reached, and mark the nodes that stopped reporting
+    if (updateProfileSchedule(datastore) || updateNodeLiveness(datastore)) {
+        return true;
+    }
 
-    // Red
-    colorInactive.r = 255;
-    colorInactive.g = 0;
-    colorInactive.b = 0;
+    // Run the compiled program, falling back to walking the rule trees
+    if (!datastore->program) {
+        datastore->program = compileRules(datastore);
+    }
+    if (datastore->program) {
+        return executeRuleProgram(datastore->program, uploadValues, queryList);
+    }
+
+    Color colorActive = {RULE_ACTIVE_RED, RULE_ACTIVE_GREEN, RULE_ACTIVE_BLUE},
+        colorInactive = {RULE_INACTIVE_RED, RULE_INACTIVE_GREEN, RULE_INACTIVE_BLUE},
+        colorStale = {NODE_STALE_RED, NODE_STALE_GREEN, NODE_STALE_BLUE};
 
     LL_iterator(datastore->rules, rule_elem) {
         Rule* rule = rule_elem->ptr;
@@ -275,8 +346,10 @@ bool executeRules (Datastore* datastore, bool uploadValues, list* queryList) {
                 uploadActuatorValue(actuator, active, queryList);
             }
 
+            // Actuators of a node that stopped reporting are drawn gray
             Pixel* pixel = getActuatorPixel(actuator);
-            if (setPixelColor(pixel, active ? &colorActive : &colorInactive)) {
+            Color* color = isNodeStale(actuator->parentNode) ? &colorStale : active ? &colorActive : &colorInactive;
+            if (setPixelColor(pixel, color)) {
                 return true;
             }
         }
@@ -332,6 +405,8 @@ bool addProfileToRule (Rule* rule, Profile* profile) {
         return true;
     }
 
+    invalidateRuleProgram(rule->parentDatastore);
+
     return false;
 }
 
@@ -343,6 +418,7 @@ bool removeProfileFromRule (Rule* rule, Profile* profile) {
     LL_iterator(rule->profiles, rule_profile_elem) {
         Profile* rule_profile = (Profile*)rule_profile_elem->ptr;
         if (rule_profile == profile) {
+            invalidateRuleProgram(rule->parentDatastore);
             list_element* res = listRemove(rule->profiles, rule_profile_elem);
             if (res == NULL && listSize(rule->profiles)) {
                 // TODO check this for logic error
@@ -18,6 +18,22 @@ typedef struct _rule Rule;
 #define TYPE_RULE_EQUAL_TO      2
 #define TYPE_RULE_WITHIN_MARGIN 3
 
+// Operations over the readings of the last 'window' ms. Need a sensor history.
+#define TYPE_RULE_RATE_OF_CHANGE    4   // Newest and oldest readings differ by more than value
+#define TYPE_RULE_MOVING_AVERAGE    5   // Mean of the readings greater than value
+#define TYPE_RULE_SUSTAINED_ABOVE   6   // Every reading greater than value for the whole window
+#define TYPE_RULE_COUNT_ABOVE       7   // At least 'count' readings greater than value
+
+#define isWindowRuleOperation(operation) ((operation) >= TYPE_RULE_RATE_OF_CHANGE && (operation) <= TYPE_RULE_COUNT_ABOVE)
+
+// Actuator pixel colors
+#define RULE_ACTIVE_RED         0
+#define RULE_ACTIVE_GREEN       255
+#define RULE_ACTIVE_BLUE        0
+#define RULE_INACTIVE_RED       255
+#define RULE_INACTIVE_GREEN     0
+#define RULE_INACTIVE_BLUE      0
+
 
 /**
  * @brief Structure to hold a rule for actuator control
@@ -35,6 +51,13 @@ struct _rule {
     uint16_t value;
     list* childs;
     list* profiles;
+    uint16_t priority;
+    uint16_t hysteresis;
+    uint32_t minOnTime;
+    uint32_t minOffTime;
+    uint8_t operand;
+    uint32_t window;
+    uint16_t count;
 };
 
 /**
@@ -78,6 +101,82 @@ bool addSensorToRule (Rule* rule, Sensor* sensor);
  */
 bool addActuatorToRule (Rule* rule, Actuator* actuator);
 
+/**
+ * @brief Sets the priority of the rule, used when several rules drive the same actuator
+ * 
+ * @param rule Pointer to the Rule object
+ * @param priority Priority of the rule. Higher wins.
+ * @return true Error
+ * @return false All good
+ */
+bool setRulePriority (Rule* rule, uint16_t priority);
+
+/**
+ * @brief Sets the hysteresis of the rule: once a sensor verifies the condition, it keeps
+ * verifying it until it moves back past the rule value by more than the hysteresis
+ * 
+ * @param rule Pointer to the Rule object
+ * @param hysteresis Width of the band, in the same units as the rule value
+ * @return true Error
+ * @return false All good
+ */
+bool setRuleHysteresis (Rule* rule, uint16_t hysteresis);
+
+/**
+ * @brief Sets the minimum time the rule has to stay active or inactive before switching again
+ * 
+ * @param rule Pointer to the Rule object
+ * @param minOnTime Minimum time active, in milliseconds
+ * @param minOffTime Minimum time inactive, in milliseconds
+ * @return true Error
+ * @return false All good
+ */
+bool setRuleDwellTimes (Rule* rule, uint32_t minOnTime, uint32_t minOffTime);
+
+/**
+ * @brief Selects which value of its sensors the rule compares: the latest reading or an aggregate of their history
+ * 
+ * @param rule Pointer to the Rule object
+ * @param operand SENSOR_OPERAND_* value
+ * @return true Error
+ * @return false All good
+ */
+bool setRuleOperand (Rule* rule, uint8_t operand);
+
+/**
+ * @brief Sets the window of the windowed operations (TYPE_RULE_RATE_OF_CHANGE and up)
+ * 
+ * @param rule Pointer to the Rule object
+ * @param window Length of the window, in milliseconds
+ * @param count Number of readings over the rule value needed by TYPE_RULE_COUNT_ABOVE
+ * @return true Error
+ * @return false All good
+ */
+bool setRuleWindow (Rule* rule, uint32_t window, uint16_t count);
+
+/**
+ * @brief Tests a sensor value against a rule value given the rule operation
+ * 
+ * @param operation Rule operation
+ * @param val Value of the sensor
+ * @param value Rule value
+ * @return true Condition verified
+ * @return false Condition not verified, invalid or windowed operation
+ */
+bool testRuleCondition (uint16_t operation, float val, uint16_t value);
+
+/**
+ * @brief Evaluates a rule by walking its tree, without the compiled program.
+ * Used by executeRules when the rules can not be compiled.
+ *
+ * @param rule Pointer to the Rule object
+ * @param uploadValues Upload the sensor values to the DB
+ * @param queryList List of prepared DB queries
+ * @return true Rule verified
+ * @return false Rule not verified
+ */
+bool evaluateRule (Rule* rule, bool uploadValues, list* queryList);
+
 /**
  * @brief Execute the control rules
  * 
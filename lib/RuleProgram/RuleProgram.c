@@ -0,0 +1,620 @@
+#include "RuleProgram.h"
+#include "DBLink.h"
+#include "Clock.h"
+
+#define RULE_PROGRAM_INITIAL_SIZE 64
+
+RuleInstruction* emitInstruction (RuleProgram* program, uint8_t opcode) {
+    if (program->length == program->reserved) {
+        uint32_t reserved = program->reserved ? program->reserved*2 : RULE_PROGRAM_INITIAL_SIZE;
+        RuleInstruction* code = (RuleInstruction*)realloc(program->code, reserved*sizeof(RuleInstruction));
+        if (!code) {
+            return NULL;
+        }
+        program->code = code;
+        program->reserved = reserved;
+    }
+
+    RuleInstruction* instruction = &program->code[program->length++];
+    instruction->opcode = opcode;
+    instruction->operation = 0;
+    instruction->value = 0;
+    instruction->target = RULE_TARGET_PENDING;
+    instruction->leaf = 0;
+    instruction->slot = 0;
+    instruction->operand.sensor = NULL;
+
+    return instruction;
+}
+
+int32_t findActuatorSlot (RuleProgram* program, Actuator* actuator) {
+    // The slot kept by the actuator may come from an older program, it is ours only if it maps back
+    if (actuator->slot < program->nActuators && program->actuators[actuator->slot] == actuator) {
+        return actuator->slot;
+    }
+
+    if (program->nActuators == program->reservedActuators) {
+        uint32_t reserved = program->reservedActuators ? program->reservedActuators*2 : RULE_PROGRAM_INITIAL_SIZE;
+        Actuator** actuators = (Actuator**)realloc(program->actuators, reserved*sizeof(Actuator*));
+        if (!actuators) {
+            return -1;
+        }
+        program->actuators = actuators;
+        program->reservedActuators = reserved;
+    }
+    program->actuators[program->nActuators] = actuator;
+    actuator->slot = program->nActuators;
+
+    return program->nActuators++;
+}
+
+bool emitProfileGate (RuleProgram* program, Rule* rule) {
+    // Any active profile jumps over the final FAIL
+    if (listSize(rule->profiles)) {
+        uint32_t gateStart = program->length;
+
+        LL_iterator(rule->profiles, profile_elem) {
+            RuleInstruction* instruction = emitInstruction(program, RULE_OP_PROFILE);
+            if (!instruction) {
+                return true;
+            }
+            instruction->operand.profile = profile_elem->ptr;
+        }
+
+        if (!emitInstruction(program, RULE_OP_FAIL)) {
+            return true;
+        }
+
+        for (uint32_t pc = gateStart; pc < program->length-1; pc++) {
+            program->code[pc].target = program->length;
+        }
+    }
+
+    return false;
+}
+
+bool emitCondition (RuleProgram* program, Rule* rule);
+
+bool emitConditionBody (RuleProgram* program, Rule* rule) {
+    // Mirrors evaluateRule: the first child decides the outcome
+    list_element* child_elem = listStart(rule->childs);
+    if (child_elem) {
+        if (emitCondition(program, child_elem->ptr)) {
+            return true;
+        }
+    }
+
+    LL_iterator(rule->sensors, sensor_elem) {
+        int32_t leaf = addLeafToBatch(program->leaves, sensor_elem->ptr, rule);
+        if (leaf < 0) {
+            return true;
+        }
+
+        RuleInstruction* instruction = emitInstruction(program, RULE_OP_COMPARE);
+        if (!instruction) {
+            return true;
+        }
+        instruction->operation = rule->operation;
+        instruction->value = rule->value;
+        instruction->leaf = leaf;
+        instruction->operand.sensor = sensor_elem->ptr;
+    }
+
+    return false;
+}
+
+bool emitCondition (RuleProgram* program, Rule* rule) {
+    return emitProfileGate(program, rule) || emitConditionBody(program, rule);
+}
+
+bool addSegmentGates (RuleProgram* program, RuleSegment* segment, Rule* rule) {
+    segment->gateStart = program->nGates;
+
+    if (listSize(rule->profiles)) {
+        Profile** gates = (Profile**)realloc(program->gates, (program->nGates + listSize(rule->profiles))*sizeof(Profile*));
+        if (!gates) {
+            return true;
+        }
+        program->gates = gates;
+
+        LL_iterator(rule->profiles, profile_elem) {
+            program->gates[program->nGates++] = profile_elem->ptr;
+        }
+    }
+
+    segment->gateEnd = program->nGates;
+
+    return false;
+}
+
+void updateSegmentGate (RuleProgram* program, RuleSegment* segment) {
+    // Rules without profiles are always awake
+    bool dormant = segment->gateEnd > segment->gateStart;
+    for (uint32_t i = segment->gateStart; i < segment->gateEnd && dormant; i++) {
+        dormant = !isProfileActive(program->gates[i]);
+    }
+    segment->dormant = dormant;
+}
+
+bool indexProfileGates (RuleProgram* program) {
+    program->profiles = (Profile**)malloc((program->nGates+1)*sizeof(Profile*));
+    program->profileOffsets = (uint32_t*)calloc(program->nGates+2, sizeof(uint32_t));
+    program->profileSegments = (uint32_t*)malloc((program->nGates+1)*sizeof(uint32_t));
+    uint32_t* fill = (uint32_t*)malloc((program->nGates+1)*sizeof(uint32_t));
+    if (!program->profiles || !program->profileOffsets || !program->profileSegments || !fill) {
+        free(fill);
+        return true;
+    }
+
+    // Number the distinct profiles, as actuators get their slots, and count the gates of each one
+    for (uint32_t gate = 0; gate < program->nGates; gate++) {
+        Profile* profile = program->gates[gate];
+        if (profile->slot >= program->nProfiles || program->profiles[profile->slot] != profile) {
+            profile->slot = program->nProfiles;
+            program->profiles[program->nProfiles++] = profile;
+        }
+        program->profileOffsets[profile->slot + 1]++;
+    }
+
+    for (uint32_t p = 0; p < program->nProfiles; p++) {
+        program->profileOffsets[p + 1] += program->profileOffsets[p];
+        fill[p] = program->profileOffsets[p];
+    }
+
+    for (uint32_t i = 0; i < program->nRules; i++) {
+        RuleSegment* segment = &program->segments[i];
+        for (uint32_t gate = segment->gateStart; gate < segment->gateEnd; gate++) {
+            program->profileSegments[fill[program->gates[gate]->slot]++] = i;
+        }
+    }
+
+    free(fill);
+
+    return false;
+}
+
+RuleProgram* compileRules (Datastore* datastore) {
+    if (!datastore) {
+        return NULL;
+    }
+
+    RuleProgram* program = (RuleProgram*)malloc(sizeof(RuleProgram));
+    if (!program) {
+        return NULL;
+    }
+
+    program->code = NULL;
+    program->length = 0;
+    program->reserved = 0;
+    program->nRules = 0;
+    program->nPartitions = 0;
+    program->partitionOffsets = NULL;
+    program->partitionSegments = NULL;
+    program->nProfiles = 0;
+    program->profiles = NULL;
+    program->profileOffsets = NULL;
+    program->profileSegments = NULL;
+    program->actuatorPolicy = datastore->actuatorPolicy;
+    program->nActuators = 0;
+    program->reservedActuators = 0;
+    program->actuators = NULL;
+    program->commands = NULL;
+    program->nGates = 0;
+    program->gates = NULL;
+    program->now = 0;
+    program->segments = (RuleSegment*)malloc((listSize(datastore->rules)+1)*sizeof(RuleSegment));
+    program->leaves = createLeafBatch();
+    if (!program->leaves || !program->segments) {
+        deleteLeafBatch(program->leaves);
+        free(program->segments);
+        free(program);
+        return NULL;
+    }
+
+    LL_iterator(datastore->rules, rule_elem) {
+        Rule* rule = rule_elem->ptr;
+        RuleSegment* segment = &program->segments[program->nRules];
+        uint32_t ruleStart = program->length;
+
+        // The profile gate of a top level rule is kept by the segment, not in the code
+        if (addSegmentGates(program, segment, rule) ||
+            !emitInstruction(program, RULE_OP_BEGIN) ||
+            emitConditionBody(program, rule)) {
+
+            deleteRuleProgram(program);
+            return NULL;
+        }
+
+        // Every failed condition lands on the actuator block with a cleared accumulator
+        uint32_t failTarget = program->length;
+        for (uint32_t pc = ruleStart; pc < program->length; pc++) {
+            if (program->code[pc].target == RULE_TARGET_PENDING) {
+                program->code[pc].target = program->length;
+            }
+        }
+
+        LL_iterator(rule->actuators, actuator_elem) {
+            RuleInstruction* instruction = emitInstruction(program, RULE_OP_SET_ACTUATOR);
+            int32_t slot = findActuatorSlot(program, actuator_elem->ptr);
+            if (!instruction || slot < 0) {
+                deleteRuleProgram(program);
+                return NULL;
+            }
+            instruction->value = rule->priority;
+            instruction->slot = slot;
+            instruction->operand.actuator = actuator_elem->ptr;
+        }
+
+        segment->start = ruleStart;
+        segment->fail = failTarget;
+        segment->end = program->length;
+        segment->active = false;
+        segment->since = 0;
+        segment->minOnTime = rule->minOnTime;
+        segment->minOffTime = rule->minOffTime;
+        updateSegmentGate(program, segment);
+        program->nRules++;
+    }
+
+    program->commands = (ActuatorCommand*)calloc(program->nActuators+1, sizeof(ActuatorCommand));
+    if (!program->commands || indexProfileGates(program)) {
+        deleteRuleProgram(program);
+        return NULL;
+    }
+
+    return program;
+}
+
+bool deleteRuleProgram (RuleProgram* program) {
+    if (!program) {
+        return true;
+    }
+
+    deleteLeafBatch(program->leaves);
+    free(program->partitionOffsets);
+    free(program->partitionSegments);
+    free(program->profiles);
+    free(program->profileOffsets);
+    free(program->profileSegments);
+    free(program->segments);
+    free(program->gates);
+    free(program->actuators);
+    free(program->commands);
+    free(program->code);
+    free(program);
+
+    return false;
+}
+
+void resolveActuatorCommand (ActuatorCommand* command, uint8_t policy, bool active, uint16_t priority) {
+    if (command->written) {
+        switch (policy) {
+            case ACTUATOR_POLICY_ANY_TRUE:
+                active |= command->active;
+                break;
+
+            case ACTUATOR_POLICY_PRIORITY:
+                if (priority < command->priority) {
+                    return;
+                }
+                break;
+        }
+    }
+
+    command->written = true;
+    command->active = active;
+    command->priority = priority;
+}
+
+bool executeRuleSegment (RuleProgram* program, RuleSegment* segment, bool uploadValues, list* queryList) {
+    const LeafBatch* leaves = program->leaves;
+    const RuleInstruction* code = program->code;
+    const uint32_t fail = segment->fail;
+    bool accumulator = false;
+    uint32_t pc = segment->dormant ? fail : segment->start;
+
+    while (pc < fail) {
+        const RuleInstruction* instruction = &code[pc];
+
+        switch (instruction->opcode) {
+            case RULE_OP_BEGIN:
+                accumulator = true;
+                pc++;
+                break;
+
+            case RULE_OP_PROFILE:
+                pc = isProfileActive(instruction->operand.profile) ? instruction->target : pc+1;
+                break;
+
+            case RULE_OP_FAIL:
+                accumulator = false;
+                pc = instruction->target;
+                break;
+
+            case RULE_OP_COMPARE:
+                if (uploadValues) {
+                    uploadSensorValue(instruction->operand.sensor, getSensorValue(instruction->operand.sensor), queryList);
+                }
+
+                if (isLeafSatisfied(leaves, instruction->leaf)) {
+                    pc++;
+                }
+                else {
+                    accumulator = false;
+                    pc = instruction->target;
+                }
+                break;
+
+            default:
+                return true;
+        }
+    }
+
+    // Minimum dwell: the rule keeps its state until it has held it long enough
+    if (accumulator != segment->active) {
+        uint32_t dwell = segment->active ? segment->minOnTime : segment->minOffTime;
+        if (segment->since && program->now - segment->since < dwell) {
+            accumulator = segment->active;
+        }
+        else {
+            segment->active = accumulator;
+            segment->since = program->now;
+        }
+    }
+
+    for (pc = fail; pc < segment->end; pc++) {
+        const RuleInstruction* instruction = &code[pc];
+        if (instruction->opcode != RULE_OP_SET_ACTUATOR) {
+            return true;
+        }
+        resolveActuatorCommand(&program->commands[instruction->slot], program->actuatorPolicy, accumulator, instruction->value);
+    }
+
+    return false;
+}
+
+bool beginRulePass (RuleProgram* program) {
+    if (!program) {
+        return true;
+    }
+
+    program->now = getMonotonicTime();
+
+    // Evaluate every leaf condition in one pass before walking the instructions
+    return evaluateLeafBatch(program->leaves, program->now);
+}
+
+bool executeRuleProgram (RuleProgram* program, bool uploadValues, list* queryList) {
+    if (beginRulePass(program)) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < program->nRules; i++) {
+        if (executeRuleSegment(program, &program->segments[i], uploadValues, queryList)) {
+            return true;
+        }
+    }
+
+    return applyActuatorCommands(program, uploadValues, queryList);
+}
+
+bool applyActuatorCommands (RuleProgram* program, bool uploadValues, list* queryList) {
+    if (!program) {
+        return true;
+    }
+
+    Color colorActive = {RULE_ACTIVE_RED, RULE_ACTIVE_GREEN, RULE_ACTIVE_BLUE},
+        colorInactive = {RULE_INACTIVE_RED, RULE_INACTIVE_GREEN, RULE_INACTIVE_BLUE},
+        colorStale = {NODE_STALE_RED, NODE_STALE_GREEN, NODE_STALE_BLUE};
+
+    bool error = false;
+    for (uint32_t slot = 0; slot < program->nActuators; slot++) {
+        ActuatorCommand* command = &program->commands[slot];
+        if (!command->written) {
+            continue;
+        }
+        command->written = false;
+
+        if (uploadValues) {
+            uploadActuatorValue(program->actuators[slot], command->active, queryList);
+        }
+
+        // Actuators of a node that stopped reporting are drawn gray
+        Actuator* actuator = program->actuators[slot];
+        Color* color = isNodeStale(actuator->parentNode) ? &colorStale : command->active ? &colorActive : &colorInactive;
+        error |= setPixelColor(getActuatorPixel(actuator), color);
+    }
+
+    return error;
+}
+
+bool executeRulePartition (RuleProgram* program, uint32_t partition, bool uploadValues, list* queryList) {
+    if (!program || partition >= program->nPartitions) {
+        return true;
+    }
+
+    for (uint32_t i = program->partitionOffsets[partition]; i < program->partitionOffsets[partition+1]; i++) {
+        if (executeRuleSegment(program, &program->segments[program->partitionSegments[i]], uploadValues, queryList)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+typedef struct {
+    Actuator* actuator;
+    uint32_t rule;
+} ActuatorUse;
+
+int compareActuatorUse (const void* a, const void* b) {
+    const ActuatorUse *useA = a,
+        *useB = b;
+
+    if (useA->actuator != useB->actuator) {
+        return (uintptr_t)useA->actuator < (uintptr_t)useB->actuator ? -1 : 1;
+    }
+    return (useA->rule > useB->rule) - (useA->rule < useB->rule);
+}
+
+typedef struct {
+    uint64_t weight;
+    uint32_t root;
+} RuleComponent;
+
+int compareRuleComponent (const void* a, const void* b) {
+    const RuleComponent *componentA = a,
+        *componentB = b;
+
+    // Heaviest first, ties in rule order
+    if (componentA->weight != componentB->weight) {
+        return componentA->weight > componentB->weight ? -1 : 1;
+    }
+    return (componentA->root > componentB->root) - (componentA->root < componentB->root);
+}
+
+uint32_t findComponent (uint32_t* parent, uint32_t rule) {
+    while (parent[rule] != rule) {
+        parent[rule] = parent[parent[rule]];
+        rule = parent[rule];
+    }
+    return rule;
+}
+
+bool partitionRuleProgram (RuleProgram* program, uint32_t nPartitions) {
+    if (!program || !nPartitions) {
+        return true;
+    }
+
+    uint32_t nRules = program->nRules,
+        nUses = 0;
+
+    for (uint32_t pc = 0; pc < program->length; pc++) {
+        nUses += (program->code[pc].opcode == RULE_OP_SET_ACTUATOR);
+    }
+
+    ActuatorUse* uses = (ActuatorUse*)malloc((nUses+1)*sizeof(ActuatorUse));
+    uint32_t* parent = (uint32_t*)malloc((nRules+1)*sizeof(uint32_t));
+    uint64_t* weight = (uint64_t*)calloc(nRules+1, sizeof(uint64_t));
+    uint64_t* load = (uint64_t*)calloc(nPartitions, sizeof(uint64_t));
+    uint32_t* assignment = (uint32_t*)malloc((nRules+1)*sizeof(uint32_t));
+    uint32_t* offsets = (uint32_t*)calloc(nPartitions+1, sizeof(uint32_t));
+    uint32_t* segments = (uint32_t*)malloc((nRules+1)*sizeof(uint32_t));
+    RuleComponent* components = (RuleComponent*)malloc((nRules+1)*sizeof(RuleComponent));
+    if (!uses || !parent || !weight || !load || !assignment || !offsets || !segments || !components) {
+        free(uses);
+        free(parent);
+        free(weight);
+        free(load);
+        free(assignment);
+        free(offsets);
+        free(segments);
+        free(components);
+        return true;
+    }
+
+    // Rules driving the same actuator belong to the same connected component
+    nUses = 0;
+    for (uint32_t rule = 0; rule < nRules; rule++) {
+        parent[rule] = rule;
+        for (uint32_t pc = program->segments[rule].start; pc < program->segments[rule].end; pc++) {
+            if (program->code[pc].opcode == RULE_OP_SET_ACTUATOR) {
+                uses[nUses].actuator = program->code[pc].operand.actuator;
+                uses[nUses].rule = rule;
+                nUses++;
+            }
+        }
+    }
+
+    qsort(uses, nUses, sizeof(ActuatorUse), compareActuatorUse);
+    for (uint32_t i = 1; i < nUses; i++) {
+        if (uses[i].actuator == uses[i-1].actuator) {
+            uint32_t a = findComponent(parent, uses[i-1].rule),
+                b = findComponent(parent, uses[i].rule);
+            if (a != b) {
+                parent[b] = a;
+            }
+        }
+    }
+
+    for (uint32_t rule = 0; rule < nRules; rule++) {
+        weight[findComponent(parent, rule)] += program->segments[rule].end - program->segments[rule].start;
+    }
+
+    // Greedy balance: each component goes to the least loaded partition, heaviest first
+    uint32_t nComponents = 0;
+    for (uint32_t rule = 0; rule < nRules; rule++) {
+        if (parent[rule] == rule) {
+            components[nComponents].weight = weight[rule];
+            components[nComponents].root = rule;
+            nComponents++;
+        }
+    }
+    qsort(components, nComponents, sizeof(RuleComponent), compareRuleComponent);
+
+    for (uint32_t i = 0; i < nComponents; i++) {
+        uint32_t lightest = 0;
+        for (uint32_t partition = 1; partition < nPartitions; partition++) {
+            if (load[partition] < load[lightest]) {
+                lightest = partition;
+            }
+        }
+        assignment[components[i].root] = lightest;
+        load[lightest] += components[i].weight;
+    }
+
+    // Lay the segments of each partition out in rule order
+    for (uint32_t rule = 0; rule < nRules; rule++) {
+        offsets[assignment[findComponent(parent, rule)] + 1]++;
+    }
+    for (uint32_t partition = 0; partition < nPartitions; partition++) {
+        offsets[partition+1] += offsets[partition];
+    }
+    for (uint32_t partition = 0; partition < nPartitions; partition++) {
+        load[partition] = offsets[partition];
+    }
+    for (uint32_t rule = 0; rule < nRules; rule++) {
+        uint32_t partition = assignment[findComponent(parent, rule)];
+        segments[load[partition]++] = rule;
+    }
+
+    free(program->partitionOffsets);
+    free(program->partitionSegments);
+    program->nPartitions = nPartitions;
+    program->partitionOffsets = offsets;
+    program->partitionSegments = segments;
+
+    free(uses);
+    free(parent);
+    free(weight);
+    free(load);
+    free(assignment);
+    free(components);
+
+    return false;
+}
+
+void wakeRuleSegments (RuleProgram* program, Profile* profile) {
+    if (!program || !profile) {
+        return;
+    }
+
+    // Profiles gating no rule have no slot in this program
+    uint32_t slot = profile->slot;
+    if (slot >= program->nProfiles || program->profiles[slot] != profile) {
+        return;
+    }
+
+    for (uint32_t i = program->profileOffsets[slot]; i < program->profileOffsets[slot + 1]; i++) {
+        updateSegmentGate(program, &program->segments[program->profileSegments[i]]);
+    }
+}
+
+void invalidateRuleProgram (Datastore* datastore) {
+    if (!datastore || !datastore->program) {
+        return;
+    }
+
+    deleteRuleProgram(datastore->program);
+    datastore->program = NULL;
+}
@@ -0,0 +1,212 @@
+#ifndef __RULE_PROGRAM__
+#define __RULE_PROGRAM__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "LinkedList.h"
+
+typedef struct _rule_program RuleProgram;
+typedef struct _rule_instruction RuleInstruction;
+typedef struct _rule_segment RuleSegment;
+typedef struct _actuator_command ActuatorCommand;
+
+#include "Datastore.h"
+#include "Rule.h"
+#include "Sensor.h"
+#include "Actuator.h"
+#include "Profile.h"
+#include "LeafBatch.h"
+
+#define RULE_OP_BEGIN           0   // Start of a top level rule. Sets the accumulator.
+#define RULE_OP_PROFILE         1   // Jumps to target if the profile is active. Used by child rules, top level gates live in the segment.
+#define RULE_OP_FAIL            2   // Clears the accumulator and jumps to target.
+#define RULE_OP_COMPARE         3   // Tests a leaf condition of the batch. Clears the accumulator and jumps to target if false.
+#define RULE_OP_SET_ACTUATOR    4   // Records the accumulator as a command for an actuator slot.
+
+#define RULE_TARGET_PENDING     UINT32_MAX
+
+
+/**
+ * @brief Single instruction of a compiled rule program.
+ * SET_ACTUATOR keeps the rule priority in value.
+ *
+ */
+struct _rule_instruction {
+    uint8_t opcode;
+    uint8_t operation;
+    uint16_t value;
+    uint32_t target;
+    uint32_t leaf;
+    uint32_t slot;
+    union {
+        Sensor* sensor;
+        Actuator* actuator;
+        Profile* profile;
+    } operand;
+};
+
+/**
+ * @brief Instructions [start, end) of a top level rule.
+ * The profiles gating the rule are gates[gateStart] up to gates[gateEnd-1].
+ * While none of them is active the rule is dormant and execution jumps
+ * straight to the actuator block at fail.
+ * active and since (monotonic ms, 0 if never switched) track the rule output
+ * to enforce the minimum on/off times.
+ *
+ */
+struct _rule_segment {
+    uint32_t start;
+    uint32_t end;
+    uint32_t fail;
+    uint32_t gateStart;
+    uint32_t gateEnd;
+    bool dormant;
+    bool active;
+    uint64_t since;
+    uint32_t minOnTime;
+    uint32_t minOffTime;
+};
+
+/**
+ * @brief Outcome requested for an actuator during the current pass
+ *
+ */
+struct _actuator_command {
+    bool written;
+    bool active;
+    uint16_t priority;
+};
+
+/**
+ * @brief Flat, linear representation of all the rules of a Datastore
+ *
+ * Rules are also split in partitions that share no actuator, so each
+ * partition can be run by a different thread with the same outcome.
+ * Partition p runs the segments partitionSegments[partitionOffsets[p]]
+ * up to partitionSegments[partitionOffsets[p+1]-1], in rule order.
+ *
+ * Each distinct profile gating a rule is indexed the same way, so a profile
+ * transition only updates its own rules: profiles[p] gates the segments
+ * profileSegments[profileOffsets[p]] up to profileSegments[profileOffsets[p+1]-1].
+ *
+ * Rules do not drive actuators directly: each distinct actuator has a slot
+ * in the command buffer, rule outputs are resolved there with the actuator
+ * policy, and every actuator is applied once at the end of the pass.
+ *
+ */
+struct _rule_program {
+    RuleInstruction* code;
+    uint32_t length;
+    uint32_t reserved;
+    uint32_t nRules;
+    RuleSegment* segments;
+    uint32_t nGates;
+    Profile** gates;
+    LeafBatch* leaves;
+    uint32_t nPartitions;
+    uint32_t* partitionOffsets;
+    uint32_t* partitionSegments;
+    uint32_t nProfiles;
+    Profile** profiles;
+    uint32_t* profileOffsets;
+    uint32_t* profileSegments;
+    uint8_t actuatorPolicy;
+    uint32_t nActuators;
+    uint32_t reservedActuators;
+    Actuator** actuators;
+    ActuatorCommand* commands;
+    uint64_t now;
+};
+
+/**
+ * @brief Lowers the Rule trees of the datastore into a flat instruction array
+ *
+ * @param datastore Datastore holding the rules to compile
+ * @return RuleProgram* Pointer to the new RuleProgram object. NULL if error.
+ */
+RuleProgram* compileRules (Datastore* datastore);
+
+/**
+ * @brief Delete a RuleProgram object
+ *
+ * @param program Pointer to the RuleProgram object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteRuleProgram (RuleProgram* program);
+
+/**
+ * @brief Starts a pass: reads the clock and evaluates every leaf condition
+ *
+ * @param program Pointer to the RuleProgram object
+ * @return true Error
+ * @return false All good
+ */
+bool beginRulePass (RuleProgram* program);
+
+/**
+ * @brief Runs every instruction of the program once, then applies the actuator commands
+ *
+ * @param program Pointer to the RuleProgram object
+ * @param uploadValues Upload the sensor and actuator values to the DB
+ * @param queryList List of prepared DB queries
+ * @return true Error
+ * @return false All good
+ */
+bool executeRuleProgram (RuleProgram* program, bool uploadValues, list* queryList);
+
+/**
+ * @brief Splits the rules of the program in partitions with no actuator in common.
+ * Rules that drive the same actuator (directly or through other rules) always
+ * land on the same partition, keeping their relative order.
+ *
+ * @param program Pointer to the RuleProgram object
+ * @param nPartitions Number of partitions to create
+ * @return true Error
+ * @return false All good
+ */
+bool partitionRuleProgram (RuleProgram* program, uint32_t nPartitions);
+
+/**
+ * @brief Runs the rules of a single partition. beginRulePass must have been called for this pass
+ * and the actuator commands applied once every partition is done.
+ *
+ * @param program Pointer to the RuleProgram object
+ * @param partition Index of the partition to run
+ * @param uploadValues Upload the sensor and actuator values to the DB
+ * @param queryList List of prepared DB queries
+ * @return true Error
+ * @return false All good
+ */
+bool executeRulePartition (RuleProgram* program, uint32_t partition, bool uploadValues, list* queryList);
+
+/**
+ * @brief Drives every actuator written during the pass once with its resolved state,
+ * and clears the command buffer for the next pass
+ *
+ * @param program Pointer to the RuleProgram object
+ * @param uploadValues Upload the actuator values to the DB
+ * @param queryList List of prepared DB queries
+ * @return true Error
+ * @return false All good
+ */
+bool applyActuatorCommands (RuleProgram* program, bool uploadValues, list* queryList);
+
+/**
+ * @brief Updates the dormant state of the rules gated by a profile, after the profile changed state
+ *
+ * @param program Pointer to the RuleProgram object. May be NULL.
+ * @param profile Profile that changed state
+ */
+void wakeRuleSegments (RuleProgram* program, Profile* profile);
+
+/**
+ * @brief Drops the compiled program of the datastore so it gets rebuilt on the next execution
+ *
+ * @param datastore Pointer to the Datastore object
+ */
+void invalidateRuleProgram (Datastore* datastore);
+
+#endif
@@ -0,0 +1,153 @@
+#include "RuleWorkers.h"
+
+void* thread_ruleWorker (void* arg) {
+    RuleWorker* worker = arg;
+    RuleWorkers* workers = worker->parentWorkers;
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&workers->mutex);
+    while (true) {
+        while (workers->active && workers->generation == generation) {
+            pthread_cond_wait(&workers->start, &workers->mutex);
+        }
+        if (!workers->active) {
+            break;
+        }
+        generation = workers->generation;
+
+        RuleProgram* program = workers->program;
+        bool uploadValues = workers->uploadValues;
+        list* queryList = workers->queryList;
+        pthread_mutex_unlock(&workers->mutex);
+
+        bool error = executeRulePartition(program, worker->index, uploadValues, queryList);
+
+        pthread_mutex_lock(&workers->mutex);
+        workers->error |= error;
+        if (--workers->pending == 0) {
+            pthread_cond_signal(&workers->done);
+        }
+    }
+    pthread_mutex_unlock(&workers->mutex);
+
+    return NULL;
+}
+
+RuleWorkers* createRuleWorkers (uint32_t nThreads) {
+    if (!nThreads || nThreads > RULE_WORKERS_MAX_THREADS) {
+        return NULL;
+    }
+
+    RuleWorkers* workers = (RuleWorkers*)malloc(sizeof(RuleWorkers));
+    if (!workers) {
+        return NULL;
+    }
+
+    workers->workers = (RuleWorker*)malloc(nThreads*sizeof(RuleWorker));
+    if (!workers->workers) {
+        free(workers);
+        return NULL;
+    }
+
+    pthread_mutex_init(&workers->mutex, NULL);
+    pthread_cond_init(&workers->start, NULL);
+    pthread_cond_init(&workers->done, NULL);
+    workers->nThreads = 1;
+    workers->generation = 0;
+    workers->pending = 0;
+    workers->active = true;
+    workers->error = false;
+    workers->program = NULL;
+    workers->uploadValues = false;
+    workers->queryList = NULL;
+
+    // Worker 0 is the calling thread
+    for (uint32_t i = 1; i < nThreads; i++) {
+        RuleWorker* worker = &workers->workers[i];
+        worker->parentWorkers = workers;
+        worker->index = i;
+        if (pthread_create(&worker->thread, NULL, &thread_ruleWorker, worker)) {
+            deleteRuleWorkers(workers);
+            return NULL;
+        }
+        workers->nThreads++;
+    }
+
+    return workers;
+}
+
+bool deleteRuleWorkers (RuleWorkers* workers) {
+    if (!workers) {
+        return true;
+    }
+
+    pthread_mutex_lock(&workers->mutex);
+    workers->active = false;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->mutex);
+
+    for (uint32_t i = 1; i < workers->nThreads; i++) {
+        pthread_join(workers->workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&workers->start);
+    pthread_cond_destroy(&workers->done);
+    pthread_mutex_destroy(&workers->mutex);
+    free(workers->workers);
+    free(workers);
+
+    return false;
+}
+
+bool executeRulesOnWorkers (RuleWorkers* workers, Datastore* datastore, bool uploadValues, list* queryList) {
+    if (!datastore) {
+        return true;
+    }
+
+    if (!workers || workers->nThreads < 2) {
+        return executeRules(datastore, uploadValues, queryList);
+    }
+
+    if (updateProfileSchedule(datastore) || updateNodeLiveness(datastore)) {
+        return true;
+    }
+
+    if (!datastore->program) {
+        datastore->program = compileRules(datastore);
+    }
+    RuleProgram* program = datastore->program;
+    if (!program ||
+        (program->nPartitions != workers->nThreads && partitionRuleProgram(program, workers->nThreads))) {
+
+        return executeRules(datastore, uploadValues, queryList);
+    }
+
+    // Leaves are shared by all partitions: evaluate them once
+    if (beginRulePass(program)) {
+        return true;
+    }
+
+    pthread_mutex_lock(&workers->mutex);
+    workers->program = program;
+    workers->uploadValues = uploadValues;
+    workers->queryList = queryList;
+    workers->error = false;
+    workers->pending = workers->nThreads - 1;
+    workers->generation++;
+    pthread_cond_broadcast(&workers->start);
+    pthread_mutex_unlock(&workers->mutex);
+
+    bool error = executeRulePartition(program, 0, uploadValues, queryList);
+
+    pthread_mutex_lock(&workers->mutex);
+    while (workers->pending) {
+        pthread_cond_wait(&workers->done, &workers->mutex);
+    }
+    error |= workers->error;
+    pthread_mutex_unlock(&workers->mutex);
+
+    // Every actuator is driven once, after all partitions resolved their commands
+    error |= applyActuatorCommands(program, uploadValues, queryList);
+
+    return error;
+}
@@ -0,0 +1,80 @@
+#ifndef __RULE_WORKERS__
+#define __RULE_WORKERS__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "LinkedList.h"
+
+typedef struct _rule_workers RuleWorkers;
+typedef struct _rule_worker RuleWorker;
+
+#include "Datastore.h"
+#include "RuleProgram.h"
+
+#define RULE_WORKERS_MAX_THREADS 64
+
+
+/**
+ * @brief A single thread of the pool
+ *
+ */
+struct _rule_worker {
+    RuleWorkers* parentWorkers;
+    uint32_t index;
+    pthread_t thread;
+};
+
+/**
+ * @brief Small pool of threads that run the partitions of a RuleProgram in parallel.
+ * The calling thread runs partition 0, worker i runs partition i.
+ *
+ */
+struct _rule_workers {
+    uint32_t nThreads;
+    RuleWorker* workers;
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t generation;
+    uint32_t pending;
+    bool active;
+    bool error;
+    RuleProgram* program;
+    bool uploadValues;
+    list* queryList;
+};
+
+/**
+ * @brief Create a RuleWorkers object and start its threads
+ *
+ * @param nThreads Total number of threads evaluating rules, including the caller
+ * @return RuleWorkers* Pointer to the new RuleWorkers object. NULL if error.
+ */
+RuleWorkers* createRuleWorkers (uint32_t nThreads);
+
+/**
+ * @brief Stop the threads and delete a RuleWorkers object
+ *
+ * @param workers Pointer to the RuleWorkers object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteRuleWorkers (RuleWorkers* workers);
+
+/**
+ * @brief Execute the control rules of the datastore, spreading independent rules over the pool.
+ * Falls back to executeRules when the pool has a single thread.
+ *
+ * @param workers Pointer to the RuleWorkers object
+ * @param datastore Pointer to the Datastore object
+ * @param uploadValues Upload the sensor and actuator values to the DB
+ * @param queryList List of prepared DB queries
+ * @return true Error
+ * @return false All good
+ */
+bool executeRulesOnWorkers (RuleWorkers* workers, Datastore* datastore, bool uploadValues, list* queryList);
+
+#endif
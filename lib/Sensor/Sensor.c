@@ -1,7 +1,15 @@
 #include "Sensor.h"
+#include "RuleProgram.h"
+#include "ColorBatch.h"
+#include "Clock.h"
+
+pthread_mutex_t sensorValueTablesMutex = PTHREAD_MUTEX_INITIALIZER;
+float* sensorValueTables[N_TYPE_SENSOR];
+SensorSegment sensorSegments[N_TYPE_SENSOR][SENSOR_MAX_SEGMENTS];
+uint8_t sensorNSegments[N_TYPE_SENSOR];
 
 bool isValidSensorType (uint8_t type) {
-    if (type <= N_TYPE_SENSOR) {
+    if (type < N_TYPE_SENSOR) {
         return true;
     }
 
@@ -59,6 +67,132 @@ sensorValueCalculator* sensorCalculatorFunctionPointer (uint8_t type) {
     return ptr;
 }
 
+const float* getSensorValueTable (uint8_t type) {
+    if (!isValidSensorType(type)) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&sensorValueTablesMutex);
+    if (!sensorValueTables[type]) {
+        sensorValueCalculator* calculator = sensorCalculatorFunctionPointer(type);
+        float* table = (float*)malloc(SENSOR_VALUE_TABLE_SIZE*sizeof(float));
+        if (table && calculator) {
+            for (uint32_t value = 0; value < SENSOR_VALUE_TABLE_SIZE; value++) {
+                table[value] = calculator(value);
+            }
+
+            // Split the table in monotonic segments so the calculator can be inverted
+            SensorSegment* segments = sensorSegments[type];
+            uint8_t nSegments = 1;
+            int8_t direction = 0;
+            segments[0].start = 0;
+            segments[0].increasing = true;
+            for (uint32_t value = 1; value < SENSOR_VALUE_TABLE_SIZE && nSegments; value++) {
+                int8_t step = (table[value] > table[value-1]) - (table[value] < table[value-1]);
+                if (!step) {
+                    continue;
+                }
+                if (direction && step != direction) {
+                    if (nSegments == SENSOR_MAX_SEGMENTS) {
+                        // Not invertible
+                        nSegments = 0;
+                        break;
+                    }
+                    segments[nSegments-1].end = value-1;
+                    segments[nSegments].start = value;
+                    nSegments++;
+                }
+                direction = step;
+                segments[nSegments-1].increasing = (step > 0);
+            }
+            if (nSegments) {
+                segments[nSegments-1].end = SENSOR_VALUE_TABLE_SIZE-1;
+            }
+            sensorNSegments[type] = nSegments;
+
+            sensorValueTables[type] = table;
+        }
+        else {
+            free(table);
+        }
+    }
+    pthread_mutex_unlock(&sensorValueTablesMutex);
+
+    return sensorValueTables[type];
+}
+
+// Predicates that are monotonic along a segment, false before and true after the searched raw value
+#define SEGMENT_ABOVE           0   // value > bound
+#define SEGMENT_ABOVE_OR_EQUAL  1   // value >= bound
+#define SEGMENT_BELOW           2   // value < bound
+#define SEGMENT_BELOW_OR_EQUAL  3   // value <= bound
+
+uint32_t searchSegment (const float* table, uint32_t start, uint32_t end, uint8_t predicate, float bound) {
+    // First raw value in [start, end] for which the predicate holds. end+1 if none.
+    uint32_t first = start,
+        last = end + 1;
+
+    while (first < last) {
+        uint32_t middle = first + (last - first)/2;
+        float value = table[middle];
+        bool holds = false;
+
+        switch (predicate) {
+            case SEGMENT_ABOVE:             holds = value > bound;  break;
+            case SEGMENT_ABOVE_OR_EQUAL:    holds = value >= bound; break;
+            case SEGMENT_BELOW:             holds = value < bound;  break;
+            case SEGMENT_BELOW_OR_EQUAL:    holds = value <= bound; break;
+        }
+
+        if (holds) {
+            last = middle;
+        }
+        else {
+            first = middle + 1;
+        }
+    }
+
+    return first;
+}
+
+bool invertSensorCalculator (uint8_t type, float low, float high, uint16_t rangeLow[], uint16_t rangeHigh[]) {
+    if (!rangeLow || !rangeHigh) {
+        return true;
+    }
+
+    const float* table = getSensorValueTable(type);
+    if (!table || !sensorNSegments[type]) {
+        return true;
+    }
+
+    for (uint8_t i = 0; i < SENSOR_MAX_SEGMENTS; i++) {
+        // Empty range by default
+        rangeLow[i] = UINT16_MAX;
+        rangeHigh[i] = 0;
+    }
+
+    for (uint8_t i = 0; i < sensorNSegments[type]; i++) {
+        SensorSegment* segment = &sensorSegments[type][i];
+        uint32_t first, firstAfter;
+
+        if (segment->increasing) {
+            first = searchSegment(table, segment->start, segment->end, SEGMENT_ABOVE, low);
+            firstAfter = searchSegment(table, segment->start, segment->end, SEGMENT_ABOVE_OR_EQUAL, high);
+        }
+        else {
+            first = searchSegment(table, segment->start, segment->end, SEGMENT_BELOW, high);
+            firstAfter = searchSegment(table, segment->start, segment->end, SEGMENT_BELOW_OR_EQUAL, low);
+        }
+
+        if (first < firstAfter) {
+            rangeLow[i] = first;
+            rangeHigh[i] = firstAfter - 1;
+        }
+    }
+
+    return false;
+}
+
 Sensor* createSensor (Node* node, uint16_t id, uint8_t type, Position* pos, uint16_t rangeMin, uint16_t rangeMax) {
     if (!node) {
         return NULL;
@@ -70,7 +204,7 @@ Sensor* createSensor (Node* node, uint16_t id, uint8_t type, Position* pos, uint
 
     Room* room = (Room*)node->parentRoom;
     Datastore* datastore = (Datastore*)room->parentDatastore;
-    if (findSensorByID(datastore, id)) {
+    if (!datastore->bulkLoad && findSensorByID(datastore, id)) {
         // There's alreay a sensor with the specified ID.
         return NULL;
     }
@@ -93,9 +227,19 @@ Sensor* createSensor (Node* node, uint16_t id, uint8_t type, Position* pos, uint
         return NULL;
     }
 
+    Gradient* gradient = createDefaultGradient();
+    if (gradient == NULL) {
+        // Memory allocation failed
+        deletePixel(pixel);
+        free(sensor);
+        return NULL;
+    }
+
     if(pthread_mutex_init(&sensor->mutex, NULL)) {
         // Mutex init failed
+        deleteGradient(gradient);
         deletePixel(pixel);
+        free(sensor);
         return NULL;
     }
 
@@ -103,6 +247,7 @@ Sensor* createSensor (Node* node, uint16_t id, uint8_t type, Position* pos, uint
     if (elem == NULL) {
         // Insertion failed
         pthread_mutex_destroy(&sensor->mutex);
+        deleteGradient(gradient);
         deletePixel(pixel);
         free(sensor);
         return NULL;
@@ -113,10 +258,19 @@ Sensor* createSensor (Node* node, uint16_t id, uint8_t type, Position* pos, uint
     sensor->id = id;
     sensor->type = type;
     sensor->calculator = sensorCalculatorFunctionPointer(type);
+    sensor->table = getSensorValueTable(type);
     sensor->value = 0;
     sensor->pixel = pixel;
     sensor->rangeMin = rangeMin;
     sensor->rangeMax = rangeMax;
+    sensor->gradient = gradient;
+    sensor->history = NULL;
+    sensor->lastSeen = getMonotonicTime();
+    sensor->period = 0;
+    sensor->stale = false;
+    sensor->received = 0;
+    sensor->uploaded = 0;
+    invalidateColorBatch(datastore);
 
     return sensor;
 }
@@ -128,6 +282,8 @@ bool deleteSensor (Sensor* sensor) {
 
     // Remove Sensor from existing rules
     Datastore* datastore = sensor->parentNode->parentRoom->parentDatastore;
+    invalidateRuleProgram(datastore);
+    invalidateColorBatch(datastore);
     LL_iterator(datastore->rules, rule_elem) {
         Rule* rule = rule_elem->ptr;
         LL_iterator(rule->sensors, ruleSensor_elem) {
@@ -146,6 +302,7 @@ bool deleteSensor (Sensor* sensor) {
     pthread_mutex_destroy(&sensor->mutex);
 
     deletePixel(sensor->pixel);
+    deleteGradient(sensor->gradient);
 
     free(sensor);
     list_element* res = listRemove(node->sensors, elem);
@@ -156,28 +313,117 @@ bool deleteSensor (Sensor* sensor) {
     return 0;
 }
 
+bool setSensorConversion (Sensor* sensor, uint8_t conversion) {
+    if (!sensor) {
+        return true;
+    }
+
+    switch (conversion) {
+        case SENSOR_CONVERSION_FORMULA:
+            sensor->table = NULL;
+            break;
+        case SENSOR_CONVERSION_TABLE:
+            sensor->table = getSensorValueTable(sensor->type);
+            if (!sensor->table) {
+                return true;
+            }
+            break;
+        default:
+            return true;
+    }
+
+    return false;
+}
+
 bool setSensorValue (Sensor* sensor, uint16_t value) {
     if (!sensor) {
         return 1;
     }
 
-    pthread_mutex_lock(&sensor->mutex);
-    sensor->value = value;
-    pthread_mutex_unlock(&sensor->mutex);
+    // A single 16 bit store, no need to lock the sensor
+    __atomic_store_n(&sensor->value, value, __ATOMIC_RELAXED);
+
+    // The liveness sweeper picks the new timestamps up on its own
+    uint64_t now = getMonotonicTime();
+    __atomic_store_n(&sensor->lastSeen, now, __ATOMIC_RELAXED);
+    __atomic_store_n(&sensor->parentNode->lastSeen, now, __ATOMIC_RELAXED);
+
+    if (sensor->history) {
+        float physical = sensor->table ? sensor->table[value] : (sensor->calculator)(value);
+
+        pthread_mutex_lock(&sensor->mutex);
+        pushSensorSample(sensor->history, now, value, physical);
+        pthread_mutex_unlock(&sensor->mutex);
+    }
     
     return 0;
 }
 
+bool setSensorSample (Sensor* sensor, uint16_t value, uint64_t received) {
+    if (setSensorValue(sensor, value)) {
+        return 1;
+    }
+
+    // Released after the value, so whoever sees the stamp sees the value too
+    __atomic_store_n(&sensor->received, received, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
 float getSensorValue (Sensor* sensor) {
     if (sensor == NULL) {
         return 0;
     }
 
+    uint16_t value = __atomic_load_n(&sensor->value, __ATOMIC_RELAXED);
+    if (sensor->table) {
+        return sensor->table[value];
+    }
+
+    return (sensor->calculator)(value);
+}
+
+float getSensorOperandValue (Sensor* sensor, uint8_t operand) {
+    if (sensor == NULL) {
+        return 0;
+    }
+
+    if (operand == SENSOR_OPERAND_VALUE || !sensor->history) {
+        return getSensorValue(sensor);
+    }
+
+    float value;
     pthread_mutex_lock(&sensor->mutex);
-    float res = (sensor->calculator)(sensor->value);
+    bool error = getSensorHistoryAggregate(sensor->history, operand, &value);
     pthread_mutex_unlock(&sensor->mutex);
 
-    return res;
+    return error ? getSensorValue(sensor) : value;
+}
+
+uint16_t getSensorRawValue (Sensor* sensor) {
+    if (sensor == NULL) {
+        return 0;
+    }
+
+    return __atomic_load_n(&sensor->value, __ATOMIC_RELAXED);
+}
+
+bool setSensorPeriod (Sensor* sensor, uint32_t period) {
+    if (!sensor) {
+        return true;
+    }
+
+    sensor->period = period;
+
+    return watchNodeLiveness(sensor->parentNode);
+}
+
+bool isSensorStale (Sensor* sensor) {
+    if (!sensor) {
+        return false;
+    }
+
+    return sensor->stale;
 }
 
 Pixel* getSensorPixel (Sensor* sensor) {
@@ -226,8 +472,40 @@ Sensor* findSensorByID (Datastore* datastore, uint16_t id) {
     return NULL;
 }
 
-float map(float x, float in_min, float in_max, float out_min, float out_max) {
-    return (x - in_min) * (out_max) / (in_max - in_min) + out_min;
+bool setSensorGradient (Sensor* sensor, const Color* stops, uint8_t nStops) {
+    if (!sensor) {
+        return true;
+    }
+
+    Gradient* gradient = createGradient(stops, nStops);
+    if (!gradient) {
+        return true;
+    }
+
+    // The color batch points at the lookup table being replaced
+    invalidateColorBatch(sensor->parentNode->parentRoom->parentDatastore);
+    deleteGradient(sensor->gradient);
+    sensor->gradient = gradient;
+
+    return false;
+}
+
+bool getSensorColorScale (Sensor* sensor, float* scale, float* offset) {
+    if (!sensor || !scale || !offset) {
+        return true;
+    }
+
+    // An empty range shows every value with the first color
+    if (sensor->rangeMax == sensor->rangeMin) {
+        *scale = 0;
+        *offset = 0;
+        return false;
+    }
+
+    *scale = (float)(GRADIENT_STEPS - 1) / ((float)sensor->rangeMax - sensor->rangeMin);
+    *offset = -(float)sensor->rangeMin * *scale;
+
+    return false;
 }
 
 bool updateSensorPixel (Sensor* sensor) {
@@ -245,15 +523,26 @@ bool updateSensorPixel (Sensor* sensor) {
         return true;
     }
 
-    float sensorValue = getSensorValue(sensor);
+    if (isSensorStale(sensor)) {
+        pthread_mutex_lock(&pixel->mutex);
+        color->r = NODE_STALE_RED;
+        color->g = NODE_STALE_GREEN;
+        color->b = NODE_STALE_BLUE;
+        pthread_mutex_unlock(&pixel->mutex);
+
+        return false;
+    }
+
+    if (!sensor->gradient) {
+        return true;
+    }
 
-    float mappedRed = map(sensorValue, sensor->rangeMin, sensor->rangeMax, 0, 255);
-    //printf("Red: %d  :  %d   :   %f   :   %f\n", sensor->type, sensor->value, sensorValue, mappedRed);
+    float scale, offset;
+    getSensorColorScale(sensor, &scale, &offset);
+    const Color* mapped = &sensor->gradient->lut[getGradientStep(getSensorValue(sensor), scale, offset)];
 
     pthread_mutex_lock(&pixel->mutex);
-    color->r = 0;
-    color->g = 0;
-    color->b = (int)mappedRed;
+    *color = *mapped;
     pthread_mutex_unlock(&pixel->mutex);
 
     return false;
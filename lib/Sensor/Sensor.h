@@ -10,10 +10,15 @@
 
 typedef struct _sensor Sensor;
 
+// Max number of monotonic segments of a value calculator
+#define SENSOR_MAX_SEGMENTS 2
+
 #include "Pixel.h"
 #include "Rule.h"
 #include "Node.h"
 #include "Position.h"
+#include "SensorHistory.h"
+#include "Gradient.h"
 
 #define N_TYPE_SENSOR           5
 #define TYPE_SENSOR_VOLTAGE     0
@@ -22,6 +27,12 @@ typedef struct _sensor Sensor;
 #define TYPE_SENSOR_LIGHT       3
 #define TYPE_SENSOR_CURRENT     4
 
+// How raw values are converted to physical units
+#define SENSOR_CONVERSION_FORMULA   0   // Call the calculator for every reading
+#define SENSOR_CONVERSION_TABLE     1   // Single load from a precomputed 65536 entry table
+
+#define SENSOR_VALUE_TABLE_SIZE     65536
+
 /**
  * @brief "category" of functions used to calculate the value of physical parameters from the raw sensor data.
  * 
@@ -40,11 +51,19 @@ struct _sensor {
     uint16_t id;
     uint8_t type;
     sensorValueCalculator* calculator;
+    const float* table;
     uint16_t value;
     Pixel* pixel;
     pthread_mutex_t mutex;
     uint16_t rangeMin;
     uint16_t rangeMax;
+    Gradient* gradient;
+    SensorHistory* history;
+    uint64_t lastSeen;
+    uint32_t period;
+    bool stale;
+    uint64_t received;
+    uint64_t uploaded;
 };
 
 /**
@@ -95,6 +114,42 @@ float currentSensorValue (uint16_t value);
 
 #define VALUE_CALCULATOR(x) (x ## _VALUE_CALCULATOR)
 
+/**
+ * @brief Range of raw values over which a calculator is monotonic
+ * 
+ */
+typedef struct {
+    uint16_t start;
+    uint16_t end;
+    bool increasing;
+} SensorSegment;
+
+/**
+ * @brief Get the conversion table of a sensor type, building it on first use.
+ * Entry i holds the output of the type's calculator for raw value i, so table
+ * lookups are bit-identical to calling the calculator.
+ * 
+ * @param type Sensor type
+ * @return const float* Table with SENSOR_VALUE_TABLE_SIZE entries. NULL if error.
+ */
+const float* getSensorValueTable (uint8_t type);
+
+/**
+ * @brief Inverts the calculator of a sensor type: finds the raw values whose
+ * physical value lies in the open interval (low, high). One range of raw
+ * values is written per monotonic segment of the calculator, empty ranges
+ * having rangeLow > rangeHigh.
+ * 
+ * @param type Sensor type
+ * @param low Lower bound of the physical value (exclusive)
+ * @param high Upper bound of the physical value (exclusive)
+ * @param rangeLow Array of SENSOR_MAX_SEGMENTS raw lower bounds (inclusive) to fill
+ * @param rangeHigh Array of SENSOR_MAX_SEGMENTS raw upper bounds (inclusive) to fill
+ * @return true Error
+ * @return false All good
+ */
+bool invertSensorCalculator (uint8_t type, float low, float high, uint16_t rangeLow[], uint16_t rangeHigh[]);
+
 /**
  * @brief Determines if a type is valid
  * 
@@ -127,7 +182,17 @@ Sensor* createSensor (Node* node, uint16_t id, uint8_t type, Position* pos, uint
 bool deleteSensor (Sensor* sensor);
 
 /**
- * @brief Set the raw value of the Sensor object
+ * @brief Select how the Sensor object converts raw values
+ * 
+ * @param sensor Pointer to the Sensor object
+ * @param conversion SENSOR_CONVERSION_FORMULA or SENSOR_CONVERSION_TABLE
+ * @return true Error
+ * @return false All Good
+ */
+bool setSensorConversion (Sensor* sensor, uint8_t conversion);
+
+/**
+ * @brief Set the raw value of the Sensor object, recording it in the sensor history if any
  * 
  * @param sensor Pointer to the Sensor object
  * @return true Error
@@ -135,6 +200,18 @@ bool deleteSensor (Sensor* sensor);
  */
 bool setSensorValue (Sensor* sensor, uint16_t value);
 
+/**
+ * @brief Set the raw value of the Sensor object from a sample of the input, stamped with the
+ * time it was received so the latency of every stage it goes through can be measured
+ * 
+ * @param sensor Pointer to the Sensor object
+ * @param value Raw value
+ * @param received Monotonic time, in ns, the sample was received
+ * @return true Error
+ * @return false All Good
+ */
+bool setSensorSample (Sensor* sensor, uint16_t value, uint64_t received);
+
 /**
  * @brief Calculate the value of the Sensor object
  * 
@@ -143,6 +220,44 @@ bool setSensorValue (Sensor* sensor, uint16_t value);
  */
 float getSensorValue (Sensor* sensor);
 
+/**
+ * @brief Get the value a rule operand refers to: the latest reading or an aggregate of the history.
+ * Falls back to the latest reading when the sensor has no history yet.
+ * 
+ * @param sensor Pointer to the Sensor object
+ * @param operand SENSOR_OPERAND_* value
+ * @return float Value in physical units. 0 in case of error
+ */
+float getSensorOperandValue (Sensor* sensor, uint8_t operand);
+
+/**
+ * @brief Get the raw value of the Sensor object
+ * 
+ * @param sensor Pointer to the Sensor object
+ * @return uint16_t Raw value of the sensor. 0 in case of error
+ */
+uint16_t getSensorRawValue (Sensor* sensor);
+
+/**
+ * @brief Sets how often the sensor is expected to report. The sensor turns stale
+ * when it misses NODE_STALE_PERIODS reports in a row.
+ * 
+ * @param sensor Pointer to the Sensor object
+ * @param period Expected time between reports, in milliseconds. 0 to use the period of the node.
+ * @return true Error
+ * @return false All good
+ */
+bool setSensorPeriod (Sensor* sensor, uint32_t period);
+
+/**
+ * @brief Tells if the sensor stopped reporting. Stale sensors never verify a rule.
+ * 
+ * @param sensor Pointer to the Sensor object
+ * @return true Sensor is stale
+ * @return false Sensor is alive, NULL or not tracked
+ */
+bool isSensorStale (Sensor* sensor);
+
 /**
  * @brief Get the Sensor Pixel object
  * 
@@ -170,7 +285,30 @@ Sensor* findSensorByType (Node* node, uint8_t type);
 Sensor* findSensorByID (Datastore* datastore, uint16_t id);
 
 /**
- * @brief Update pixel color for sensors
+ * @brief Set the colors the range of the sensor is shown with. Black to blue by default.
+ *
+ * @param sensor Pointer to the Sensor object
+ * @param stops Colors of the gradient, from rangeMin to rangeMax
+ * @param nStops Number of stops, from 1 to GRADIENT_MAX_STOPS
+ * @return true Error
+ * @return false All good
+ */
+bool setSensorGradient (Sensor* sensor, const Color* stops, uint8_t nStops);
+
+/**
+ * @brief Get the scale and offset turning a value of the sensor into a step of its gradient
+ *
+ * @param sensor Pointer to the Sensor object
+ * @param scale Pointer to the scale to fill
+ * @param offset Pointer to the offset to fill
+ * @return true Error
+ * @return false All good
+ */
+bool getSensorColorScale (Sensor* sensor, float* scale, float* offset);
+
+/**
+ * @brief Update pixel color for sensors. Stale sensors are drawn gray.
+ * The pixels of all sensors are better updated at once with updateSensorPixels.
  * 
  * @param sensor Pointer to Sensor Object
  * @return true Error
@@ -0,0 +1,321 @@
+#include "SensorHistory.h"
+
+size_t getSensorHistorySize (uint32_t capacity) {
+    // Keep every array of the slab 8 byte aligned
+    size_t queueSize = ((capacity*sizeof(uint32_t) + 7) / 8) * 8;
+
+    return sizeof(SensorHistory) + capacity*sizeof(SensorSample) + 2*queueSize;
+}
+
+SensorHistory* initSensorHistory (void* memory, uint32_t capacity, uint32_t window, float alpha) {
+    size_t queueSize = ((capacity*sizeof(uint32_t) + 7) / 8) * 8;
+    SensorHistory* history = memory;
+    uint8_t* arrays = (uint8_t*)memory + sizeof(SensorHistory);
+
+    history->capacity = capacity;
+    history->window = window;
+    history->alpha = alpha;
+    history->first = 0;
+    history->next = 0;
+    history->samples = (SensorSample*)arrays;
+    history->minQueue = (uint32_t*)(arrays + capacity*sizeof(SensorSample));
+    history->minFirst = 0;
+    history->minNext = 0;
+    history->maxQueue = (uint32_t*)(arrays + capacity*sizeof(SensorSample) + queueSize);
+    history->maxFirst = 0;
+    history->maxNext = 0;
+    history->sum = 0;
+    history->pushesSinceResum = 0;
+    history->ewma = 0;
+
+    return history;
+}
+
+bool createSensorHistories (Datastore* datastore, uint32_t capacity, uint32_t window, float alpha) {
+    if (!datastore || !capacity || !(alpha > 0 && alpha <= 1)) {
+        return true;
+    }
+
+    size_t historySize = ((getSensorHistorySize(capacity) + 7) / 8) * 8;
+    uint32_t nSensors = 0;
+
+    LL_iterator(datastore->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+            nSensors += listSize(node->sensors);
+        }
+    }
+
+    uint8_t* slab = (uint8_t*)malloc(nSensors*historySize + 1);
+    if (!slab) {
+        return true;
+    }
+
+    deleteSensorHistories(datastore);
+    datastore->sensorHistories = slab;
+
+    LL_iterator(datastore->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+            LL_iterator(node->sensors, sensor_elem) {
+                Sensor* sensor = (Sensor*)sensor_elem->ptr;
+
+                pthread_mutex_lock(&sensor->mutex);
+                sensor->history = initSensorHistory(slab, capacity, window, alpha);
+                pthread_mutex_unlock(&sensor->mutex);
+
+                slab += historySize;
+            }
+        }
+    }
+
+    return false;
+}
+
+void deleteSensorHistories (Datastore* datastore) {
+    if (!datastore || !datastore->sensorHistories) {
+        return;
+    }
+
+    LL_iterator(datastore->rooms, room_elem) {
+        Room* room = (Room*)room_elem->ptr;
+        LL_iterator(room->nodes, node_elem) {
+            Node* node = (Node*)node_elem->ptr;
+            LL_iterator(node->sensors, sensor_elem) {
+                Sensor* sensor = (Sensor*)sensor_elem->ptr;
+
+                pthread_mutex_lock(&sensor->mutex);
+                sensor->history = NULL;
+                pthread_mutex_unlock(&sensor->mutex);
+            }
+        }
+    }
+
+    free(datastore->sensorHistories);
+    datastore->sensorHistories = NULL;
+}
+
+#define SAMPLE(history, n) ((history)->samples[(n) % (history)->capacity])
+
+void dropOldestSample (SensorHistory* history) {
+    uint32_t oldest = history->first++;
+
+    history->sum -= SAMPLE(history, oldest).value;
+    if (history->minFirst != history->minNext && history->minQueue[history->minFirst % history->capacity] == oldest) {
+        history->minFirst++;
+    }
+    if (history->maxFirst != history->maxNext && history->maxQueue[history->maxFirst % history->capacity] == oldest) {
+        history->maxFirst++;
+    }
+}
+
+void pushSensorSample (SensorHistory* history, uint64_t timestamp, uint16_t raw, float value) {
+    if (!history) {
+        return;
+    }
+
+    if (history->next - history->first == history->capacity) {
+        dropOldestSample(history);
+    }
+    while (history->window && history->next != history->first &&
+        SAMPLE(history, history->first).timestamp + history->window < timestamp) {
+
+        dropOldestSample(history);
+    }
+
+    uint32_t n = history->next++;
+    SensorSample* sample = &SAMPLE(history, n);
+    sample->timestamp = timestamp;
+    sample->raw = raw;
+    sample->value = value;
+
+    // Readings dominated by the new one can never be the min (max) again
+    while (history->minNext != history->minFirst &&
+        SAMPLE(history, history->minQueue[(history->minNext-1) % history->capacity]).value >= value) {
+
+        history->minNext--;
+    }
+    history->minQueue[history->minNext++ % history->capacity] = n;
+
+    while (history->maxNext != history->maxFirst &&
+        SAMPLE(history, history->maxQueue[(history->maxNext-1) % history->capacity]).value <= value) {
+
+        history->maxNext--;
+    }
+    history->maxQueue[history->maxNext++ % history->capacity] = n;
+
+    // Rebuild the sum once per turn of the ring so rounding errors don't pile up
+    if (++history->pushesSinceResum >= history->capacity) {
+        history->sum = 0;
+        for (uint32_t i = history->first; i != history->next; i++) {
+            history->sum += SAMPLE(history, i).value;
+        }
+        history->pushesSinceResum = 0;
+    }
+    else {
+        history->sum += value;
+    }
+
+    history->ewma = (n == 0) ? value : history->ewma + history->alpha*(value - history->ewma);
+}
+
+void copySensorHistory (SensorHistory* from, SensorHistory* to) {
+    if (!from || !to || from == to) {
+        return;
+    }
+
+    bool empty = to->next == to->first;
+    uint64_t newest = empty ? 0 : SAMPLE(to, to->next-1).timestamp;
+
+    for (uint32_t i = from->first; i != from->next; i++) {
+        SensorSample* sample = &SAMPLE(from, i);
+        if (empty || sample->timestamp > newest) {
+            pushSensorSample(to, sample->timestamp, sample->raw, sample->value);
+        }
+    }
+
+    if (empty && from->next != from->first) {
+        to->ewma = from->ewma;
+    }
+}
+
+uint32_t getSensorHistoryCount (SensorHistory* history) {
+    if (!history) {
+        return 0;
+    }
+
+    return history->next - history->first;
+}
+
+bool getSensorHistoryAggregate (SensorHistory* history, uint8_t operand, float* result) {
+    if (!history || !result || history->next == history->first) {
+        return true;
+    }
+
+    switch (operand) {
+        case SENSOR_OPERAND_MEAN:
+            *result = history->sum / (history->next - history->first);
+            break;
+
+        case SENSOR_OPERAND_MIN:
+            *result = SAMPLE(history, history->minQueue[history->minFirst % history->capacity]).value;
+            break;
+
+        case SENSOR_OPERAND_MAX:
+            *result = SAMPLE(history, history->maxQueue[history->maxFirst % history->capacity]).value;
+            break;
+
+        case SENSOR_OPERAND_EWMA:
+            *result = history->ewma;
+            break;
+
+        default:
+            return true;
+    }
+
+    return false;
+}
+
+void initSensorWindow (SensorWindow* window, uint32_t duration, float threshold) {
+    if (!window) {
+        return;
+    }
+
+    window->duration = duration;
+    window->threshold = threshold;
+    window->valid = false;
+    window->front = 0;
+    window->next = 0;
+    window->sum = 0;
+    window->above = 0;
+    window->streak = false;
+    window->streakStart = 0;
+    window->change = 0;
+}
+
+void consumeWindowSample (SensorWindow* window, SensorSample* sample) {
+    window->sum += sample->value;
+    if (sample->value > window->threshold) {
+        window->above++;
+        if (!window->streak) {
+            window->streak = true;
+            window->streakStart = sample->timestamp;
+        }
+    }
+    else {
+        window->streak = false;
+    }
+}
+
+void rebuildSensorWindow (SensorHistory* history, SensorWindow* window) {
+    window->sum = 0;
+    window->above = 0;
+    window->streak = false;
+
+    // The run in progress may have started before the oldest reading: assume it started there
+    for (uint32_t n = history->first; n != history->next; n++) {
+        consumeWindowSample(window, &SAMPLE(history, n));
+    }
+
+    window->front = history->first;
+    window->next = history->next;
+    window->valid = true;
+}
+
+bool updateSensorWindow (Sensor* sensor, SensorWindow* window, uint64_t now) {
+    if (!sensor || !window) {
+        return true;
+    }
+
+    pthread_mutex_lock(&sensor->mutex);
+
+    SensorHistory* history = sensor->history;
+    if (!history) {
+        pthread_mutex_unlock(&sensor->mutex);
+        return true;
+    }
+
+    // Readings still in the window were overwritten: start over from the history
+    if (!window->valid ||
+        (int32_t)(window->front - history->first) < 0 ||
+        (int32_t)(history->next - window->next) < 0) {
+
+        rebuildSensorWindow(history, window);
+    }
+    else {
+        for (; window->next != history->next; window->next++) {
+            consumeWindowSample(window, &SAMPLE(history, window->next));
+        }
+    }
+
+    while (window->front != window->next &&
+        SAMPLE(history, window->front).timestamp + window->duration < now) {
+
+        SensorSample* sample = &SAMPLE(history, window->front);
+        window->sum -= sample->value;
+        window->above -= (sample->value > window->threshold);
+        window->front++;
+    }
+
+    if (window->front == window->next) {
+        window->sum = 0;
+        window->change = 0;
+    }
+    else {
+        window->change = SAMPLE(history, window->next-1).value - SAMPLE(history, window->front).value;
+    }
+
+    pthread_mutex_unlock(&sensor->mutex);
+
+    return false;
+}
+
+uint32_t getSensorWindowCount (SensorWindow* window) {
+    if (!window) {
+        return 0;
+    }
+
+    return window->next - window->front;
+}
@@ -0,0 +1,172 @@
+#ifndef __SENSOR_HISTORY__
+#define __SENSOR_HISTORY__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct _sensor_history SensorHistory;
+typedef struct _sensor_sample SensorSample;
+typedef struct _sensor_window SensorWindow;
+
+// Value of a sensor a rule compares against
+#define SENSOR_OPERAND_VALUE    0   // Latest reading
+#define SENSOR_OPERAND_MEAN     1   // Mean of the readings in the history
+#define SENSOR_OPERAND_MIN      2   // Lowest reading in the history
+#define SENSOR_OPERAND_MAX      3   // Highest reading in the history
+#define SENSOR_OPERAND_EWMA     4   // Exponentially weighted moving average of every reading
+
+#define SENSOR_HISTORY_DEFAULT_ALPHA 0.1
+
+
+/**
+ * @brief A single reading of a sensor
+ *
+ */
+struct _sensor_sample {
+    uint64_t timestamp;
+    uint16_t raw;
+    float value;
+};
+
+/**
+ * @brief Fixed capacity ring buffer of the last readings of a sensor, with
+ * aggregates updated on every push in O(1) (amortized for min and max,
+ * which keep monotonic queues of sample sequence numbers).
+ *
+ * Readings older than window (ms, 0 for no limit) are dropped on push.
+ * Sample with sequence number n lives at samples[n % capacity].
+ *
+ */
+struct _sensor_history {
+    uint32_t capacity;
+    uint32_t window;
+    float alpha;
+    uint32_t first;
+    uint32_t next;
+    SensorSample* samples;
+    uint32_t* minQueue;
+    uint32_t minFirst;
+    uint32_t minNext;
+    uint32_t* maxQueue;
+    uint32_t maxFirst;
+    uint32_t maxNext;
+    double sum;
+    uint32_t pushesSinceResum;
+    float ewma;
+};
+
+/**
+ * @brief Incremental view over the readings of a sensor history taken in
+ * the last duration ms. Each update only consumes the readings pushed
+ * since the previous one and drops the ones that aged out, unless the
+ * history overwrote readings still in the window, in which case the
+ * state is rebuilt from what the history holds.
+ *
+ * Readings [front, next) are in the window. above counts the ones over
+ * threshold, streakStart is when the current run of readings over
+ * threshold started, and change is newest minus oldest reading.
+ *
+ */
+struct _sensor_window {
+    uint32_t duration;
+    float threshold;
+    bool valid;
+    uint32_t front;
+    uint32_t next;
+    double sum;
+    uint32_t above;
+    bool streak;
+    uint64_t streakStart;
+    float change;
+};
+
+// Included after the structures: LeafBatch.h, reached through Datastore.h, embeds SensorWindow
+#include "Datastore.h"
+
+/**
+ * @brief Gives every sensor of the datastore a history, all carved out of a single allocation
+ *
+ * @param datastore Pointer to the Datastore object
+ * @param capacity Max number of readings kept per sensor
+ * @param window Max age of the readings kept, in milliseconds. 0 for no limit.
+ * @param alpha Smoothing factor of the EWMA, in (0, 1]
+ * @return true Error
+ * @return false All good
+ */
+bool createSensorHistories (Datastore* datastore, uint32_t capacity, uint32_t window, float alpha);
+
+/**
+ * @brief Releases the histories of the datastore. Sensors are left without history.
+ *
+ * @param datastore Pointer to the Datastore object
+ */
+void deleteSensorHistories (Datastore* datastore);
+
+/**
+ * @brief Adds a reading to the history, dropping the ones that fell out of it
+ *
+ * @param history Pointer to the SensorHistory object
+ * @param timestamp Monotonic time of the reading, in milliseconds
+ * @param raw Raw value
+ * @param value Value in physical units
+ */
+void pushSensorSample (SensorHistory* history, uint64_t timestamp, uint16_t raw, float value);
+
+/**
+ * @brief Adds to a history the readings of another one that are newer than its own,
+ * in order. A history with no readings also takes over the moving average.
+ *
+ * @param from Pointer to the SensorHistory object to read
+ * @param to Pointer to the SensorHistory object to fill
+ */
+void copySensorHistory (SensorHistory* from, SensorHistory* to);
+
+/**
+ * @brief Number of readings currently in the history
+ *
+ * @param history Pointer to the SensorHistory object
+ * @return uint32_t Number of readings
+ */
+uint32_t getSensorHistoryCount (SensorHistory* history);
+
+/**
+ * @brief Get an aggregate of the readings in the history
+ *
+ * @param history Pointer to the SensorHistory object
+ * @param operand One of SENSOR_OPERAND_MEAN, MIN, MAX or EWMA
+ * @param result Pointer to the value to fill
+ * @return true Error, invalid operand or empty history
+ * @return false All good
+ */
+bool getSensorHistoryAggregate (SensorHistory* history, uint8_t operand, float* result);
+
+/**
+ * @brief Initializes an empty window
+ *
+ * @param window Pointer to the SensorWindow object
+ * @param duration Length of the window, in milliseconds
+ * @param threshold Readings over this value are counted as above
+ */
+void initSensorWindow (SensorWindow* window, uint32_t duration, float threshold);
+
+/**
+ * @brief Moves the window to the current time, consuming the new readings of the sensor history
+ *
+ * @param sensor Pointer to the Sensor object
+ * @param window Pointer to the SensorWindow object
+ * @param now Current monotonic time, in milliseconds
+ * @return true Error, the sensor has no history
+ * @return false All good
+ */
+bool updateSensorWindow (Sensor* sensor, SensorWindow* window, uint64_t now);
+
+/**
+ * @brief Number of readings in the window
+ *
+ * @param window Pointer to the SensorWindow object
+ * @return uint32_t Number of readings
+ */
+uint32_t getSensorWindowCount (SensorWindow* window);
+
+#endif
@@ -0,0 +1,126 @@
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "SharedFrame.h"
+#include "Clock.h"
+
+SharedFrame* createSharedFrame (const char* name, uint16_t width, uint16_t height, uint32_t channels) {
+    if (!name || !width || !height || !channels) {
+        return NULL;
+    }
+
+    SharedFrame* shared = (SharedFrame*)malloc(sizeof(SharedFrame));
+    if (!shared) {
+        return NULL;
+    }
+
+    shared->name = (char*)malloc(strlen(name)+1);
+    if (!shared->name) {
+        free(shared);
+        return NULL;
+    }
+    strcpy(shared->name, name);
+
+    shared->size = sizeof(SharedFrameHeader) + (size_t)width * height * channels;
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        free(shared->name);
+        free(shared);
+        return NULL;
+    }
+
+    void* segment = MAP_FAILED;
+    if (!ftruncate(fd, shared->size)) {
+        segment = mmap(NULL, shared->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (segment == MAP_FAILED) {
+        shm_unlink(name);
+        free(shared->name);
+        free(shared);
+        return NULL;
+    }
+
+    shared->header = (SharedFrameHeader*)segment;
+    shared->pixels = (uint8_t*)segment + sizeof(SharedFrameHeader);
+
+    // Readers check the magic last, once the rest of the header is in place
+    SharedFrameHeader* header = shared->header;
+    header->version = SHARED_FRAME_VERSION;
+    header->width = width;
+    header->height = height;
+    header->channels = channels;
+    header->lock = 0;
+    header->sequence = 0;
+    header->updated = 0;
+    memset(shared->pixels, 0, shared->size - sizeof(SharedFrameHeader));
+    __atomic_store_n(&header->magic, SHARED_FRAME_MAGIC, __ATOMIC_RELEASE);
+
+    return shared;
+}
+
+bool deleteSharedFrame (SharedFrame* shared) {
+    if (!shared) {
+        return true;
+    }
+
+    munmap(shared->header, shared->size);
+    shm_unlink(shared->name);
+    free(shared->name);
+    free(shared);
+
+    return false;
+}
+
+void writeSharedFrame (SharedFrame* shared, const uint8_t* frame, uint64_t sequence) {
+    if (!shared || !frame) {
+        return;
+    }
+
+    SharedFrameHeader* header = shared->header;
+    uint64_t lock = __atomic_load_n(&header->lock, __ATOMIC_RELAXED);
+
+    // Odd while writing: readers that overlap the copy see the lock move and retry
+    __atomic_store_n(&header->lock, lock + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(shared->pixels, frame, shared->size - sizeof(SharedFrameHeader));
+    header->sequence = sequence;
+    header->updated = getMonotonicTime();
+
+    __atomic_store_n(&header->lock, lock + 2, __ATOMIC_RELEASE);
+}
+
+bool readSharedFrame (const SharedFrameHeader* header, uint8_t* frame, uint64_t* sequence) {
+    if (!header || !frame || __atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SHARED_FRAME_MAGIC ||
+        header->version != SHARED_FRAME_VERSION) {
+        return true;
+    }
+
+    size_t frameSize = (size_t)header->width * header->height * header->channels;
+    const uint8_t* pixels = (const uint8_t*)header + sizeof(SharedFrameHeader);
+
+    while (true) {
+        uint64_t lock = __atomic_load_n(&header->lock, __ATOMIC_ACQUIRE);
+        if (lock & 1) {
+            sched_yield();
+            continue;
+        }
+
+        memcpy(frame, pixels, frameSize);
+        uint64_t frameSequence = header->sequence;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&header->lock, __ATOMIC_RELAXED) == lock) {
+            if (sequence) {
+                *sequence = frameSequence;
+            }
+            return false;
+        }
+    }
+}
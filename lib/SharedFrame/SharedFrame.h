@@ -0,0 +1,86 @@
+#ifndef __SHARED_FRAME__
+#define __SHARED_FRAME__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct _shared_frame SharedFrame;
+typedef struct _shared_frame_header SharedFrameHeader;
+
+#define SHARED_FRAME_MAGIC      0x53534147  // "GASS" read as a little endian word
+#define SHARED_FRAME_VERSION    1
+
+
+/**
+ * @brief Start of the shared memory segment, followed by the pixels of the latest frame:
+ * channels bytes per pixel, packed RGB, row after row.
+ *
+ * The frame is guarded by a seqlock: lock is odd while the frame is being written.
+ * Readers load lock, copy what they need, and retry if lock was odd or changed meanwhile.
+ * sequence is the number of the frame and updated the monotonic time, in ms, it was written.
+ *
+ */
+struct _shared_frame_header {
+    uint32_t magic;
+    uint32_t version;
+    uint16_t width;
+    uint16_t height;
+    uint32_t channels;
+    uint64_t lock;
+    uint64_t sequence;
+    uint64_t updated;
+};
+
+/**
+ * @brief POSIX shared memory segment exporting frames to other processes
+ *
+ */
+struct _shared_frame {
+    char* name;
+    size_t size;
+    SharedFrameHeader* header;
+    uint8_t* pixels;
+};
+
+/**
+ * @brief Create a SharedFrame object, creating or replacing the shared memory segment
+ *
+ * @param name Name of the segment, as given to shm_open, e.g. "/gas"
+ * @param width Number of columns of the frames
+ * @param height Number of rows of the frames
+ * @param channels Bytes per pixel
+ * @return SharedFrame* Pointer to the new SharedFrame object. NULL if error.
+ */
+SharedFrame* createSharedFrame (const char* name, uint16_t width, uint16_t height, uint32_t channels);
+
+/**
+ * @brief Delete a SharedFrame object and remove its segment. Processes that mapped it keep their mapping.
+ *
+ * @param shared Pointer to the SharedFrame object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteSharedFrame (SharedFrame* shared);
+
+/**
+ * @brief Copies a frame into the segment. Single writer only.
+ *
+ * @param shared Pointer to the SharedFrame object
+ * @param frame Pixels of the frame
+ * @param sequence Number of the frame
+ */
+void writeSharedFrame (SharedFrame* shared, const uint8_t* frame, uint64_t sequence);
+
+/**
+ * @brief Copies a consistent frame out of a mapped segment, for the processes reading it
+ *
+ * @param header Start of the mapped segment
+ * @param frame Filled with width*height*channels bytes
+ * @param sequence Filled with the number of the frame. May be NULL.
+ * @return true Error, not a valid segment
+ * @return false All good
+ */
+bool readSharedFrame (const SharedFrameHeader* header, uint8_t* frame, uint64_t* sequence);
+
+#endif
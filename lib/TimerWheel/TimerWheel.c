@@ -0,0 +1,134 @@
+#include "TimerWheel.h"
+
+TimerWheel* createTimerWheel (uint32_t nSlots, uint64_t now) {
+    if (!nSlots) {
+        return NULL;
+    }
+
+    TimerWheel* wheel = (TimerWheel*)malloc(sizeof(TimerWheel));
+    if (!wheel) {
+        return NULL;
+    }
+
+    wheel->slots = (Timer**)calloc(nSlots, sizeof(Timer*));
+    if (!wheel->slots) {
+        free(wheel);
+        return NULL;
+    }
+
+    wheel->nSlots = nSlots;
+    wheel->now = now;
+
+    return wheel;
+}
+
+bool deleteTimerWheel (TimerWheel* wheel) {
+    if (!wheel) {
+        return true;
+    }
+
+    for (uint32_t slot = 0; slot < wheel->nSlots; slot++) {
+        while (wheel->slots[slot]) {
+            cancelTimer(wheel->slots[slot]);
+        }
+    }
+
+    free(wheel->slots);
+    free(wheel);
+
+    return false;
+}
+
+void initTimer (Timer* timer, TimerCallback callback, void* arg) {
+    if (!timer) {
+        return;
+    }
+
+    timer->tick = 0;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+void linkTimer (TimerWheel* wheel, Timer* timer) {
+    Timer** head = &wheel->slots[timer->tick % wheel->nSlots];
+
+    timer->next = *head;
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = head;
+    *head = timer;
+}
+
+bool scheduleTimer (TimerWheel* wheel, Timer* timer, uint64_t tick) {
+    if (!wheel || !timer) {
+        return true;
+    }
+
+    cancelTimer(timer);
+
+    // Past ticks go to the next slot visited
+    timer->tick = tick > wheel->now ? tick : wheel->now+1;
+    linkTimer(wheel, timer);
+
+    return false;
+}
+
+void cancelTimer (Timer* timer) {
+    if (!timer || !timer->pprev) {
+        return;
+    }
+
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+uint32_t advanceTimerWheel (TimerWheel* wheel, uint64_t now) {
+    if (!wheel || now <= wheel->now) {
+        return 0;
+    }
+
+    // Past a full turn every slot has to be visited exactly once
+    uint64_t from = wheel->now + 1,
+        elapsed = now - wheel->now;
+    if (elapsed > wheel->nSlots) {
+        from = now - wheel->nSlots + 1;
+    }
+    wheel->now = now;
+
+    uint32_t fired = 0;
+    for (uint64_t tick = from; tick <= now; tick++) {
+        Timer** head = &wheel->slots[tick % wheel->nSlots];
+
+        // Detach the slot so callbacks can schedule timers on it again
+        Timer* timer = *head;
+        *head = NULL;
+        if (timer) {
+            timer->pprev = &timer;
+        }
+
+        while (timer) {
+            Timer* current = timer;
+            cancelTimer(current);
+
+            if (current->tick <= now) {
+                fired++;
+                if (current->callback) {
+                    current->callback(current, current->arg);
+                }
+            }
+            else {
+                // Due on a later turn of the wheel
+                linkTimer(wheel, current);
+            }
+        }
+    }
+
+    return fired;
+}
@@ -0,0 +1,95 @@
+#ifndef __TIMER_WHEEL__
+#define __TIMER_WHEEL__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct _timer_wheel TimerWheel;
+typedef struct _timer Timer;
+
+typedef void (*TimerCallback) (Timer* timer, void* arg);
+
+
+/**
+ * @brief A timer that fires once when the wheel reaches its tick.
+ * Timers are owned by the caller and linked into the wheel, so
+ * scheduling and cancelling never allocate.
+ *
+ */
+struct _timer {
+    uint64_t tick;
+    TimerCallback callback;
+    void* arg;
+    Timer* next;
+    Timer** pprev;
+};
+
+/**
+ * @brief Hashed timing wheel: timers land on slot tick % nSlots, and
+ * advancing the wheel only visits the slots of the elapsed ticks.
+ *
+ */
+struct _timer_wheel {
+    uint32_t nSlots;
+    uint64_t now;
+    Timer** slots;
+};
+
+/**
+ * @brief Create a TimerWheel object
+ *
+ * @param nSlots Number of slots of the wheel
+ * @param now Current tick
+ * @return TimerWheel* Pointer to the new TimerWheel object. NULL if error.
+ */
+TimerWheel* createTimerWheel (uint32_t nSlots, uint64_t now);
+
+/**
+ * @brief Delete a TimerWheel object. Scheduled timers are unlinked but not freed.
+ *
+ * @param wheel Pointer to the TimerWheel object
+ * @return true Error
+ * @return false All good
+ */
+bool deleteTimerWheel (TimerWheel* wheel);
+
+/**
+ * @brief Initializes a timer, leaving it unscheduled
+ *
+ * @param timer Pointer to the Timer
+ * @param callback Function called when the timer fires
+ * @param arg Argument given to the callback
+ */
+void initTimer (Timer* timer, TimerCallback callback, void* arg);
+
+/**
+ * @brief Schedules a timer to fire at the given tick. A scheduled timer is moved.
+ * Ticks already reached fire on the next advance.
+ *
+ * @param wheel Pointer to the TimerWheel object
+ * @param timer Pointer to the Timer
+ * @param tick Tick at which the timer fires
+ * @return true Error
+ * @return false All good
+ */
+bool scheduleTimer (TimerWheel* wheel, Timer* timer, uint64_t tick);
+
+/**
+ * @brief Removes a timer from its wheel, if scheduled
+ *
+ * @param timer Pointer to the Timer
+ */
+void cancelTimer (Timer* timer);
+
+/**
+ * @brief Moves the wheel up to tick now, firing every timer due.
+ * Callbacks may schedule timers again.
+ *
+ * @param wheel Pointer to the TimerWheel object
+ * @param now Current tick
+ * @return uint32_t Number of timers fired
+ */
+uint32_t advanceTimerWheel (TimerWheel* wheel, uint64_t now);
+
+#endif
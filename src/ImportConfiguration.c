@@ -1,58 +1,37 @@
 #include "ImportConfiguration.h"
 #include "stdio.h"
+#include <sys/stat.h>
 
-char* getMinifiedJSONStringFromFile (const char* filename) {
+char* getJSONStringFromFile (const char* filename) {
     if (!filename) {
         return NULL;
     }
 
-    FILE* file = fopen(filename, "r");
+    FILE* file = fopen(filename, "rb");
     if (!file) {
         return NULL;
     }
 
-    int readChar = 0;
-    unsigned int jsonSize = 0,
-        jsonReserved = 100;
-    bool inString = false;
-    char* json = malloc(jsonReserved);
-    if (!json) {
+    // Read the whole file at once, the parser already skips whitespace
+    struct stat info;
+    if (fstat(fileno(file), &info) || info.st_size < 0) {
         fclose(file);
         return NULL;
     }
-    json[0] = '\0';
-
-    while ( (readChar = fgetc(file)) != EOF) {
-        // Ignore line endings and spaces (if not in string)
-        if ( (readChar == ' ' && !inString)
-            || readChar == '\n'
-            || readChar == '\r') {
-            continue;
-        }
 
-        // Check if string is being read
-        if (readChar == '"' || readChar == '\'') {
-            inString = !inString;
-        }
-
-        // Check if there is still space in the allocated string
-        if (jsonSize == jsonReserved-1) {
-            jsonReserved += 100;
-            json = realloc(json, jsonReserved);
-            if (!json) {
-                fclose(file);
-                return NULL;
-            }
-        }
-
-        // Concat current JSON string and new char
-        char aux[2] = {readChar, '\0'};
-        strcat(json, aux);
-        jsonSize++;
+    size_t jsonSize = (size_t)info.st_size;
+    char* json = malloc(jsonSize+1);
+    if (!json) {
+        fclose(file);
+        return NULL;
     }
 
-    // Trim string to actual size of JSON's minified string
-    json = realloc(json, jsonSize+1);
+    if (fread(json, 1, jsonSize, file) != jsonSize) {
+        free(json);
+        fclose(file);
+        return NULL;
+    }
+    json[jsonSize] = '\0';
 
     // Close the file
     fclose(file);
@@ -104,6 +83,64 @@ bool parseSensor (Node* node, cJSON* json_sensor) {
         return 1;
     }
 
+    // Optional: how raw values are converted. Lookup table by default.
+    cJSON* json_conversion = cJSON_GetObjectItem(json_sensor, "conversion");
+    if (cJSON_IsString(json_conversion) && (json_conversion->valuestring != NULL)) {
+        uint8_t conversion;
+        if (!strcmp(json_conversion->valuestring, "table")) {
+            conversion = SENSOR_CONVERSION_TABLE;
+        }
+        else if (!strcmp(json_conversion->valuestring, "formula")) {
+            conversion = SENSOR_CONVERSION_FORMULA;
+        }
+        else {
+            return 1;
+        }
+
+        if (setSensorConversion(sensor, conversion)) {
+            return 1;
+        }
+    }
+
+    // Optional: expected time, in seconds, between readings. The node period by default.
+    cJSON* json_period = cJSON_GetObjectItem(json_sensor, "period");
+    if (json_period) {
+        if (!cJSON_IsNumber(json_period) || json_period->valuedouble < 0 ||
+            setSensorPeriod(sensor, (uint32_t)(json_period->valuedouble * 1000))) {
+            return 1;
+        }
+    }
+
+    // Optional: colors the range is shown with, from rangeMin to rangeMax. Black to blue by default.
+    cJSON* json_gradient = cJSON_GetObjectItem(json_sensor, "gradient");
+    if (json_gradient) {
+        int nStops = cJSON_GetArraySize(json_gradient);
+        if (!cJSON_IsArray(json_gradient) || nStops < 1 || nStops > GRADIENT_MAX_STOPS) {
+            return 1;
+        }
+
+        Color stops[GRADIENT_MAX_STOPS];
+        cJSON* json_stop = NULL;
+        int i = 0;
+        cJSON_ArrayForEach(json_stop, json_gradient) {
+            cJSON* json_r = cJSON_GetObjectItem(json_stop, "r");
+            cJSON* json_g = cJSON_GetObjectItem(json_stop, "g");
+            cJSON* json_b = cJSON_GetObjectItem(json_stop, "b");
+            if (!cJSON_IsNumber(json_r) || !cJSON_IsNumber(json_g) || !cJSON_IsNumber(json_b)) {
+                return 1;
+            }
+
+            stops[i].r = (uint8_t)json_r->valueint;
+            stops[i].g = (uint8_t)json_g->valueint;
+            stops[i].b = (uint8_t)json_b->valueint;
+            i++;
+        }
+
+        if (setSensorGradient(sensor, stops, (uint8_t)nStops)) {
+            return 1;
+        }
+    }
+
     return 0;
 }
 
@@ -148,7 +185,7 @@ bool parseActuator (Node* node, cJSON* json_actuator) {
     return 0;
 }
 
-bool parseNode (Room* room, cJSON* json_node) {
+bool parseNode (Room* room, cJSON* json_node, uint32_t* nErrors) {
     if (!room || !json_node) {
         return 1;
     }
@@ -175,11 +212,14 @@ bool parseNode (Room* room, cJSON* json_node) {
     if (!cJSON_IsArray(sensors)) {
         return 1;
     }
+    int position = 0;
     cJSON_ArrayForEach(sensor, sensors) {
         if(parseSensor(node, sensor)) {
-            // Error parsing sensor
-            return 1;
+            // Error parsing sensor, keep going to report the others
+            fprintf(stderr, "Configuration error: invalid sensor %d of node %u.\n", position, id);
+            (*nErrors)++;
         }
+        position++;
     }
 
     // Parse the node's actuators
@@ -188,9 +228,21 @@ bool parseNode (Room* room, cJSON* json_node) {
     if (!cJSON_IsArray(actuators)) {
         return 1;
     }
+    position = 0;
     cJSON_ArrayForEach(actuator, actuators) {
         if(parseActuator(node, actuator)) {
-            // Error parsing actuator
+            // Error parsing actuator, keep going to report the others
+            fprintf(stderr, "Configuration error: invalid actuator %d of node %u.\n", position, id);
+            (*nErrors)++;
+        }
+        position++;
+    }
+
+    // Optional: expected time, in seconds, between reports. Liveness is not tracked by default.
+    cJSON* json_period = cJSON_GetObjectItem(json_node, "period");
+    if (json_period) {
+        if (!cJSON_IsNumber(json_period) || json_period->valuedouble < 0 ||
+            setNodePeriod(node, (uint32_t)(json_period->valuedouble * 1000))) {
             return 1;
         }
     }
@@ -198,8 +250,8 @@ bool parseNode (Room* room, cJSON* json_node) {
     return 0;
 }
 
-bool parseRule (Datastore* datastore, Rule* parentRule, cJSON* json_rule) {
-    if (!json_rule || !datastore) {
+bool parseRule (Datastore* datastore, DatastoreIndex* index, Rule* parentRule, cJSON* json_rule, uint32_t* nErrors) {
+    if (!json_rule || !datastore || !index) {
         return true;
     }
 
@@ -232,6 +284,82 @@ bool parseRule (Datastore* datastore, Rule* parentRule, cJSON* json_rule) {
         return true;
     }
 
+    // Rule IDs are checked here, as rules are parsed once the rest of the datastore was indexed
+    void* existing = NULL;
+    if (insertHashTable(index->rules, id, rule, &existing)) {
+        return true;
+    }
+    if (existing) {
+        fprintf(stderr, "Configuration error: rule %u is defined more than once.\n", id);
+        (*nErrors)++;
+    }
+
+    // Optional: priority used to resolve conflicts between rules driving the same actuator
+    cJSON* json_priority = cJSON_GetObjectItem(json_rule, "priority");
+    if (json_priority) {
+        if (!cJSON_IsNumber(json_priority) || setRulePriority(rule, (uint16_t)json_priority->valueint)) {
+            return true;
+        }
+    }
+
+    // Optional: value of the sensors the rule compares
+    cJSON* json_operand = cJSON_GetObjectItem(json_rule, "operand");
+    if (json_operand) {
+        if (!cJSON_IsString(json_operand) || json_operand->valuestring == NULL) {
+            return true;
+        }
+
+        const char* operands[] = {"value", "mean", "min", "max", "ewma"};
+        uint8_t operand = 0;
+        while (operand < sizeof(operands)/sizeof(operands[0]) && strcmp(json_operand->valuestring, operands[operand])) {
+            operand++;
+        }
+
+        if (setRuleOperand(rule, operand)) {
+            return true;
+        }
+    }
+
+    // Optional: window, in seconds, of the windowed operations and readings needed by count above
+    cJSON* json_window = cJSON_GetObjectItem(json_rule, "window");
+    cJSON* json_count = cJSON_GetObjectItem(json_rule, "count");
+    if (json_window || json_count) {
+        if ((json_window && (!cJSON_IsNumber(json_window) || json_window->valuedouble < 0)) ||
+            (json_count && !cJSON_IsNumber(json_count))) {
+            return true;
+        }
+
+        uint32_t window = json_window ? (uint32_t)(json_window->valuedouble*1000) : 0;
+        uint16_t count = json_count ? (uint16_t)json_count->valueint : 1;
+        if (setRuleWindow(rule, window, count)) {
+            return true;
+        }
+    }
+
+    // Optional: hysteresis band, in rule value units
+    cJSON* json_hysteresis = cJSON_GetObjectItem(json_rule, "hysteresis");
+    if (json_hysteresis) {
+        if (!cJSON_IsNumber(json_hysteresis) || setRuleHysteresis(rule, (uint16_t)json_hysteresis->valueint)) {
+            return true;
+        }
+    }
+
+    // Optional: minimum time, in seconds, the rule stays active or inactive before switching
+    cJSON* json_minOnTime = cJSON_GetObjectItem(json_rule, "minOnTime");
+    cJSON* json_minOffTime = cJSON_GetObjectItem(json_rule, "minOffTime");
+    if (json_minOnTime || json_minOffTime) {
+        if ((json_minOnTime && (!cJSON_IsNumber(json_minOnTime) || json_minOnTime->valuedouble < 0)) ||
+            (json_minOffTime && (!cJSON_IsNumber(json_minOffTime) || json_minOffTime->valuedouble < 0))) {
+            return true;
+        }
+
+        uint32_t minOnTime = json_minOnTime ? (uint32_t)(json_minOnTime->valuedouble*1000) : 0,
+            minOffTime = json_minOffTime ? (uint32_t)(json_minOffTime->valuedouble*1000) : 0;
+        if (setRuleDwellTimes(rule, minOnTime, minOffTime)) {
+            return true;
+        }
+    }
+
     cJSON* json_sensor_array = cJSON_GetObjectItem(json_rule, "sensors"),
         *json_sensor_entry = NULL;;
     if (!cJSON_IsArray(json_sensor_array)) {
@@ -241,9 +369,11 @@ bool parseRule (Datastore* datastore, Rule* parentRule, cJSON* json_rule) {
         if (cJSON_IsNumber(json_sensor_entry)) {
             uint16_t sensor_id = (uint16_t)json_sensor_entry->valueint;
             
-            Sensor* sensor = findSensorByID(datastore, sensor_id);
+            Sensor* sensor = findInHashTable(index->sensors, sensor_id);
             if (!sensor) {
-                return true;
+                fprintf(stderr, "Configuration error: rule %u uses unknown sensor %u.\n", id, sensor_id);
+                (*nErrors)++;
+                continue;
             }
 
             if (addSensorToRule(rule, sensor)) {
@@ -261,9 +391,11 @@ bool parseRule (Datastore* datastore, Rule* parentRule, cJSON* json_rule) {
         if (cJSON_IsNumber(json_actuator_entry)) {
             uint16_t actuator_id = (uint16_t)json_actuator_entry->valueint;
 
-            Actuator* actuator = findActuatorByID(datastore, actuator_id);
+            Actuator* actuator = findInHashTable(index->actuators, actuator_id);
             if (!actuator) {
-                return true;
+                fprintf(stderr, "Configuration error: rule %u uses unknown actuator %u.\n", id, actuator_id);
+                (*nErrors)++;
+                continue;
             }
 
             if (addActuatorToRule(rule, actuator)) {
@@ -281,9 +413,11 @@ bool parseRule (Datastore* datastore, Rule* parentRule, cJSON* json_rule) {
         if (cJSON_IsNumber(json_profile_entry)) {
             uint16_t profile_id = (uint16_t)json_profile_entry->valueint;
 
-            Profile* profile = findProfileByID(datastore, profile_id);
+            Profile* profile = findInHashTable(index->profiles, profile_id);
             if (!profile) {
-                return true;
+                fprintf(stderr, "Configuration error: rule %u uses unknown profile %u.\n", id, profile_id);
+                (*nErrors)++;
+                continue;
             }
 
             if (addProfileToRule(rule, profile)) {
@@ -297,19 +431,20 @@ bool parseRule (Datastore* datastore, Rule* parentRule, cJSON* json_rule) {
     if (!cJSON_IsArray(json_childs_array)) {
         return true;
     }
+    int position = 0;
     cJSON_ArrayForEach(json_childs_entry, json_childs_array) {
-        if(!cJSON_IsObject(json_childs_entry)) {
-            return true;
-        }
-        else {
-            parseRule(datastore, rule, json_childs_entry);
+        if(!cJSON_IsObject(json_childs_entry) || parseRule(datastore, index, rule, json_childs_entry, nErrors)) {
+            // Error parsing child rule, keep going to report the others
+            fprintf(stderr, "Configuration error: invalid child %d of rule %u.\n", position, id);
+            (*nErrors)++;
         }
+        position++;
     }
 
     return false;
 }
 
-bool parseRoom (Datastore* datastore, cJSON* json_room) {
+bool parseRoom (Datastore* datastore, cJSON* json_room, uint32_t* nErrors) {
     if (!datastore || !json_room) {
         return 1;
     }
@@ -351,18 +486,21 @@ bool parseRoom (Datastore* datastore, cJSON* json_room) {
     if (!cJSON_IsArray(nodes)) {
         return 1;
     }
+    int position = 0;
     cJSON_ArrayForEach(node, nodes) {
-        if(parseNode(room, node)) {
-            // Error parsing node
-            return 1;
+        if(parseNode(room, node, nErrors)) {
+            // Error parsing node, keep going to report the others
+            fprintf(stderr, "Configuration error: invalid node %d of room %u.\n", position, id);
+            (*nErrors)++;
         }
+        position++;
     }
 
     return 0;
 }
 
-bool parseExtraPixel (Datastore* datastore, cJSON* json_pixel) {
-    if (!datastore || !json_pixel) {
+bool parseExtraPixel (Datastore* datastore, DatastoreIndex* index, cJSON* json_pixel, uint32_t* nErrors) {
+    if (!datastore || !index || !json_pixel) {
         return true;
     }
 
@@ -403,11 +541,17 @@ bool parseExtraPixel (Datastore* datastore, cJSON* json_pixel) {
     color.g = g;
     color.b = b;
 
+    if (findInHashTable(index->pixels, HASH_POSITION_KEY(posX, posY))) {
+        fprintf(stderr, "Configuration error: pixel (%u, %u) is used more than once.\n", posX, posY);
+        (*nErrors)++;
+        return false;
+    }
+
     Pixel* pixel = createPixel(datastore, &color, &position);
-    if (!pixel) {
+    if (!pixel || insertHashTable(index->pixels, HASH_POSITION_KEY(posX, posY), pixel, NULL)) {
         return true;
     }
-    
+
     return false;
 }
 
@@ -453,9 +597,93 @@ bool parseProfile (Datastore* datastore, cJSON* json_profile) {
     return false;
 }
 
+bool parsePanel (Datastore* datastore, cJSON* json_panel) {
+    if (!datastore || !json_panel) {
+        return true;
+    }
+
+    // Read the rectangle of the matrix shown by the panel and where it is driven from
+    cJSON* json_x = cJSON_GetObjectItem(json_panel, "x");
+    cJSON* json_y = cJSON_GetObjectItem(json_panel, "y");
+    cJSON* json_width = cJSON_GetObjectItem(json_panel, "width");
+    cJSON* json_height = cJSON_GetObjectItem(json_panel, "height");
+    cJSON* json_output = cJSON_GetObjectItem(json_panel, "output");
+    if (!cJSON_IsNumber(json_x) || json_x->valueint < 0 || json_x->valueint > UINT16_MAX ||
+        !cJSON_IsNumber(json_y) || json_y->valueint < 0 || json_y->valueint > UINT16_MAX ||
+        !cJSON_IsNumber(json_width) || json_width->valueint <= 0 || json_width->valueint > UINT16_MAX ||
+        !cJSON_IsNumber(json_height) || json_height->valueint <= 0 || json_height->valueint > UINT16_MAX ||
+        !cJSON_IsString(json_output) || json_output->valuestring == NULL) {
+        return true;
+    }
+
+    Panel* panel = createPanel(datastore,
+        (uint16_t)json_x->valueint, (uint16_t)json_y->valueint,
+        (uint16_t)json_width->valueint, (uint16_t)json_height->valueint,
+        json_output->valuestring);
+    if (!panel) {
+        return true;
+    }
+
+    // Optional: encoding, frame rate cap and time, in seconds, between keyframes of delta frames.
+    // The keyframe period must fit in 32 bits once in ms.
+    cJSON* json_format = cJSON_GetObjectItem(json_panel, "format");
+    cJSON* json_fps = cJSON_GetObjectItem(json_panel, "fps");
+    cJSON* json_keyframe = cJSON_GetObjectItem(json_panel, "keyframe");
+    if (json_format || json_fps || json_keyframe) {
+        uint8_t format = FRAME_FORMAT_TEXT;
+        if ((json_format && (!cJSON_IsString(json_format) || parseFrameFormat(json_format->valuestring, &format))) ||
+            (json_fps && (!cJSON_IsNumber(json_fps) || json_fps->valueint < 0)) ||
+            (json_keyframe && (!cJSON_IsNumber(json_keyframe) || json_keyframe->valuedouble < 0 ||
+                json_keyframe->valuedouble > UINT32_MAX / 1000.0))) {
+            return true;
+        }
+
+        if (setPanelEncoding(panel, format,
+                json_fps ? (uint32_t)json_fps->valueint : 0,
+                json_keyframe != NULL,
+                json_keyframe ? (uint32_t)(json_keyframe->valuedouble*1000) : 0)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool parseMatrix (Datastore* datastore, cJSON* json_matrix, uint32_t* nErrors) {
+    if (!datastore || !json_matrix) {
+        return true;
+    }
+
+    cJSON* json_width = cJSON_GetObjectItem(json_matrix, "width");
+    cJSON* json_height = cJSON_GetObjectItem(json_matrix, "height");
+    if (!cJSON_IsNumber(json_width) || json_width->valueint <= 0 || json_width->valueint > UINT16_MAX ||
+        !cJSON_IsNumber(json_height) || json_height->valueint <= 0 || json_height->valueint > UINT16_MAX ||
+        setMatrixSize(datastore, (uint16_t)json_width->valueint, (uint16_t)json_height->valueint)) {
+        return true;
+    }
+
+    // Optional: panels the matrix is split into, each with its own output
+    cJSON *panels = cJSON_GetObjectItem(json_matrix, "panels"),
+        *panel = NULL;
+    if (panels && !cJSON_IsArray(panels)) {
+        return true;
+    }
+    int position = 0;
+    cJSON_ArrayForEach(panel, panels) {
+        if (parsePanel(datastore, panel)) {
+            // Error parsing panel, keep going to report the others
+            fprintf(stderr, "Configuration error: invalid panel %d.\n", position);
+            (*nErrors)++;
+        }
+        position++;
+    }
+
+    return false;
+}
+
 Datastore* importConfiguration(const char* filename) {
     
-    char* jsonString = getMinifiedJSONStringFromFile(filename);
+    char* jsonString = getJSONStringFromFile(filename);
     if (!jsonString) {
         return NULL;
     }
@@ -473,22 +701,53 @@ Datastore* importConfiguration(const char* filename) {
         return NULL;
     }
 
+    // Everything is inserted first, then IDs and references are checked in one pass.
+    // Errors are counted and reported as found, so a single run shows all of them.
+    datastore->bulkLoad = true;
+    uint32_t nErrors = 0;
+    int position;
+
+    // Optional: size of the RGB matrix and its panels. 30x30 on the output stream by default.
+    cJSON* json_matrix = cJSON_GetObjectItem(json, "matrix");
+    if (json_matrix && parseMatrix(datastore, json_matrix, &nErrors)) {
+        fprintf(stderr, "Configuration error: invalid matrix.\n");
+        nErrors++;
+    }
+
     // Parse the room's data from the configuration file
     cJSON *rooms = cJSON_GetObjectItem(json, "rooms"),
         *room = NULL;
     if (!cJSON_IsArray(rooms)) {
-        deleteDatastore(datastore);
-        cJSON_Delete(json);
-        free(jsonString);
-        return NULL;
+        fprintf(stderr, "Configuration error: missing rooms.\n");
+        nErrors++;
     }
+    position = 0;
     cJSON_ArrayForEach(room, rooms) {
-        if(parseRoom(datastore, room)) {
+        if(parseRoom(datastore, room, &nErrors)) {
             // Error parsing room
-            deleteDatastore(datastore);
-            cJSON_Delete(json);
-            free(jsonString);
-            return NULL;
+            fprintf(stderr, "Configuration error: invalid room %d.\n", position);
+            nErrors++;
+        }
+        position++;
+    }
+
+    // Optional: history of readings kept per sensor, allocated once all sensors are known
+    cJSON* json_history = cJSON_GetObjectItem(json, "history");
+    if (json_history) {
+        cJSON* json_size = cJSON_GetObjectItem(json_history, "size");
+        cJSON* json_window = cJSON_GetObjectItem(json_history, "window");
+        cJSON* json_alpha = cJSON_GetObjectItem(json_history, "alpha");
+
+        if (!cJSON_IsObject(json_history) || !cJSON_IsNumber(json_size) || json_size->valueint <= 0 ||
+            (json_window && (!cJSON_IsNumber(json_window) || json_window->valuedouble < 0)) ||
+            (json_alpha && !cJSON_IsNumber(json_alpha)) ||
+            createSensorHistories(datastore,
+                (uint32_t)json_size->valueint,
+                json_window ? (uint32_t)(json_window->valuedouble*1000) : 0,
+                json_alpha ? (float)json_alpha->valuedouble : SENSOR_HISTORY_DEFAULT_ALPHA)) {
+
+            fprintf(stderr, "Configuration error: invalid history.\n");
+            nErrors++;
         }
     }
 
@@ -496,56 +755,95 @@ Datastore* importConfiguration(const char* filename) {
     cJSON *profiles = cJSON_GetObjectItem(json, "profiles"),
         *profile = NULL;
     if (!cJSON_IsArray(profiles)) {
-        deleteDatastore(datastore);
-        cJSON_Delete(json);
-        free(jsonString);
-        return NULL;
+        fprintf(stderr, "Configuration error: missing profiles.\n");
+        nErrors++;
     }
+    position = 0;
     cJSON_ArrayForEach(profile, profiles) {
         if(parseProfile(datastore, profile)) {
             // Error parsing Profile
-            deleteDatastore(datastore);
-            cJSON_Delete(json);
-            free(jsonString);
-            return NULL;
+            fprintf(stderr, "Configuration error: invalid profile %d.\n", position);
+            nErrors++;
         }
+        position++;
     }
 
-    // Parse the rule's data from the configuration file
-    cJSON *rules = cJSON_GetObjectItem(json, "rules"),
-        *rule = NULL;
-    if (!cJSON_IsArray(rules)) {
+    // Checks the IDs parsed so far, rules find what they use in the index
+    DatastoreIndex* index = indexDatastore(datastore, &nErrors);
+    if (!index) {
         deleteDatastore(datastore);
         cJSON_Delete(json);
         free(jsonString);
         return NULL;
     }
+
+    // Parse the rule's data from the configuration file
+    cJSON *rules = cJSON_GetObjectItem(json, "rules"),
+        *rule = NULL;
+    if (!cJSON_IsArray(rules)) {
+        fprintf(stderr, "Configuration error: missing rules.\n");
+        nErrors++;
+    }
+    position = 0;
     cJSON_ArrayForEach(rule, rules) {
-        if(parseRule(datastore, NULL, rule)) {
+        if(parseRule(datastore, index, NULL, rule, &nErrors)) {
             // Error parsing rule
-            deleteDatastore(datastore);
-            cJSON_Delete(json);
-            free(jsonString);
-            return NULL;
+            fprintf(stderr, "Configuration error: invalid rule %d.\n", position);
+            nErrors++;
         }
+        position++;
+    }
+
+    // Optional: how rules driving the same actuator are combined
+    cJSON* json_policy = cJSON_GetObjectItem(json, "actuatorPolicy");
+    if (json_policy) {
+        if (!cJSON_IsString(json_policy) || json_policy->valuestring == NULL) {
+            fprintf(stderr, "Configuration error: invalid actuatorPolicy.\n");
+            nErrors++;
+        }
+        else if (!strcmp(json_policy->valuestring, "last")) {
+            datastore->actuatorPolicy = ACTUATOR_POLICY_LAST_WRITER;
+        }
+        else if (!strcmp(json_policy->valuestring, "any")) {
+            datastore->actuatorPolicy = ACTUATOR_POLICY_ANY_TRUE;
+        }
+        else if (!strcmp(json_policy->valuestring, "priority")) {
+            datastore->actuatorPolicy = ACTUATOR_POLICY_PRIORITY;
+        }
+        else {
+            fprintf(stderr, "Configuration error: unknown actuatorPolicy %s.\n", json_policy->valuestring);
+            nErrors++;
+        }
+        invalidateRuleProgram(datastore);
     }
 
     // Parse the extra pixel's data from the configuration file
     cJSON *pixels = cJSON_GetObjectItem(json, "pixels"),
         *pixel = NULL;
     if (!cJSON_IsArray(pixels)) {
-        deleteDatastore(datastore);
-        cJSON_Delete(json);
-        free(jsonString);
-        return NULL;
+        fprintf(stderr, "Configuration error: missing pixels.\n");
+        nErrors++;
     }
+    position = 0;
     cJSON_ArrayForEach(pixel, pixels) {
-        if(parseExtraPixel(datastore, pixel)) {
+        if(parseExtraPixel(datastore, index, pixel, &nErrors)) {
             // Error parsing extra Pixel
-            deleteDatastore(datastore);
-            cJSON_Delete(json);
-            free(jsonString);
-            return NULL;
+            fprintf(stderr, "Configuration error: invalid pixel %d.\n", position);
+            nErrors++;
+        }
+        position++;
+    }
+
+    deleteDatastoreIndex(index);
+    datastore->bulkLoad = false;
+
+    // Pixels past the edge of the matrix would never be shown
+    LL_iterator(datastore->pixels, pixel_elem) {
+        Pixel* outside = (Pixel*)pixel_elem->ptr;
+        if (outside->pos->x >= datastore->matrixWidth || outside->pos->y >= datastore->matrixHeight) {
+            fprintf(stderr, "Configuration error: pixel (%u, %u) is outside the %ux%u matrix.\n",
+                outside->pos->x, outside->pos->y, datastore->matrixWidth, datastore->matrixHeight);
+            nErrors++;
         }
     }
 
@@ -553,6 +851,12 @@ Datastore* importConfiguration(const char* filename) {
     //printf("%s\n", jsonString);
     cJSON_Delete(json);
     free(jsonString);
+
+    if (nErrors) {
+        fprintf(stderr, "%u error(s) in configuration file %s.\n", nErrors, filename);
+        deleteDatastore(datastore);
+        return NULL;
+    }
     
     return datastore;
 }
\ No newline at end of file
@@ -7,10 +7,21 @@
 #include "Node.h"
 #include "Sensor.h"
 #include "Actuator.h"
+#include "Panel.h"
+#include "FrameWriter.h"
 #include "cJSON.h"
 
+/**
+ * @brief Reads a whole configuration file at once
+ *
+ * @param filename Filename and directory of the file to be read
+ * @return char* Contents of the file, to be freed by the caller. NULL if error.
+ */
+char* getJSONStringFromFile (const char* filename);
+
 /**
  * @brief Imports the configuration of the nodes and their layout from a file.
+ * Every error found in the file is reported on stderr, not just the first one.
  * 
  * @param filename Filename and directory of the file to be read
  * @return Datastore* Datastore object with all the information already inserted. NULL if error.
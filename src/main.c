@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <signal.h>
 #include <libpq-fe.h>
 
 #include "DBLink.h"
@@ -9,7 +11,16 @@
 #include "Rule.h"
 #include "Node.h"
 #include "Sensor.h"
+#include "ColorBatch.h"
 #include "Profile.h"
+#include "RuleWorkers.h"
+#include "ConfigReload.h"
+#include "ConfigImage.h"
+#include "Framebuffer.h"
+#include "FrameWriter.h"
+#include "OutputSink.h"
+#include "Metrics.h"
+#include "Clock.h"
 #include "functions.h"
 #include "ImportConfiguration.h"
 
@@ -33,33 +44,29 @@
 #define MESSAGE_HANDLING_INFO 20
 #define END 22
 
-// RGB Matrix configuration
-#define X_SIZE  30
-#define Y_SIZE  X_SIZE
-
-#define DEFAULT_COLOR_R PIXEL_DEFAULT_RED
-#define DEFAULT_COLOR_G PIXEL_DEFAULT_GREEN
-#define DEFAULT_COLOR_B PIXEL_DEFAULT_BLUE
-
 // Multithreading
 #define THREAD_READINPUT    0
 #define THREAD_EXECUTERULES 1
-#define THREAD_WRITEOUTPUT  2
+#define THREAD_MAIN         2   // Only used as reader slot of the live datastore
 
 typedef struct {
-    Datastore* datastore;
+    ConfigReload* reload;
     FILE* stream;
     bool active;
     list* queryList;
+    RuleWorkers* workers;
+    Framebuffer* framebuffer;
+    list* sinks;
 }ThreadArgs;
 
 void* thread_readInput (void* arg) {
     ThreadArgs* args = arg;
-    Datastore* datastore = args->datastore;
+    ConfigReload* reload = args->reload;
     FILE* stream = args->stream;
     int* ret = calloc(1, sizeof(int));
     
     char str[BUFFER +1];
+    char *saveptr;
     char *token;
     char *endptr; 
     char data[PAYLOAD_SIZE][MAX_DATASIZE];
@@ -68,10 +75,12 @@ void* thread_readInput (void* arg) {
     while (args->active) {
         //while(fgets(str, BUFFER , fp)){
         if (fgets(str, BUFFER, stream)) {
+            // Every stage the sample goes through is timed from here
+            uint64_t received = getMonotonicTimeNs();
             
             //printf("%s\n", str);
             
-            token = strtok(str, " \n"); //here starts a loop to separate data into respective positions
+            token = strtok_r(str, " \n", &saveptr); //here starts a loop to separate data into respective positions
             
             while (token != NULL) { // Loop until no character is found on the string
             
@@ -83,7 +92,7 @@ void* thread_readInput (void* arg) {
                 
                 data_type++;
 
-                token = strtok(NULL, " \n");
+                token = strtok_r(NULL, " \n", &saveptr);
                 
                 if (data_type == PAYLOAD_SIZE){
                     // Restart postitions
@@ -92,17 +101,32 @@ void* thread_readInput (void* arg) {
                 
             }
 
+            bool parseError = false;
             for (c_vect_index = 0; c_vect_index < PAYLOAD_SIZE; c_vect_index++) {
                 // Converts hex data to dec
                 converted_data[c_vect_index] = strtol(data[c_vect_index], &endptr, 16);
+                parseError |= endptr == data[c_vect_index] || *endptr != '\0';
+            }
+            addMetricCount(METRIC_PACKETS, 1);
+            if (parseError) {
+                addMetricCount(METRIC_PACKET_ERRORS, 1);
             }
             
             // Here we set the sensor values with converted data in its respective Node IDs and Sensor Type
-            setSensorValue (findSensorByType (findNodeByID (datastore, converted_data[MOTE_ID]), TYPE_SENSOR_VOLTAGE), converted_data[RAW_VOLTAGE]);
-            setSensorValue (findSensorByType (findNodeByID (datastore, converted_data[MOTE_ID]), TYPE_SENSOR_TEMPERATURE), converted_data[RAW_TEMPERATURE]);
-            setSensorValue (findSensorByType (findNodeByID (datastore, converted_data[MOTE_ID]), TYPE_SENSOR_HUMIDITY), converted_data[RAW_HUMIDITY]);
-            setSensorValue (findSensorByType (findNodeByID (datastore, converted_data[MOTE_ID]), TYPE_SENSOR_LIGHT), converted_data[RAW_VISIBLE_LIGHT]);
-            setSensorValue (findSensorByType (findNodeByID (datastore, converted_data[MOTE_ID]), TYPE_SENSOR_CURRENT), converted_data[RAW_CURRENT]);
+            Datastore* datastore = acquireDatastore(reload, THREAD_READINPUT);
+            Node* node = findNodeByID(datastore, converted_data[MOTE_ID]);
+            if (!node) {
+                addMetricCount(METRIC_PACKETS_UNKNOWN, 1);
+            }
+            setSensorSample (findSensorByType (node, TYPE_SENSOR_VOLTAGE), converted_data[RAW_VOLTAGE], received);
+            setSensorSample (findSensorByType (node, TYPE_SENSOR_TEMPERATURE), converted_data[RAW_TEMPERATURE], received);
+            setSensorSample (findSensorByType (node, TYPE_SENSOR_HUMIDITY), converted_data[RAW_HUMIDITY], received);
+            setSensorSample (findSensorByType (node, TYPE_SENSOR_LIGHT), converted_data[RAW_VISIBLE_LIGHT], received);
+            setSensorSample (findSensorByType (node, TYPE_SENSOR_CURRENT), converted_data[RAW_CURRENT], received);
+            releaseDatastore(reload, THREAD_READINPUT);
+            if (node) {
+                recordMetricTime(METRIC_SAMPLE_INGEST_TIME, getMonotonicTimeNs() - received);
+            }
             
             
             // some printfs for debugging
@@ -125,62 +149,35 @@ void* thread_readInput (void* arg) {
 
 void* thread_executeRules (void* arg) {
     ThreadArgs* args = arg;
-    Datastore* datastore = args->datastore;
+    ConfigReload* reload = args->reload;
     list* queryList = args->queryList;
+    RuleWorkers* workers = args->workers;
+    Framebuffer* framebuffer = args->framebuffer;
+    list* sinks = args->sinks;
     //FILE* stream = args->stream;
     int* ret = calloc(1, sizeof(int));
     
     while (args->active) {
-        executeRules(datastore, true, queryList);
-
-        LL_iterator(datastore->rooms, room_elem) {
-            Room* room = room_elem->ptr;
-            LL_iterator(room->nodes, node_elem) {
-                Node* node = node_elem->ptr;
-                LL_iterator(node->sensors, sensor_elem) {
-                    Sensor* sensor = sensor_elem->ptr;
-                    updateSensorPixel(sensor);
-                }
-            }
+        uint64_t start = getMonotonicTimeNs();
+        Datastore* datastore = acquireDatastore(reload, THREAD_EXECUTERULES);
+        claimSensorSamples(datastore);
+        executeRulesOnWorkers(workers, datastore, true, queryList);
+        recordSampleLatency(datastore, METRIC_SAMPLE_RULES_TIME);
+
+        updateSensorPixels(datastore);
+        recordSampleLatency(datastore, METRIC_SAMPLE_PIXEL_TIME);
+
+        // Hand the frame over to every output sink, which never touch the pixels
+        renderFrame(framebuffer, datastore);
+        LL_iterator(sinks, sink_elem) {
+            publishOutputSink((OutputSink*)sink_elem->ptr, getBackFrame(framebuffer));
         }
-    }
-
-    pthread_exit(ret);
-}
+        publishFrame(framebuffer);
+        recordSampleLatency(datastore, METRIC_SAMPLE_FRAME_TIME);
+        releaseDatastore(reload, THREAD_EXECUTERULES);
 
-void* thread_writeOutput (void* arg) {
-    ThreadArgs* args = arg;
-    Datastore* datastore = args->datastore;
-    FILE* stream = args->stream;
-    int* ret = calloc(1, sizeof(int));
-    
-    while (args->active) {
-        fprintf(stream, "[");
-        for (int x = 0; x < X_SIZE; x++) {
-            for (int y = 0; y < Y_SIZE; y++) {
-                Position position;
-                position.x = x;
-                position.y = y;
-
-                Pixel* pixel = findPixelByPos(datastore, &position);
-                if (pixel) {
-                    pthread_mutex_lock(&pixel->mutex);
-                    fprintf(stream, "[%d,%d,%d]", pixel->color->r, pixel->color->g, pixel->color->b);
-                    pthread_mutex_unlock(&pixel->mutex);
-                }
-                else {
-                    fprintf(stream, "[%d,%d,%d]", DEFAULT_COLOR_R, DEFAULT_COLOR_G, DEFAULT_COLOR_B);
-                }
-
-                if (y < X_SIZE-1) {
-                    fprintf(stream, ",");
-                }
-            }
-            if (x < Y_SIZE-1) {
-                fprintf(stream, ",");
-            }
-        }
-        fprintf(stream, "]\n");
+        addMetricCount(METRIC_RULE_PASSES, 1);
+        recordMetricTime(METRIC_RULE_PASS_TIME, getMonotonicTimeNs() - start);
     }
 
     pthread_exit(ret);
@@ -224,13 +221,130 @@ void createAllDBTables (list* queryList) {
     DB_exec(queryList, "create_table_profile_rule", NULL);
 }
 
-int main(int argc, char const *argv[]) {
-    if (argc < 5) {
-        printf("Not enough arguments. Expecting:\n\t%s <configuration-file> <db-conn-configuration-file> <input-stream> <output-stream>\n\n", argv[0]);
+void printUsage (const char* name) {
+    printf("Expecting:\n\t%s [-j <rule-threads>] [-c <configuration-image>] [-f text|rgb888|rgb565] [-d <keyframe-ms>] [-r <fps>] [-o <output>[,<format>[,<fps>[,<keyframe-ms>]]]]... [-s <shm-name>] [-m <metrics-socket>] <configuration-file> <db-conn-configuration-file> <input-stream> <output-stream>\n", name);
+    printf("\t%s -C <configuration-image> <configuration-file>\n\n", name);
+}
+
+// Loads the configuration from its compiled image, rebuilding the image from the file when stale
+Datastore* loadConfiguration (const char* filename, const char* imageFilename) {
+    if (!imageFilename) {
+        return importConfiguration(filename);
+    }
+
+    Datastore* datastore = loadConfigImage(imageFilename, filename);
+    if (datastore) {
+        return datastore;
+    }
+
+    datastore = importConfiguration(filename);
+    if (datastore && writeConfigImage(datastore, imageFilename, filename)) {
+        fprintf(stderr, "Error writing the configuration image %s.\n", imageFilename);
+    }
+
+    return datastore;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t nRuleThreads = 1;
+    char* imageFilename = NULL;
+    bool compileOnly = false;
+    uint8_t outputFormat = FRAME_FORMAT_TEXT;
+    bool deltaOutput = false;
+    uint32_t keyframePeriod = 0;
+    uint32_t maxFps = OUTPUT_SINK_UNCAPPED;
+    char* sinkSpecs[OUTPUT_SINK_MAX];
+    uint8_t nSinkSpecs = 0;
+    char* sharedFrameName = NULL;
+    char* metricsSocket = NULL;
+    int option;
+
+    while ((option = getopt(argc, argv, "j:c:C:f:d:r:o:s:m:")) != -1) {
+        switch (option) {
+            case 'j':
+                nRuleThreads = strtol(optarg, (char **)NULL, 10);
+                if (!nRuleThreads || nRuleThreads > RULE_WORKERS_MAX_THREADS) {
+                    printf("Invalid number of rule threads.\n");
+                    return 1;
+                }
+                break;
+            case 'C':
+                compileOnly = true;
+                // fall through
+            case 'c':
+                imageFilename = optarg;
+                break;
+            case 'f':
+                if (parseFrameFormat(optarg, &outputFormat)) {
+                    printf("Invalid output format.\n");
+                    return 1;
+                }
+                break;
+            case 'd':
+                deltaOutput = true;
+                if (parseOutputSinkNumber(optarg, &keyframePeriod)) {
+                    printf("Invalid keyframe period.\n");
+                    return 1;
+                }
+                break;
+            case 'r':
+                if (parseOutputSinkNumber(optarg, &maxFps)) {
+                    printf("Invalid frame rate.\n");
+                    return 1;
+                }
+                break;
+            case 'o':
+                // The output stream argument is a sink too
+                if (nSinkSpecs >= OUTPUT_SINK_MAX-1) {
+                    printf("Too many outputs.\n");
+                    return 1;
+                }
+                sinkSpecs[nSinkSpecs++] = optarg;
+                break;
+            case 's':
+                sharedFrameName = optarg;
+                break;
+            case 'm':
+                metricsSocket = optarg;
+                break;
+            default:
+                printUsage(argv[0]);
+                return 1;
+        }
+    }
+
+    // Compile the configuration image and quit
+    if (compileOnly) {
+        if (argc - optind < 1) {
+            printf("Not enough arguments. ");
+            printUsage(argv[0]);
+            return 1;
+        }
+
+        Datastore* datastore = importConfiguration(argv[optind]);
+        if (!datastore) {
+            printf("Error in config file.\n");
+            return 1;
+        }
+
+        bool error = writeConfigImage(datastore, imageFilename, argv[optind]);
+        deleteDatastore(datastore);
+        if (error) {
+            printf("Error writing the configuration image.\n");
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if (argc - optind < 4) {
+        printf("Not enough arguments. ");
+        printUsage(argv[0]);
         return 1;
     }
+    char** args = &argv[optind];
 
-    char* connStr = getConnectionStringFromFile(argv[2]);
+    char* connStr = getConnectionStringFromFile(args[1]);
     if (!connStr) {
         printf("Error reading the DB connection string Configuration File\n");
         return 1;
@@ -250,73 +364,143 @@ int main(int argc, char const *argv[]) {
     createAllDBTables(queryList);
     DB_prepareRegularQueries(conn, queryList);
 
-    Datastore* datastore = importConfiguration(argv[1]);
+    Datastore* datastore = loadConfiguration(args[0], imageFilename);
     if (!datastore) {
         printf("Error in config file.\n");
         return 1;
     }
 
     DB_uploadConfiguration(datastore, queryList);
+
+    // Before any other thread: SIGHUP must stay blocked in all of them
+    ConfigReload* reload = createConfigReload(args[0], &importConfiguration, datastore);
+    if (!reload) {
+        printf("Error starting the configuration reload thread.\n");
+        return 1;
+    }
     
-    FILE* inputStream = fopen(argv[3], "r");
-    FILE* outputStream = fopen(argv[4], "w");
+    FILE* inputStream = fopen(args[2], "r");
     //FILE* inputStream = stdin;
-    //FILE* outputStream = stdout;
-    if (!inputStream || !outputStream) {
+    if (!inputStream) {
         printf("Error reading streams. Please verify.\n");
         return 1;
     }
 
-    pthread_t threads[3];
-    int thread_IDs[3];
-    void* thread_retValues[3];
-    ThreadArgs thread_args[3];
+    RuleWorkers* workers = createRuleWorkers(nRuleThreads);
+    if (!workers) {
+        printf("Error starting the rule threads.\n");
+        return 1;
+    }
+
+    // The matrix keeps the size it had at startup, reloads only change what is drawn on it
+    uint16_t width = datastore->matrixWidth;
+    uint16_t height = datastore->matrixHeight;
+    Framebuffer* framebuffer = createFramebuffer(width, height);
+    if (!framebuffer) {
+        printf("Error creating the framebuffer.\n");
+        return 1;
+    }
+
+    // Local consumers can sample the matrix from shared memory, without going through the output
+    if (sharedFrameName && exportFramebuffer(framebuffer, sharedFrameName)) {
+        printf("Error creating the shared memory segment %s.\n", sharedFrameName);
+        return 1;
+    }
+
+    // Every output gets the frames at its own rate, in its own thread.
+    // A reader closing its end must only stop that output, not the whole process.
+    signal(SIGPIPE, SIG_IGN);
+
+    // Counters, gauges and latency histograms, scraped in the Prometheus text format
+    MetricsServer* metrics = NULL;
+    if (metricsSocket) {
+        metrics = createMetricsServer(metricsSocket);
+        if (!metrics) {
+            printf("Error listening on the metrics socket %s.\n", metricsSocket);
+            return 1;
+        }
+    }
+    list* sinks = newList();
+    if (!sinks) {
+        return 1;
+    }
+
+    OutputSink* sink = createOutputSink(args[3], outputFormat, maxFps, deltaOutput, keyframePeriod, width, height);
+    if (!sink || !listInsert(sinks, sink, NULL)) {
+        printf("Error opening the output %s. Delta output needs a binary output format.\n", args[3]);
+        return 1;
+    }
+
+    for (uint8_t i = 0; i < nSinkSpecs; i++) {
+        sink = createOutputSinkFromSpec(sinkSpecs[i], width, height);
+        if (!sink || !listInsert(sinks, sink, NULL)) {
+            printf("Error opening the output %s.\n", sinkSpecs[i]);
+            return 1;
+        }
+    }
+
+    // Each panel of the configuration only gets its own part of the matrix
+    LL_iterator(datastore->panels, panel_elem) {
+        Panel* panel = (Panel*)panel_elem->ptr;
+        sink = createOutputSink(panel->output, panel->format, panel->maxFps, panel->delta, panel->keyframePeriod, panel->width, panel->height);
+        if (!sink || setOutputSinkRegion(sink, panel->x, panel->y, width, height) || !listInsert(sinks, sink, NULL)) {
+            printf("Error opening the output %s of the panel at (%u, %u).\n", panel->output, panel->x, panel->y);
+            return 1;
+        }
+    }
+
+    pthread_t threads[2];
+    int thread_IDs[2];
+    void* thread_retValues[2];
+    ThreadArgs thread_args[2];
 
     // Prepare thread arguments
-    thread_args[THREAD_READINPUT].datastore = datastore;
+    thread_args[THREAD_READINPUT].reload = reload;
     thread_args[THREAD_READINPUT].stream = inputStream;
     thread_args[THREAD_READINPUT].active = true;
     thread_args[THREAD_READINPUT].queryList = queryList;
+    thread_args[THREAD_READINPUT].workers = workers;
+    thread_args[THREAD_READINPUT].framebuffer = framebuffer;
+    thread_args[THREAD_READINPUT].sinks = sinks;
 
-    thread_args[THREAD_EXECUTERULES].datastore = datastore;
+    thread_args[THREAD_EXECUTERULES].reload = reload;
     thread_args[THREAD_EXECUTERULES].stream = NULL;
     thread_args[THREAD_EXECUTERULES].active = true;
     thread_args[THREAD_EXECUTERULES].queryList = queryList;
-
-    thread_args[THREAD_WRITEOUTPUT].datastore = datastore;
-    thread_args[THREAD_WRITEOUTPUT].stream = outputStream;
-    thread_args[THREAD_WRITEOUTPUT].active = true;
-    thread_args[THREAD_WRITEOUTPUT].queryList = queryList;
+    thread_args[THREAD_EXECUTERULES].workers = workers;
+    thread_args[THREAD_EXECUTERULES].framebuffer = framebuffer;
+    thread_args[THREAD_EXECUTERULES].sinks = sinks;
 
 
     // Create the threads
     thread_IDs[THREAD_READINPUT] = pthread_create(&threads[THREAD_READINPUT], NULL, &thread_readInput, &thread_args[THREAD_READINPUT]);
     thread_IDs[THREAD_EXECUTERULES] = pthread_create(&threads[THREAD_EXECUTERULES], NULL, &thread_executeRules, &thread_args[THREAD_EXECUTERULES]);
-    thread_IDs[THREAD_WRITEOUTPUT] = pthread_create(&threads[THREAD_WRITEOUTPUT], NULL, &thread_writeOutput, &thread_args[THREAD_WRITEOUTPUT]);
 
-    // Run until asked to quit
+    // Run until asked to quit. SIGHUP reloads the configuration file.
     printf("\n\nPress ENTER to exit...");
     getchar();
 
+    datastore = acquireDatastore(reload, THREAD_MAIN);
     moveNodeToRoom(findNodeByID(datastore, 1), findRoomByID(datastore, 2), queryList);
     moveSensorToNode(findSensorByID(datastore, 1), findNodeByID(datastore, 2), queryList);
     moveActuatorToNode(findActuatorByID(datastore, 1), findNodeByID(datastore, 2), queryList);
+    releaseDatastore(reload, THREAD_MAIN);
 
     // Signal threads to die
     thread_args[THREAD_READINPUT].active = false;
     thread_args[THREAD_EXECUTERULES].active = false;
-    thread_args[THREAD_WRITEOUTPUT].active = false;
 
     // Wait for thread endings
     pthread_join(threads[THREAD_READINPUT], &thread_retValues[THREAD_READINPUT]);
     pthread_join(threads[THREAD_EXECUTERULES], &thread_retValues[THREAD_EXECUTERULES]);
-    pthread_join(threads[THREAD_WRITEOUTPUT], &thread_retValues[THREAD_WRITEOUTPUT]);
+
+    // Waits for a reload in progress, the datastore is final from now on
+    deleteConfigReload(reload, &datastore);
 
     // Print Thread return values
     fprintf(stderr, "Thread return values:\n");
     fprintf(stderr, "\t%d\n", *(int*)thread_retValues[THREAD_READINPUT]);
     fprintf(stderr, "\t%d\n", *(int*)thread_retValues[THREAD_EXECUTERULES]);
-    fprintf(stderr, "\t%d\n", *(int*)thread_retValues[THREAD_WRITEOUTPUT]);
 
     // Free memory used by threads to return a value to the parent process
     uint8_t nThreads = sizeof(thread_retValues)/sizeof(thread_retValues[0]);
@@ -325,8 +509,24 @@ int main(int argc, char const *argv[]) {
     }
 
 
+    deleteRuleWorkers(workers);
+
+    // Delete all output sinks
+    list_element* sink_elem = listStart(sinks);
+    while (sink_elem != NULL) {
+        deleteOutputSink(sink_elem->ptr);
+        listRemove(sinks, sink_elem);
+        sink_elem = listStart(sinks);
+    }
+    deleteList(sinks);
+    deleteMetricsServer(metrics);
+
+    // Latency of the samples over the whole run
+    fprintf(stderr, "Latency:\n");
+    writeLatencyReport(stderr);
+
+    deleteFramebuffer(framebuffer);
     fclose(inputStream);
-    fclose(outputStream);
     PQfinish(conn);
     deleteList(queryList);
     deleteDatastore(datastore);